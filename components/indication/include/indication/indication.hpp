@@ -4,6 +4,7 @@
 #include <string> // Native Libraries
 
 #include "esp_log.h" // ESP Libraries
+#include "esp_timer.h"
 #include "led_strip.h"
 
 #include "freertos/FreeRTOS.h" // RTOS Libraries
@@ -26,6 +27,14 @@ extern "C"
         ~Indication();
 
         QueueHandle_t &getColorCmdRequestQueue(void);
+        bool setDefaultValues(uint8_t, uint8_t, uint8_t);
+        bool setPixel(uint16_t, uint8_t, uint8_t, uint8_t);
+        bool setSegment(uint16_t, uint16_t, uint8_t, uint8_t, uint8_t);
+        void getRenderStats(IND_RenderStats *);
+        void logRenderStats(void);
+        void getSequenceStats(IND_SequenceStats *);
+        void logSequenceStats(void);
+        void getSettingsStats(IND_SettingsStats *);
 
     private:
         char TAG[5] = "IND ";
@@ -53,6 +62,36 @@ extern "C"
         uint8_t bCurrValue = 0;
         uint8_t cCurrValue = 0;
 
+        IND_Pixel frameBuffer[IND_LED_COUNT] = {}; // What the strip shows, or will once the dirty range is sent
+        uint16_t dirtyFirst = 0;                     // Clean when dirtyFirst > dirtyLast
+        uint16_t dirtyLast = IND_LED_COUNT - 1;      // All dirty at start -- after a warm reset the strip still shows old colors
+        SemaphoreHandle_t frameMutex = nullptr;      // Held while the framebuffer is written or on the wire
+
+        IND_RenderStats renderStats = {};
+        IND_SequenceStats sequenceStats = {};
+        IND_SettingsStats settingsStats = {};
+        int64_t commandStartUs = 0;                           // Set when a command arrives, cleared by the frame that shows it
+        portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED; // Our stats are read from other tasks
+
+        IND_Keyframe keyframes[IND_SEQ_MAX_KEYFRAMES] = {};
+        uint8_t keyframeCount = 0;
+        uint8_t keyframeNext = 0;
+        int64_t sequenceStartUs = 0;                // Start of the current pass
+        uint32_t sequenceLengthUs = 0;              // One pass, for repeats
+        uint8_t sequenceRepeats = 0;                // Passes still to play after this one
+        esp_timer_handle_t sequenceTimer = nullptr; // One-shot, armed for the next keyframe or fade step
+
+        bool blnExtended = false; // The sequence paints RGB on its own pixels
+        uint16_t seqFirstPixel = 0;
+        uint16_t seqPixels = 1;
+        uint32_t seqColor = 0; // 0x00RRGGBB now on the sequence pixels
+
+        bool blnFading = false;
+        uint32_t fadeFrom = 0;
+        uint32_t fadeTo = 0;
+        uint32_t fadeStartUs = 0; // Offset in the pass, like keyframes
+        uint32_t fadeUs = 0;
+
         uint8_t aDefaultValue = 5; // Default values are brightness levels
         uint8_t bDefaultValue = 10;
         uint8_t cDefaultValue = 50;
@@ -63,7 +102,6 @@ extern "C"
 
         IND_OP indOP = IND_OP::Run;
         IND_INIT initINDStep = IND_INIT::Finished;
-        IND_STATES indStates = IND_STATES::Init;
 
         TaskHandle_t runTaskIndication = nullptr;
 
@@ -73,12 +111,12 @@ extern "C"
 
         /* NVS Variables*/
         bool blnSaveNVSVariables = false;
+        bool blnLegacySettings = false; // Per-key values were found and should be erased once the blob is saved
 
         uint8_t clearLEDTargets;
         uint8_t setLEDTargets;
 
         uint8_t dark_delay;
-        uint8_t dark_delay_counter;
 
         uint8_t first_color_target;
         uint8_t first_color_cycles;
@@ -87,17 +125,36 @@ extern "C"
         uint8_t second_color_cycles;
 
         uint8_t color_timeout;
-        uint8_t color_timeout_counter;
-
-        uint8_t first_color_timeout_counter;
-        uint8_t second_color_timeout_counter;
 
+        void startCommand(const IND_Command &);
+        void decodeLegacy(uint32_t);
         void startIndication(uint32_t);
+        bool startExtended(const IND_ExtendedCommand &);
+        void recordDecode(int64_t);
         void setAndClearColors(uint8_t, uint8_t);
+        void writeSegment(uint16_t, uint16_t, uint8_t, uint8_t, uint8_t);
+        bool renderFrame(uint8_t);
+        bool sendFrame(uint16_t);
+        void runRenderBenchmark(void);
         void resetIndication(void);
 
+        uint8_t compileSequence(void);
+        uint8_t compileExtended(const IND_ExtendedCommand &);
+        void startSequence(uint8_t, uint8_t);
+        void playSequence(void);
+        void stepFade(int64_t);
+        void writeSequenceColor(uint32_t);
+        void finishSequence(void);
+        void runDecodeBenchmark(void);
+        static void sequenceTimerCallback(void *);
+
         bool restoreVariblesFromNVS(void);
         bool saveVariblesToNVS(void);
+        bool decodeSettingsBlob(const uint8_t *, size_t);
+        bool saveStatesToLog(void);
+        bool restoreStatesFromLog(void);
+        void saveResumeState(void);
+        bool restoreResumeState(void);
         std::string getStateText(uint8_t);
 
         static void runMarshaller(void *);
@@ -107,5 +164,7 @@ extern "C"
         bool showInitSteps = false;
         bool showRun = true;
         bool showNVSActions = true;
+        bool showRenderBenchmark = false; // Frames per second against strip length, once after init
+        bool showDecodeBenchmark = false; // Time and heap use of command decoding, once after init
     };
 }
@@ -1,13 +1,52 @@
 #pragma once
+#include "sdkconfig.h"
 
 #include <stdint.h>
 
 #define TRI_COLOR_LED_GPIO 48 // GPIO 48 for ESP32-S3 built-in addressable LED
 #define LED_RMT_CHANNEL 0
+#define IND_LED_COUNT CONFIG_IND_LED_COUNT // Pixels on the strip
 
 //
-// No Command Request or Response structure here.   All messages are currently received by task notification.
+// Command Requests
 //
+// Every item on the color command queue is an IND_Command.  Legacy carries the original 32-bit encoding unchanged (see
+// indication.cpp), with its times counted in ticks.  Extended carries 24-bit colors and times in milliseconds, so it means
+// the same thing whatever configTICK_RATE_HZ is.
+//
+enum class IND_CMD : uint8_t
+{
+    Legacy,
+    Extended,
+};
+
+#define IND_EXT_MAX_CYCLES 13 // Per color, so 2 * 13 cycles always fit IND_SEQ_MAX_KEYFRAMES
+
+struct IND_ExtendedCommand
+{
+    uint32_t firstColor;  // 0x00RRGGBB
+    uint32_t secondColor; // 0x00RRGGBB
+    uint8_t firstCycles;  // 1 through IND_EXT_MAX_CYCLES
+    uint8_t secondCycles; // 0 through IND_EXT_MAX_CYCLES -- 0 for no second color
+    uint8_t repeat;       // The whole pattern plays this many more times
+    uint16_t fadeInMs;    // Ramp up from dark at the start of each cycle
+    uint16_t onMs;        // Held at full color
+    uint16_t fadeOutMs;   // Ramp down to dark
+    uint16_t offMs;       // Dark before the next cycle
+    uint16_t firstPixel;  // Pixels the pattern plays on.  They are dark when it ends and pixel 0 goes back to ColorA..ColorC.
+    uint16_t pixels;      // 0 is taken as 1
+};
+
+struct IND_Command
+{
+    IND_CMD type;
+
+    union
+    {
+        IND_ExtendedCommand extended; // First, so "IND_Command command = {}" clears all of it
+        uint32_t legacy;
+    };
+};
 
 //
 // Class Operations
@@ -27,6 +66,133 @@ enum class LED_STATE : uint8_t
     ON,
 };
 
+//
+// Persisted settings live in one versioned, CRC checked blob.  Fields are only ever appended.  A blob written by older
+// firmware is shorter, so the fields it lacks keep their defaults.  Bump IND_SETTINGS_VERSION whenever a field is added or
+// its meaning changes and add an upgrade step in Indication::decodeSettingsBlob().
+//
+#define IND_SETTINGS_KEY "settings"
+#define IND_SETTINGS_VERSION 1
+#define IND_SETTINGS_MAX_SIZE 64 // Largest blob we accept -- room for newer firmware to append fields
+
+struct IND_SettingsBlob
+{
+    uint32_t crc;     // esp_rom_crc32_le over every byte after this field, up to length
+    uint16_t version; // IND_SETTINGS_VERSION of the firmware that wrote it
+    uint16_t length;  // sizeof(IND_SettingsBlob) of the firmware that wrote it
+    uint8_t aState;   // LED_STATE
+    uint8_t bState;
+    uint8_t cState;
+    uint8_t aDefValue;
+    uint8_t bDefValue;
+    uint8_t cDefValue;
+};
+
+//
+// The LED states change with every manual ON/OFF/AUTO command, so they are also kept in the System log store where a change
+// is one small append.  When present they are newer than the states in the settings blob.
+//
+#define IND_STATES_LOG_KEY "ind.states" // aState, bState, cState as LED_STATE bytes
+
+//
+// Our part of the System warm resume snapshot.  Only ever read back by the firmware that wrote it.
+//
+struct IND_ResumeState
+{
+    uint8_t aState; // LED_STATE
+    uint8_t bState;
+    uint8_t cState;
+    uint8_t aDefValue;
+    uint8_t bDefValue;
+    uint8_t cDefValue;
+};
+
+//
+// The render layer keeps the whole strip in one framebuffer and sends at most one frame per logical change.  A WS2812 pixel
+// keeps the first 24 bits it sees and passes the rest on, so a frame only has to run from pixel 0 to the last dirty pixel --
+// everything after it keeps what it shows.
+//
+#define IND_REFRESH_TIMEOUT_MS 100 // Longest we wait on the RMT tx-done event for one frame (300 pixels take about 9 ms)
+
+struct IND_Pixel
+{
+    uint8_t g; // WS2812 wire order, so the framebuffer goes to the RMT as it is
+    uint8_t r;
+    uint8_t b;
+};
+
+static_assert(sizeof(IND_Pixel) == 3, "The framebuffer must be contiguous GRB bytes");
+
+struct IND_RenderStats
+{
+    uint32_t commands;       // Indication requests taken from the queue
+    uint32_t changes;        // Calls to setAndClearColors that touched a color, plus pixel and segment commands
+    uint32_t channelUpdates; // Colors touched -- the old code sent a frame and slept 10 ms for each one
+    uint32_t frames;         // Frames actually sent
+    uint32_t framesSkipped;  // Changes that left the frame as it was
+    uint32_t pixelsDirty;    // Pixels that changed, summed over all frames
+    uint32_t pixelsSent;     // Pixels shifted out -- a full refresh would have sent frames * IND_LED_COUNT
+    uint32_t refreshErrors;
+    uint32_t refreshMaxUs;   // Frame handed to the RMT until it reported done
+    uint32_t latencyLastUs;  // Command taken from the queue until its first frame was on the LED
+    uint32_t latencyMaxUs;
+    uint32_t latencyTotalUs;
+    uint32_t latencyCount;
+};
+
+//
+// A command is compiled into a timeline of keyframes when it arrives and then played from one-shot esp_timer deadlines, so
+// IND::Run sleeps between transitions.  Times are offsets from the start of the pass -- a late wakeup never pushes the rest
+// of the pattern back.  Legacy keyframes set and clear ColorA..ColorC, extended ones fade the command's pixels to a color.
+//
+#define IND_LEGACY_MAX_CYCLES 28 // Legacy first color 1..13 (0x0E/0x0F are state commands), second color 0..15
+#define IND_SEQ_MAX_KEYFRAMES (2 * IND_LEGACY_MAX_CYCLES + 1) // An on and an off per cycle, plus the end
+#define IND_FADE_STEP_US 20000  // Frame interval while a fade runs (50 fps)
+
+struct IND_Keyframe
+{
+    uint32_t atUs;       // Offset from the start of the pass
+    uint32_t fadeUs;     // Extended -- reaches rgb at atUs + fadeUs
+    uint32_t rgb;        // Extended -- 0x00RRGGBB
+    uint8_t setColors;   // Legacy -- COLORx_Bit
+    uint8_t clearColors;
+    bool blnRGB;
+};
+
+struct IND_SequenceStats
+{
+    uint32_t sequences;        // Commands compiled into a timeline
+    uint32_t keyframes;        // Keyframes played
+    uint32_t wakeups;          // Times IND::Run woke while a sequence played
+    uint32_t tickWakeups;      // Wakeups the old loop would have taken -- one per tick of every legacy sequence
+    uint32_t lateMaxUs;        // Worst keyframe behind its deadline
+    uint32_t timerErrors;
+    uint32_t fadeFrames;       // Frames asked for by fade steps
+    uint32_t legacyCommands;   // Decoded from each queue item
+    uint32_t extendedCommands;
+    uint32_t rejectedCommands;
+    uint32_t decodeMaxUs;      // Decode and compile of one command
+    uint32_t decodeTotalUs;
+};
+
+enum class IND_SettingsSource : uint8_t // Where the last restore found our settings
+{
+    None,
+    Blob,
+    PerKey,
+    Defaults,
+    BadBlob,
+};
+
+struct IND_SettingsStats
+{
+    uint32_t restores;
+    uint32_t restoreUs;       // The last restore, from opening NVS to the settings decoded
+    uint32_t saves;
+    uint32_t saveUs;          // The last save, staged and committed to the cache
+    IND_SettingsSource source;
+};
+
 enum class IND_OP : uint8_t // Primary Operations
 {
     Run,
@@ -43,15 +209,6 @@ enum class IND_INIT : uint8_t
     ColorC_On,
     ColorC_Off,
     Restore_Settings,
+    Apply_Settings,
     Finished,
 };
-
-enum class IND_STATES : uint8_t
-{
-    Init,
-    Show_FirstColor,
-    FirstColor_Dark,
-    Show_SecondColor,
-    SecondColor_Dark,
-    Final
-};
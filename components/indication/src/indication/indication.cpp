@@ -1,11 +1,17 @@
 #include "indication/indication.hpp"
 #include "led_strip.h"
 
-extern xSemaphoreHandle semSYSEntry;
+#include <stddef.h>
+
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "driver/rmt.h"
+
 xSemaphoreHandle semIndEntry = NULL;
 
 Indication::Indication(System *mySys, int8_t parmMajor, int8_t parmMinor, int8_t parmRev)
 {
+    SYS_BOOT_MARK("IND", "Constructor");
     sys = mySys;
     majorVer = parmMajor; // We pass in the software version of the project so out LEDs
     minorVer = parmMinor; // can flash this out during startup
@@ -15,14 +21,26 @@ Indication::Indication(System *mySys, int8_t parmMajor, int8_t parmMinor, int8_t
     if (semIndEntry != NULL)
         xSemaphoreTake(semIndEntry, portMAX_DELAY); // Hold the locking semaphore until initialization is complete
 
-    pStrip_a = led_strip_init(LED_RMT_CHANNEL, TRI_COLOR_LED_GPIO, 1); // LED strip initialization with the GPIO and pixels number
+    pStrip_a = led_strip_init(LED_RMT_CHANNEL, TRI_COLOR_LED_GPIO, IND_LED_COUNT); // LED strip initialization with the GPIO and pixels number
+    frameMutex = xSemaphoreCreateMutex();
+
+    const esp_timer_create_args_t sequence_timer_args = {
+        .callback = &Indication::sequenceTimerCallback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ind_sequence",
+        .skip_unhandled_events = false};
+
+    if (esp_timer_create(&sequence_timer_args, &sequenceTimer) != ESP_OK)
+        ESP_LOGE(TAG, "Error, unable to create the sequence timer");
 
     resetIndication();
 
-    queColorCmdRequests = xQueueCreate(3, sizeof(uint32_t)); // We can receive up to 3 indication requests and they will play out in order.
+    queColorCmdRequests = xQueueCreate(3, sizeof(IND_Command)); // We can receive up to 3 indication requests and they will play out in order.
 
     indOP = IND_OP::Init;
     initINDStep = IND_INIT::Start;
+    SYS_BOOT_MARK("IND", "Create IND::Run");
     xTaskCreate(runMarshaller, "IND::Run", 1024 * 3, this, 5, &runTaskIndication); // Low number indicates low priority task
 }
 
@@ -34,6 +52,15 @@ Indication::~Indication()
     if (semIndEntry != NULL)
         vSemaphoreDelete(semIndEntry);
 
+    if (frameMutex != nullptr)
+        vSemaphoreDelete(frameMutex);
+
+    if (sequenceTimer != nullptr)
+    {
+        esp_timer_stop(sequenceTimer);
+        esp_timer_delete(sequenceTimer);
+    }
+
     if (this->runTaskIndication != nullptr)
         vTaskDelete(NULL);
 }
@@ -90,28 +117,77 @@ QueueHandle_t &Indication::getColorCmdRequestQueue(void)
 //
 // PLEASE CALL ON THIS SERVICE LIKE THIS:
 //
-// const int32_t val = 0x22820919;
-// xQueueSendToBack(indCmdRequestQue, &val, 30);
+// IND_Command command = {};
+// command.type = IND_CMD::Legacy;
+// command.legacy = 0x22820919;
+// xQueueSendToBack(indCmdRequestQue, &command, 30);
 //
+// The extended form carries RGB colors and millisecond times (see IND_ExtendedCommand):
 //
+// IND_Command command = {};
+// command.type = IND_CMD::Extended;
+// command.extended.firstColor = 0x00FF8000; // Orange
+// command.extended.firstCycles = 3;
+// command.extended.fadeInMs = 150;
+// command.extended.onMs = 200;
+// command.extended.fadeOutMs = 150;
+// command.extended.offMs = 300;
+// xQueueSendToBack(indCmdRequestQue, &command, 30);
 //
-void Indication::startIndication(uint32_t value)
+void Indication::startCommand(const IND_Command &command)
 {
-    //  std::cout << "IO Value: " << (uint32_t *)value << std::endl;
-    first_color_target = (0xF0000000 & value) >> 28; // First Color(s) -- We may see any of the color bits set
-    first_color_cycles = (0x0F000000 & value) >> 24; // First Color Cycles
+    portENTER_CRITICAL(&statsMux);
+    renderStats.commands++;
+    commandStartUs = esp_timer_get_time();
 
-    // ESP_LOGW(TAG, "First Color 0x%02x", first_color_target);
-    // ESP_LOGW(TAG, "First Color 0x%02x", first_color_cycles);
+    if (command.type == IND_CMD::Legacy)
+        sequenceStats.legacyCommands++;
+    else if (command.type == IND_CMD::Extended)
+        sequenceStats.extendedCommands++;
+    portEXIT_CRITICAL(&statsMux);
 
-    second_color_target = (0x00F00000 & value) >> 20; // Second Color(s)
-    second_color_cycles = (0x000F0000 & value) >> 16; // Second Color Cycles
+    switch (command.type)
+    {
+    case IND_CMD::Legacy:
+    {
+        startIndication(command.legacy);
+        break;
+    }
 
-    color_timeout = (0x0000FF00 & value) >> 8; // Time out
-    dark_delay = (0x000000FF & value);         // Dark Time
+    case IND_CMD::Extended:
+    {
+        if (startExtended(command.extended))
+            break;
 
-    first_color_timeout_counter = color_timeout;
-    second_color_timeout_counter = color_timeout;
+        portENTER_CRITICAL(&statsMux);
+        sequenceStats.rejectedCommands++;
+        portEXIT_CRITICAL(&statsMux);
+        break;
+    }
+
+    default:
+    {
+        ESP_LOGW(TAG, "Unknown command type %d", (int)command.type);
+
+        portENTER_CRITICAL(&statsMux);
+        sequenceStats.rejectedCommands++;
+        portEXIT_CRITICAL(&statsMux);
+        break;
+    }
+    }
+}
+
+void Indication::startIndication(uint32_t value)
+{
+    auto startTime = esp_timer_get_time();
+    uint8_t count = 0;
+
+    decodeLegacy(value);
+
+    if ((first_color_cycles != 0x00) && (first_color_cycles < 0x0E)) // Not one of the state commands
+        count = compileSequence();
+
+    recordDecode(startTime);
 
     // ESP_LOGI(TAG, "First Color 0x%0X Cycles 0x%0X", first_color_target, first_color_cycles);
     // ESP_LOGI(TAG, "Second Color 0x%0X Cycles 0x%0X", second_color_target, second_color_cycles);
@@ -134,6 +210,9 @@ void Indication::startIndication(uint32_t value)
         if (first_color_target & COLORC_Bit)
             cState = LED_STATE::ON;
 
+        saveStatesToLog();
+        saveResumeState();
+
         clearLEDTargets = 0;
         setLEDTargets = (uint8_t)COLORA_Bit | (uint8_t)COLORB_Bit | (uint8_t)COLORC_Bit;
         setAndClearColors(setLEDTargets, clearLEDTargets);
@@ -151,6 +230,9 @@ void Indication::startIndication(uint32_t value)
         if (first_color_target & COLORC_Bit)
             cState = LED_STATE::OFF;
 
+        saveStatesToLog();
+        saveResumeState();
+
         setLEDTargets = 0;
         clearLEDTargets = (uint8_t)COLORA_Bit | (uint8_t)COLORB_Bit | (uint8_t)COLORC_Bit;
         setAndClearColors(setLEDTargets, clearLEDTargets);
@@ -168,33 +250,48 @@ void Indication::startIndication(uint32_t value)
         if (first_color_target & COLORC_Bit)
             cState = LED_STATE::AUTO;
 
+        saveStatesToLog();
+        saveResumeState();
+
         setAndClearColors(first_color_target, 0);
     }
     else
     {
-        setAndClearColors(first_color_target, 0); // Process normal color display
-        first_color_cycles--;
-        indStates = IND_STATES::Show_FirstColor;
-        IsIndicating = true;
+        startSequence(count, 0); // Process normal color display
     }
 }
 
+void Indication::decodeLegacy(uint32_t value)
+{
+    //  std::cout << "IO Value: " << (uint32_t *)value << std::endl;
+    first_color_target = (0xF0000000 & value) >> 28; // First Color(s) -- We may see any of the color bits set
+    first_color_cycles = (0x0F000000 & value) >> 24; // First Color Cycles
+
+    // ESP_LOGW(TAG, "First Color 0x%02x", first_color_target);
+    // ESP_LOGW(TAG, "First Color 0x%02x", first_color_cycles);
+
+    second_color_target = (0x00F00000 & value) >> 20; // Second Color(s)
+    second_color_cycles = (0x000F0000 & value) >> 16; // Second Color Cycles
+
+    color_timeout = (0x0000FF00 & value) >> 8; // Time out
+    dark_delay = (0x000000FF & value);         // Dark Time
+}
+
 void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
 {
     //
     // ESP_LOGI(TAG, "SetAndClearColors 0x%02X 0x%02X", SetColors, ClearColors); // Debug info
     // ESP_LOGI(TAG, "Colors Curr/Default  %d/%d   %d/%d   %d/%d", aCurrValue, aDefaultValue, bCurrValue, bDefaultValue, cCurrValue, cDefaultValue);
     //
+    uint8_t updates = 0; // Channels touched -- each one used to be a frame of its own
+
     if (ClearColors & COLORA_Bit) // Seeing the bit to Clear this color
     {
         if (aState == LED_STATE::ON)
             aCurrValue = aDefaultValue; // Don't turn off this value because our stat is ON
         else
             aCurrValue = 0; // Otherwide, do turn it off.
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue); // Green and Blue and just set again to their current values
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10)); // If we dont' yield, the LED library doesn't have time to service the LED bus between successive led_strip calls.
+        updates++;
     }
 
     if (ClearColors & COLORB_Bit)
@@ -203,10 +300,7 @@ void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
             bCurrValue = bDefaultValue;
         else
             bCurrValue = 0;
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue);
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        updates++;
     }
 
     if (ClearColors & COLORC_Bit)
@@ -215,11 +309,7 @@ void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
             cCurrValue = cDefaultValue;
         else
             cCurrValue = 0;
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue);
-        cCurrValue = 0;
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        updates++;
     }
 
     if (SetColors & COLORA_Bit) // Setting the bit to Set this color
@@ -228,10 +318,7 @@ void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
             aCurrValue = 0;           // Don't allow any value to be displayed on the LED
         else
             aCurrValue = aDefaultValue; // State is either AUTO or ON.
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue); // Again, Green and Blue and just set again to their current values
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        updates++;
     }
 
     if (SetColors & COLORB_Bit)
@@ -240,10 +327,7 @@ void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
             bCurrValue = 0;
         else
             bCurrValue = bDefaultValue;
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue);
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        updates++;
     }
 
     if (SetColors & COLORC_Bit)
@@ -252,16 +336,213 @@ void Indication::setAndClearColors(uint8_t SetColors, uint8_t ClearColors)
             cCurrValue = 0;
         else
             cCurrValue = cDefaultValue;
-
-        pStrip_a->set_pixel(pStrip_a, 0, aCurrValue, bCurrValue, cCurrValue);
-        pStrip_a->refresh(pStrip_a, 100);
-        vTaskDelay(pdMS_TO_TICKS(10));
+        updates++;
     }
 
     // ESP_LOGW(TAG, "Red   State/Value  %d/%d", (int)aState, aCurrValue);
     // ESP_LOGW(TAG, "Green State/Value  %d/%d", (int)bState, bCurrValue);
     // ESP_LOGW(TAG, "Blue  State/Value  %d/%d", (int)cState, cCurrValue);
     // ESP_LOGW(TAG, "---------------------------------------------------");
+
+    if ((updates > 0) && (xSemaphoreTake(frameMutex, portMAX_DELAY) == pdTRUE))
+    {
+        writeSegment(0, 1, aCurrValue, bCurrValue, cCurrValue); // ColorA..ColorC are red, green and blue of pixel 0
+        renderFrame(updates);
+        xSemaphoreGive(frameMutex);
+    }
+}
+
+//
+// Pixel and segment commands may come from any task.  Each one is a logical change of its own and is on the strip when we
+// return true.
+//
+bool Indication::setPixel(uint16_t index, uint8_t red, uint8_t green, uint8_t blue)
+{
+    return setSegment(index, 1, red, green, blue);
+}
+
+bool Indication::setSegment(uint16_t first, uint16_t count, uint8_t red, uint8_t green, uint8_t blue)
+{
+    if ((count == 0) || (first >= IND_LED_COUNT) || (count > IND_LED_COUNT - first))
+    {
+        ESP_LOGW(TAG, "Segment %d+%d is outside the strip of %d pixels", first, count, IND_LED_COUNT);
+        return false;
+    }
+
+    if ((frameMutex == nullptr) || (xSemaphoreTake(frameMutex, portMAX_DELAY) != pdTRUE))
+        return false;
+
+    writeSegment(first, count, red, green, blue);
+    bool blnResult = renderFrame(1);
+
+    xSemaphoreGive(frameMutex);
+    return blnResult;
+}
+
+//
+// Render Layer
+//
+// setAndClearColors() and the pixel commands only write the framebuffer, which widens the dirty range for every pixel that
+// really changed.  renderFrame() then sends at most one frame for the whole change and nothing at all when no pixel changed.
+// Both are called with frameMutex held.
+//
+void Indication::writeSegment(uint16_t first, uint16_t count, uint8_t red, uint8_t green, uint8_t blue)
+{
+    for (uint16_t i = first; i < first + count; i++)
+    {
+        auto &pixel = frameBuffer[i];
+
+        if ((pixel.r == red) && (pixel.g == green) && (pixel.b == blue))
+            continue;
+
+        pixel = {green, red, blue};
+
+        if (i < dirtyFirst)
+            dirtyFirst = i;
+
+        if (i > dirtyLast)
+            dirtyLast = i;
+    }
+}
+
+bool Indication::renderFrame(uint8_t updates)
+{
+    bool blnClean = (dirtyFirst > dirtyLast);
+    bool blnResult = true;
+    uint16_t length = dirtyLast + 1; // The chain is always sent from pixel 0 -- each pixel passes the rest on
+    int64_t startTime = esp_timer_get_time();
+    int64_t doneTime = startTime;
+
+    if (!blnClean)
+    {
+        blnResult = sendFrame(length);
+        doneTime = esp_timer_get_time();
+    }
+
+    portENTER_CRITICAL(&statsMux);
+    renderStats.changes++;
+    renderStats.channelUpdates += updates;
+
+    if (blnClean)
+        renderStats.framesSkipped++;
+    else if (!blnResult)
+        renderStats.refreshErrors++;
+    else
+    {
+        renderStats.frames++;
+        renderStats.pixelsDirty += dirtyLast - dirtyFirst + 1;
+        renderStats.pixelsSent += length;
+
+        if ((uint32_t)(doneTime - startTime) > renderStats.refreshMaxUs)
+            renderStats.refreshMaxUs = (uint32_t)(doneTime - startTime);
+
+        if (commandStartUs != 0) // First frame since a command arrived -- the light now shows it
+        {
+            auto latency = (uint32_t)(doneTime - commandStartUs);
+
+            renderStats.latencyLastUs = latency;
+            renderStats.latencyTotalUs += latency;
+            renderStats.latencyCount++;
+
+            if (latency > renderStats.latencyMaxUs)
+                renderStats.latencyMaxUs = latency;
+
+            commandStartUs = 0;
+        }
+    }
+    portEXIT_CRITICAL(&statsMux);
+
+    if (blnResult) // After a failed frame the range stays dirty and goes out again with the next change
+    {
+        dirtyFirst = IND_LED_COUNT;
+        dirtyLast = 0;
+    }
+    else
+        ESP_LOGW(TAG, "Frame refresh failed");
+
+    return blnResult;
+}
+
+//
+// led_strip_init() installed the WS2812 translator on our channel, so the framebuffer goes to the RMT directly.  refresh()
+// would always send the whole strip from the driver's own copy.  We block on the tx-done event, not a fixed sleep, and the
+// framebuffer may be written again once it returns.
+//
+bool Indication::sendFrame(uint16_t length)
+{
+    if (rmt_write_sample((rmt_channel_t)LED_RMT_CHANNEL, (const uint8_t *)frameBuffer, length * sizeof(IND_Pixel), true) != ESP_OK)
+        return false;
+
+    return rmt_wait_tx_done((rmt_channel_t)LED_RMT_CHANNEL, pdMS_TO_TICKS(IND_REFRESH_TIMEOUT_MS)) == ESP_OK;
+}
+
+//
+// Sends what the strip already shows over and over for a range of lengths, so nothing visibly changes.  The wire time of
+// a WS2812 pixel is fixed at 30 us, so the numbers mostly show our overhead per frame and the reset gap.
+//
+void Indication::runRenderBenchmark(void)
+{
+    const uint16_t lengths[] = {1, 8, 16, 30, 60, 100, 150, 200, 300};
+    const uint8_t frames = 20;
+
+    if (xSemaphoreTake(frameMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    ESP_LOGI(TAG, "Render benchmark  %d pixels  %d frames per length", IND_LED_COUNT, frames);
+
+    for (auto length : lengths)
+    {
+        if (length > IND_LED_COUNT)
+            length = IND_LED_COUNT;
+
+        uint8_t sent = 0;
+        auto startTime = esp_timer_get_time();
+
+        for (uint8_t i = 0; i < frames; i++)
+        {
+            if (sendFrame(length))
+                sent++;
+        }
+
+        auto frameUs = (uint32_t)((esp_timer_get_time() - startTime) / frames);
+
+        ESP_LOGI(TAG, "  %3d px  %6d us/frame  %5d fps  %d failed", length, frameUs, (frameUs > 0) ? 1000000 / frameUs : 0,
+                 frames - sent);
+
+        if (length == IND_LED_COUNT)
+            break;
+    }
+
+    xSemaphoreGive(frameMutex);
+}
+
+void Indication::getRenderStats(IND_RenderStats *stats)
+{
+    if (stats == nullptr)
+        return;
+
+    portENTER_CRITICAL(&statsMux);
+    *stats = renderStats;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+void Indication::logRenderStats(void)
+{
+    IND_RenderStats stats;
+    getRenderStats(&stats);
+
+    // Before the render layer every touched color was its own frame followed by a 10 ms sleep
+    auto framesPerCmd = (stats.commands > 0) ? (float)stats.frames / stats.commands : 0.0f;
+    auto oldFramesPerCmd = (stats.commands > 0) ? (float)stats.channelUpdates / stats.commands : 0.0f;
+    auto latencyAvgUs = (stats.latencyCount > 0) ? stats.latencyTotalUs / stats.latencyCount : 0;
+
+    ESP_LOGI(TAG, "commands %d  changes %d  frames %d (was %d)  skipped %d  frames/cmd %.2f (was %.2f)  errors %d", stats.commands,
+             stats.changes, stats.frames, stats.channelUpdates, stats.framesSkipped, framesPerCmd, oldFramesPerCmd,
+             stats.refreshErrors);
+    ESP_LOGI(TAG, "cmd-to-light last %d us  avg %d us  max %d us  refresh max %d us  sleeps removed %d ms", stats.latencyLastUs,
+             latencyAvgUs, stats.latencyMaxUs, stats.refreshMaxUs, stats.channelUpdates * 10);
+    ESP_LOGI(TAG, "pixels dirty %d  sent %d  full refresh would send %d", stats.pixelsDirty, stats.pixelsSent,
+             stats.frames * IND_LED_COUNT);
 }
 
 void Indication::resetIndication()
@@ -273,15 +554,389 @@ void Indication::resetIndication()
     second_color_cycles = 0;
 
     dark_delay = 0;
-    dark_delay_counter = 0;
-
     color_timeout = 0;
-    color_timeout_counter = 0;
 
-    indStates = IND_STATES::Init;
+    keyframeCount = 0;
+    keyframeNext = 0;
     IsIndicating = false;
 }
 
+//
+// Sequencer
+//
+// Legacy command times count ticks, so they are converted with the tick period once here and keep their meaning.  The
+// timeline is the one the tick loop used to walk: each cycle of the first color is on for color_timeout and dark for
+// dark_delay, the last one dark for twice that.  The second color follows the same way and its last dark time is three
+// times as long.
+//
+// A zero on or dark time made the tick loop wait forever with the queue unread.  The timeline now ends there instead, the
+// LEDs hold what they show and the next command is taken.
+//
+uint8_t Indication::compileSequence(void)
+{
+    const uint32_t tickUs = 1000 * 1000 / configTICK_RATE_HZ;
+
+    uint32_t onUs = color_timeout * tickUs;
+    uint32_t darkUs = dark_delay * tickUs;
+    uint32_t atUs = 0;
+    uint8_t cycles = first_color_cycles + second_color_cycles;
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < cycles; i++)
+    {
+        bool blnFirst = (i < first_color_cycles);
+        uint8_t target = blnFirst ? first_color_target : second_color_target;
+        uint32_t offUs = darkUs;
+
+        if (i == first_color_cycles - 1)
+            offUs = 2 * darkUs;
+        else if (i == cycles - 1)
+            offUs = 3 * darkUs;
+
+        if (count + 3 > IND_SEQ_MAX_KEYFRAMES) // This cycle's on and off and the end must still fit
+            break;
+
+        keyframes[count++] = {atUs, 0, 0, target, 0, false};
+
+        if (onUs == 0)
+            return count;
+
+        atUs += onUs;
+        keyframes[count++] = {atUs, 0, 0, 0, target, false};
+
+        if (offUs == 0)
+            return count;
+
+        atUs += offUs;
+    }
+
+    keyframes[count++] = {atUs, 0, 0, 0, 0, false}; // The end -- the queue is read again from here
+    return count;
+}
+
+//
+// An extended cycle fades in, holds, fades out and stays dark -- every part in milliseconds and any of them may be zero.
+// Nothing here allocates; the timeline is built in place like a legacy one.
+//
+uint8_t Indication::compileExtended(const IND_ExtendedCommand &command)
+{
+    uint32_t fadeInUs = command.fadeInMs * 1000;
+    uint32_t onUs = command.onMs * 1000;
+    uint32_t fadeOutUs = command.fadeOutMs * 1000;
+    uint32_t offUs = command.offMs * 1000;
+    uint32_t atUs = 0;
+    uint8_t cycles = command.firstCycles + command.secondCycles;
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < cycles; i++)
+    {
+        uint32_t color = (i < command.firstCycles) ? command.firstColor : command.secondColor;
+
+        if (count + 3 > IND_SEQ_MAX_KEYFRAMES)
+            break;
+
+        keyframes[count++] = {atUs, fadeInUs, color & 0x00FFFFFF, 0, 0, true};
+        atUs += fadeInUs + onUs;
+        keyframes[count++] = {atUs, fadeOutUs, 0, 0, 0, true};
+        atUs += fadeOutUs + offUs;
+    }
+
+    keyframes[count++] = {atUs, 0, 0, 0, 0, false};
+    return count;
+}
+
+bool Indication::startExtended(const IND_ExtendedCommand &command)
+{
+    auto startTime = esp_timer_get_time();
+    uint16_t pixels = (command.pixels == 0) ? 1 : command.pixels;
+
+    if ((command.firstCycles == 0) || (command.firstCycles > IND_EXT_MAX_CYCLES) || (command.secondCycles > IND_EXT_MAX_CYCLES))
+    {
+        ESP_LOGW(TAG, "Extended command with %d + %d cycles rejected", command.firstCycles, command.secondCycles);
+        return false;
+    }
+
+    if ((command.firstPixel >= IND_LED_COUNT) || (pixels > IND_LED_COUNT - command.firstPixel))
+    {
+        ESP_LOGW(TAG, "Extended command on pixels %d+%d is outside the strip of %d", command.firstPixel, pixels, IND_LED_COUNT);
+        return false;
+    }
+
+    auto count = compileExtended(command);
+    recordDecode(startTime);
+
+    blnExtended = true;
+    seqFirstPixel = command.firstPixel;
+    seqPixels = pixels;
+    seqColor = 0;
+
+    startSequence(count, command.repeat);
+    return true;
+}
+
+void Indication::recordDecode(int64_t startTime)
+{
+    auto decodeUs = (uint32_t)(esp_timer_get_time() - startTime);
+
+    portENTER_CRITICAL(&statsMux);
+    sequenceStats.decodeTotalUs += decodeUs;
+
+    if (decodeUs > sequenceStats.decodeMaxUs)
+        sequenceStats.decodeMaxUs = decodeUs;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+void Indication::startSequence(uint8_t count, uint8_t repeat)
+{
+    keyframeCount = count;
+    keyframeNext = 0;
+    sequenceLengthUs = keyframes[count - 1].atUs;
+    sequenceRepeats = repeat;
+    sequenceStartUs = esp_timer_get_time();
+    blnFading = false;
+    IsIndicating = true;
+
+    portENTER_CRITICAL(&statsMux);
+    sequenceStats.sequences++;
+
+    if (!blnExtended)
+        sequenceStats.tickWakeups += sequenceLengthUs / (1000 * 1000 / configTICK_RATE_HZ) + 1;
+    portEXIT_CRITICAL(&statsMux);
+
+    playSequence();
+}
+
+//
+// Plays every keyframe that is due and the fade step, if one runs, then arms the timer for whichever comes next.  Anything
+// that fell behind is caught up in order, so the LEDs always end up where the timeline says they should be.  A repeat
+// starts the next pass where the last one should have ended, not where it did.
+//
+void Indication::playSequence(void)
+{
+    while (true)
+    {
+        auto elapsedUs = esp_timer_get_time() - sequenceStartUs;
+
+        while ((keyframeNext < keyframeCount) && (keyframes[keyframeNext].atUs <= elapsedUs))
+        {
+            auto &keyframe = keyframes[keyframeNext++];
+
+            portENTER_CRITICAL(&statsMux);
+            sequenceStats.keyframes++;
+
+            if ((uint32_t)(elapsedUs - keyframe.atUs) > sequenceStats.lateMaxUs)
+                sequenceStats.lateMaxUs = (uint32_t)(elapsedUs - keyframe.atUs);
+            portEXIT_CRITICAL(&statsMux);
+
+            if (keyframe.blnRGB)
+            {
+                if (blnFading) // Fades never overlap on the timeline, so one that is still running is only late
+                    writeSequenceColor(fadeTo);
+
+                fadeFrom = seqColor;
+                fadeTo = keyframe.rgb;
+                fadeStartUs = keyframe.atUs;
+                fadeUs = keyframe.fadeUs;
+                blnFading = true;
+            }
+            else if (keyframe.setColors | keyframe.clearColors)
+                setAndClearColors(keyframe.setColors, keyframe.clearColors);
+        }
+
+        if (blnFading)
+            stepFade(elapsedUs);
+
+        if (keyframeNext >= keyframeCount) // End of this pass
+        {
+            if (blnFading)
+                writeSequenceColor(fadeTo);
+
+            blnFading = false;
+
+            if (sequenceRepeats == 0)
+                break;
+
+            sequenceRepeats--;
+            keyframeNext = 0;
+            sequenceStartUs += sequenceLengthUs;
+            continue;
+        }
+
+        int64_t wakeUs = keyframes[keyframeNext].atUs;
+
+        if (blnFading && (elapsedUs + IND_FADE_STEP_US < wakeUs))
+            wakeUs = elapsedUs + IND_FADE_STEP_US;
+
+        elapsedUs = esp_timer_get_time() - sequenceStartUs; // Rendering took some of that time
+
+        if (wakeUs <= elapsedUs)
+            continue;
+
+        esp_timer_stop(sequenceTimer); // Harmless when the timer is not running
+
+        if (esp_timer_start_once(sequenceTimer, wakeUs - elapsedUs) == ESP_OK)
+            return;
+
+        ESP_LOGE(TAG, "Error, unable to arm the sequence timer");
+
+        portENTER_CRITICAL(&statsMux);
+        sequenceStats.timerErrors++;
+        portEXIT_CRITICAL(&statsMux);
+
+        vTaskDelay(pdMS_TO_TICKS((wakeUs - elapsedUs) / 1000) + 1); // Keep the pattern going without the timer
+    }
+
+    finishSequence();
+}
+
+//
+// Linear in each channel from the color the fade started on.  8-bit steps mean many fade steps land on the frame already
+// shown, and the render layer skips those.
+//
+void Indication::stepFade(int64_t elapsedUs)
+{
+    uint32_t color = fadeTo;
+
+    if ((elapsedUs - fadeStartUs) < fadeUs)
+    {
+        auto done = (int32_t)(elapsedUs - fadeStartUs);
+        color = 0;
+
+        for (uint8_t shift = 0; shift < 24; shift += 8)
+        {
+            int32_t from = (fadeFrom >> shift) & 0xFF;
+            int32_t to = (fadeTo >> shift) & 0xFF;
+            color |= (uint32_t)(from + (to - from) * (int64_t)done / (int32_t)fadeUs) << shift;
+        }
+    }
+    else
+        blnFading = false;
+
+    portENTER_CRITICAL(&statsMux);
+    sequenceStats.fadeFrames++;
+    portEXIT_CRITICAL(&statsMux);
+
+    writeSequenceColor(color);
+}
+
+void Indication::writeSequenceColor(uint32_t color)
+{
+    seqColor = color;
+
+    if (xSemaphoreTake(frameMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    writeSegment(seqFirstPixel, seqPixels, (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+    renderFrame(1);
+    xSemaphoreGive(frameMutex);
+}
+
+//
+// An extended pattern leaves its pixels dark and gives pixel 0 back to ColorA..ColorC in one frame.
+//
+void Indication::finishSequence(void)
+{
+    if (blnExtended && (xSemaphoreTake(frameMutex, portMAX_DELAY) == pdTRUE))
+    {
+        writeSegment(seqFirstPixel, seqPixels, 0, 0, 0);
+
+        if (seqFirstPixel == 0)
+            writeSegment(0, 1, aCurrValue, bCurrValue, cCurrValue);
+
+        renderFrame(0);
+        xSemaphoreGive(frameMutex);
+    }
+
+    blnExtended = false;
+    resetIndication(); // Sequence finished
+}
+
+//
+// Decodes and compiles a mix of legacy and extended commands without playing them.  The free heap before and after shows
+// the path stays allocation-free.  Only run before the first command is taken -- it reuses the keyframe table.
+//
+void Indication::runDecodeBenchmark(void)
+{
+    const uint32_t legacy[] = {0x71000309, 0x11222030, 0x43000115, 0xDDDDFFFF};
+    const uint16_t rounds = 1000;
+
+    IND_ExtendedCommand extended = {};
+    extended.firstColor = 0x00FF8000;
+    extended.secondColor = 0x000040FF;
+    extended.firstCycles = IND_EXT_MAX_CYCLES;
+    extended.secondCycles = IND_EXT_MAX_CYCLES;
+    extended.fadeInMs = 150;
+    extended.onMs = 200;
+    extended.fadeOutMs = 150;
+    extended.offMs = 300;
+
+    auto heapBefore = esp_get_free_heap_size();
+    auto startTime = esp_timer_get_time();
+
+    for (uint16_t i = 0; i < rounds; i++)
+    {
+        decodeLegacy(legacy[i % 4]);
+        compileSequence();
+    }
+
+    auto legacyUs = esp_timer_get_time() - startTime;
+    startTime = esp_timer_get_time();
+
+    for (uint16_t i = 0; i < rounds; i++)
+        compileExtended(extended);
+
+    auto extendedUs = esp_timer_get_time() - startTime;
+    auto heapAfter = esp_get_free_heap_size();
+
+    resetIndication();
+
+    ESP_LOGI(TAG, "Decode benchmark  legacy %lld ns  extended %lld ns per command  heap change %d bytes",
+             legacyUs * 1000 / rounds, extendedUs * 1000 / rounds, (int32_t)(heapBefore - heapAfter));
+}
+
+void Indication::sequenceTimerCallback(void *arg)
+{
+    auto obj = (Indication *)arg;
+
+    if (obj->runTaskIndication != nullptr)
+        xTaskNotifyGive(obj->runTaskIndication);
+}
+
+void Indication::getSequenceStats(IND_SequenceStats *stats)
+{
+    if (stats == nullptr)
+        return;
+
+    portENTER_CRITICAL(&statsMux);
+    *stats = sequenceStats;
+    portEXIT_CRITICAL(&statsMux);
+}
+
+void Indication::logSequenceStats(void)
+{
+    IND_SequenceStats stats;
+    getSequenceStats(&stats);
+
+    ESP_LOGI(TAG, "sequences %d  keyframes %d  wakeups %d (tick loop %d)  late max %d us  timer errors %d", stats.sequences,
+             stats.keyframes, stats.wakeups, stats.tickWakeups, stats.lateMaxUs, stats.timerErrors);
+
+    auto decoded = stats.legacyCommands + stats.extendedCommands;
+    auto decodeAvgUs = (decoded > 0) ? stats.decodeTotalUs / decoded : 0;
+
+    ESP_LOGI(TAG, "legacy %d  extended %d  rejected %d  decode avg %d us  max %d us  fade frames %d", stats.legacyCommands,
+             stats.extendedCommands, stats.rejectedCommands, decodeAvgUs, stats.decodeMaxUs, stats.fadeFrames);
+}
+
+void Indication::getSettingsStats(IND_SettingsStats *stats)
+{
+    if (stats == nullptr)
+        return;
+
+    portENTER_CRITICAL(&statsMux);
+    *stats = settingsStats;
+    portEXIT_CRITICAL(&statsMux);
+}
+
 void Indication::runMarshaller(void *arg)
 {
     auto obj = (Indication *)arg;
@@ -294,14 +949,12 @@ void Indication::runMarshaller(void *arg)
 void Indication::run(void)
 {
     uint8_t cycles = 0;
-    uint32_t value = 0;
+    IND_Command command = {};
     //
     // Set Object Debug Level
     // Note that this function can not raise log level above the level set using CONFIG_LOG_DEFAULT_LEVEL setting in menuconfig.
     // esp_log_level_set(TAG, ESP_LOG_INFO);
     //
-    TickType_t startTime;
-    TickType_t waitTime = 100;
 
     while (true)
     {
@@ -311,105 +964,19 @@ void Indication::run(void)
         {
             if (IsIndicating)
             {
-                waitTime = 1;
-                startTime = xTaskGetTickCount();
-                vTaskDelayUntil(&startTime, waitTime);
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // Asleep until the sequence timer says a keyframe is due
 
-                switch (indStates)
-                {
-                case IND_STATES::Init:
-                {
-                    break;
-                }
-
-                case IND_STATES::Show_FirstColor:
-                {
-                    if (first_color_timeout_counter > 0)
-                    {
-                        if (--first_color_timeout_counter < 1)
-                        {
-                            setAndClearColors(0, first_color_target);
-                            indStates = IND_STATES::FirstColor_Dark;
-
-                            if (first_color_cycles == 0)
-                            {
-                                dark_delay_counter = (dark_delay * 2);
-                                indStates = IND_STATES::SecondColor_Dark;
-                            }
-                            else
-                            { // If we are finished with the first color and we don't have a second color add extra delay time.
-                                if ((first_color_cycles < 1) && (second_color_target == 0))
-                                    dark_delay_counter = 3 * dark_delay;
-                                else
-                                    dark_delay_counter = dark_delay;
-                            }
-                        }
-                    }
-                    break;
-                }
-
-                case IND_STATES::Show_SecondColor:
-                {
-                    if (second_color_timeout_counter > 0)
-                    {
-                        if (--second_color_timeout_counter < 1)
-                        {
-                            setAndClearColors(0, second_color_target);
-                            indStates = IND_STATES::SecondColor_Dark;
-
-                            if (second_color_cycles < 1) // If we are finished with the second color -- add extra delay time
-                                dark_delay_counter = 3 * dark_delay;
-                            else
-                                dark_delay_counter = dark_delay;
-                        }
-                    }
-                    break;
-                }
-
-                case IND_STATES::FirstColor_Dark:
-                case IND_STATES::SecondColor_Dark:
-                {
-                    if (dark_delay_counter > 0)
-                    {
-                        if (--dark_delay_counter < 1)
-                        {
-                            if (first_color_cycles > 0)
-                            {
-                                first_color_cycles--;
-                                setAndClearColors(first_color_target, 0); // Turn on the LED
-                                first_color_timeout_counter = color_timeout;
-                                indStates = IND_STATES::Show_FirstColor;
-                            }
-                            else if ((second_color_cycles > 0) && (indStates == IND_STATES::SecondColor_Dark))
-                            {
-                                second_color_cycles--;
-                                setAndClearColors(second_color_target, 0); // Turn on the LED
-                                second_color_timeout_counter = color_timeout;
-                                indStates = IND_STATES::Show_SecondColor;
-                            }
-                            else
-                            {
-                                indStates = IND_STATES::Final;
-                            }
-                        }
-                    }
-
-                    break;
-                }
-
-                case IND_STATES::Final:
-                {
-                    resetIndication(); // Resetting all the indicator variables
-                    break;
-                }
-                }
+                portENTER_CRITICAL(&statsMux);
+                sequenceStats.wakeups++;
+                portEXIT_CRITICAL(&statsMux);
 
+                playSequence();
                 break;
             }
             else // When we are not indicating -- we are waiting for new indication requests
             {
-                if (xQueueReceive(queColorCmdRequests, &value, portMAX_DELAY)) // We can afford to wait here for requests
-                    startIndication(value);
+                if (xQueueReceive(queColorCmdRequests, &command, portMAX_DELAY)) // We can afford to wait here for requests
+                    startCommand(command);
             }
             break;
         }
@@ -420,8 +987,17 @@ void Indication::run(void)
             {
             case IND_INIT::Start:
             {
+                SYS_BOOT_MARK("IND", "Start");
                 ESP_LOGI(TAG, "Initalization Start");
 
+                if (restoreResumeState()) // Warm reset -- the version was shown at power-on and our state is in RTC memory
+                {
+                    ESP_LOGI(TAG, "Warm resume -- version blink and NVS restore skipped");
+                    initINDStep = IND_INIT::Apply_Settings;
+                    break;
+                }
+
+                SYS_BOOT_MARK("IND", "Version blink");
                 initINDStep = IND_INIT::ColorA_On;
                 cycles = majorVer;
                 vTaskDelay(pdMS_TO_TICKS(50));
@@ -540,11 +1116,27 @@ void Indication::run(void)
 
             case IND_INIT::Restore_Settings:
             {
+                SYS_BOOT_MARK("IND", "Restore_Settings");
+
                 if (showInitSteps)
                     ESP_LOGI(TAG, "Step 1  - Restore_Settings");
 
                 if (restoreVariblesFromNVS() == false)
                     ESP_LOGE(TAG, "ERROR  restoreVariblesFromNVS");
+                else if (blnSaveNVSVariables) // First boot, a migration or an upgraded blob -- write our layout once
+                    saveVariblesToNVS();
+
+                saveResumeState();
+                initINDStep = IND_INIT::Apply_Settings;
+                break;
+            }
+
+            case IND_INIT::Apply_Settings:
+            {
+                SYS_BOOT_MARK("IND", "Apply_Settings");
+
+                if (showInitSteps)
+                    ESP_LOGI(TAG, "Step 2  - Apply_Settings");
 
                 // We just restored all the Color State...
                 // Now we need to act on them to put the LEDs any restrictive states as needed...
@@ -556,7 +1148,7 @@ void Indication::run(void)
 
                 if (bState == LED_STATE::ON)
                     setAndClearColors(COLORB_Bit, 0);
-                else if (aState == LED_STATE::OFF)
+                else if (bState == LED_STATE::OFF)
                     setAndClearColors(0, COLORB_Bit);
 
                 if (cState == LED_STATE::ON)
@@ -570,9 +1162,17 @@ void Indication::run(void)
 
             case IND_INIT::Finished:
             {
+                SYS_BOOT_SIGNAL("IND", "Finished"); // semIndEntry is given below
+
                 ESP_LOGI(TAG, "Initialization Finished");
                 indOP = IND_OP::Run;
                 xSemaphoreGive(semIndEntry); // Let anyone waiting know that our Initialization is complete
+
+                if (showRenderBenchmark)
+                    runRenderBenchmark(); // After semIndEntry so it never holds up the boot
+
+                if (showDecodeBenchmark)
+                    runDecodeBenchmark();
                 break;
             }
             }
@@ -583,6 +1183,24 @@ void Indication::run(void)
 }
 
 /* NVS Routines */
+bool Indication::setDefaultValues(uint8_t aValue, uint8_t bValue, uint8_t cValue)
+{
+    aDefaultValue = aValue;
+    bDefaultValue = bValue;
+    cDefaultValue = cValue;
+
+    aDefaultValue_nvs_dirty = true;
+    bDefaultValue_nvs_dirty = true;
+    cDefaultValue_nvs_dirty = true;
+    blnSaveNVSVariables = true;
+    saveResumeState();
+    return saveVariblesToNVS();
+}
+
+//
+// All of our settings come back with a single blob read.  On the first boot after the blob layout was introduced we find
+// no blob, so we fall back to the old per-key layout once.  The next save writes the blob and erases those keys.
+//
 bool Indication::restoreVariblesFromNVS(void)
 {
     if (showNVSActions)
@@ -591,162 +1209,242 @@ bool Indication::restoreVariblesFromNVS(void)
     if (sys == nullptr)
         return false;
 
-    if (xSemaphoreTake(semSYSEntry, portMAX_DELAY) == pdTRUE)
-    {
-        if (sys->openNVStorage("indication", true) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to OpenNVStorage inside restoreVariblesFromNVS");
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-    }
-
-    /* Restore Color States */
-    std::string key = "aState";
-    uint8_t int8Val = 0;
+    auto startTime = esp_timer_get_time();
+    uint8_t raw[IND_SETTINGS_MAX_SIZE];
+    size_t length = sizeof(raw);
+    bool blnOpened = false;
+    bool blnBlob = false;
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
     {
-        if (int8Val == 0) // If the value has never been saved, set it to AUTO and mark it dirty
+        NvsTransaction txn("indication", SYS_NVS_MODE::ReadOnly); // Takes no lock
+
+        if (txn.isOpen())
         {
-            int8Val = (uint8_t)aState;
-            aState_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
+            blnOpened = true;
+            blnBlob = txn.getBlob(IND_SETTINGS_KEY, raw, &length);
 
-        if (showNVSActions)
-            ESP_LOGI(TAG, "aState is %s", getStateText((int)aState).c_str());
+            if (!blnBlob) // Migrate from the per-key layout.  Missing keys come back as their schema defaults.
+            {
+                blnLegacySettings |= txn.get(SET_IND_A_STATE, &aState);
+                blnLegacySettings |= txn.get(SET_IND_B_STATE, &bState);
+                blnLegacySettings |= txn.get(SET_IND_C_STATE, &cState);
+                blnLegacySettings |= txn.get(SET_IND_A_DEF_VALUE, &aDefaultValue);
+                blnLegacySettings |= txn.get(SET_IND_B_DEF_VALUE, &bDefaultValue);
+                blnLegacySettings |= txn.get(SET_IND_C_DEF_VALUE, &cDefaultValue);
+            }
+        }
     }
-    else
+
+    if (!blnOpened)
     {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
+        ESP_LOGE(TAG, "Error, Unable to OpenNVStorage inside restoreVariblesFromNVS");
         return false;
     }
 
-    key = "bState";
+    const char *source = "blob";
+    auto sourceType = IND_SettingsSource::Blob;
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
+    if (blnBlob && !decodeSettingsBlob(raw, length))
     {
-        if (int8Val == 0)
-        {
-            int8Val = (uint8_t)bState;
-            bState_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
-
-        if (showNVSActions)
-            ESP_LOGI(TAG, "bState is %s", getStateText((int)bState).c_str());
+        source = "defaults (bad blob)";
+        sourceType = IND_SettingsSource::BadBlob;
+        aState = SET_IND_A_STATE.defaultValue;
+        bState = SET_IND_B_STATE.defaultValue;
+        cState = SET_IND_C_STATE.defaultValue;
+        aDefaultValue = SET_IND_A_DEF_VALUE.defaultValue;
+        bDefaultValue = SET_IND_B_DEF_VALUE.defaultValue;
+        cDefaultValue = SET_IND_C_DEF_VALUE.defaultValue;
+        blnSaveNVSVariables = true;
     }
-    else
+    else if (!blnBlob)
     {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
-        return false;
+        source = blnLegacySettings ? "per-key layout" : "defaults";
+        sourceType = blnLegacySettings ? IND_SettingsSource::PerKey : IND_SettingsSource::Defaults;
+        blnSaveNVSVariables = true;
     }
 
-    key = "cState";
+    auto restoreUs = (uint32_t)(esp_timer_get_time() - startTime); // The log store is the same for either layout
+
+    portENTER_CRITICAL(&statsMux);
+    settingsStats.restores++;
+    settingsStats.restoreUs = restoreUs;
+    settingsStats.source = sourceType;
+    portEXIT_CRITICAL(&statsMux);
+
+    bool blnLogStates = restoreStatesFromLog();
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
+    if (showNVSActions)
     {
-        if (int8Val == 0)
-        {
-            int8Val = (uint8_t)cState;
-            cState_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
+        ESP_LOGI(TAG, "Settings restored from %s in %lld us", source, esp_timer_get_time() - startTime);
 
-        if (showNVSActions)
-            ESP_LOGI(TAG, "cState is %s", getStateText((int)cState).c_str());
+        if (blnLogStates)
+            ESP_LOGI(TAG, "States restored from the log store");
+
+        ESP_LOGI(TAG, "aState is %s", getStateText((int)aState).c_str());
+        ESP_LOGI(TAG, "bState is %s", getStateText((int)bState).c_str());
+        ESP_LOGI(TAG, "cState is %s", getStateText((int)cState).c_str());
+        ESP_LOGI(TAG, "Color A Value Default %d", aDefaultValue);
+        ESP_LOGI(TAG, "Color B Value Default %d", bDefaultValue);
+        ESP_LOGI(TAG, "Color C Value Default %d", cDefaultValue);
     }
-    else
-    {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
+    return true;
+}
+
+//
+// Returns false if the blob can not be trusted.  Fields that are out of range fall back to their defaults and the blob is
+// rewritten, as is any blob from another version.
+//
+bool Indication::decodeSettingsBlob(const uint8_t *raw, size_t length)
+{
+    IND_SettingsBlob blob;
+
+    if ((length < offsetof(IND_SettingsBlob, aState)) || (length > IND_SETTINGS_MAX_SIZE))
         return false;
-    }
 
-    /* Restore Color Values */
-    key = "aDefValue"; // Color A Default Value
+    memcpy(&blob, raw, offsetof(IND_SettingsBlob, aState)); // Header first
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
-    {
-        if (int8Val > 0)             // Do not allow the Color Value to be set lower than 1
-            aDefaultValue = int8Val; // The key idea is that we are restoring a saved default value.
-        else                         // Value is zero which is unacceptable.
-        {
-            aDefaultValue = 1;
-            aDefaultValue_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
+    if ((blob.length != length) || (blob.version == 0))
+        return false;
 
-        if (showNVSActions) // If we don't have something stored, then we still have the program's default value.
-            ESP_LOGI(TAG, "Color A Value Default %d", aDefaultValue);
-    }
-    else
-    {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
+    if (blob.crc != esp_rom_crc32_le(0, raw + sizeof(uint32_t), length - sizeof(uint32_t)))
         return false;
-    }
 
-    key = "bDefValue";
+    blob.aState = (uint8_t)SET_IND_A_STATE.defaultValue; // Anything an older layout did not write keeps its default
+    blob.bState = (uint8_t)SET_IND_B_STATE.defaultValue;
+    blob.cState = (uint8_t)SET_IND_C_STATE.defaultValue;
+    blob.aDefValue = SET_IND_A_DEF_VALUE.defaultValue;
+    blob.bDefValue = SET_IND_B_DEF_VALUE.defaultValue;
+    blob.cDefValue = SET_IND_C_DEF_VALUE.defaultValue;
+    memcpy(&blob, raw, (length < sizeof(blob)) ? length : sizeof(blob));
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
+    //
+    // Upgrade path.  Each step converts a blob from its version to the next and falls through to the one after it.
+    //
+    switch (blob.version)
     {
-        if (int8Val > 0)
-            bDefaultValue = int8Val;
-        else
-        {
-            bDefaultValue = 1;
-            bDefaultValue_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
+    case 1: // Current layout
+        break;
 
-        if (showNVSActions)
-            ESP_LOGI(TAG, "Color B Value Default %d", bDefaultValue);
+    default: // Written by newer firmware.  It only appends, so the fields we know are still good.
+        break;
     }
-    else
-    {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
+
+    if ((blob.version < IND_SETTINGS_VERSION) || (length < sizeof(blob)))
+        blnSaveNVSVariables = true; // Rewrite an older blob in our layout.  A newer one is left alone until something changes.
+
+    aState_nvs_dirty = !SET_IND_A_STATE.inRange(blob.aState);
+    bState_nvs_dirty = !SET_IND_B_STATE.inRange(blob.bState);
+    cState_nvs_dirty = !SET_IND_C_STATE.inRange(blob.cState);
+    aDefaultValue_nvs_dirty = !SET_IND_A_DEF_VALUE.inRange(blob.aDefValue);
+    bDefaultValue_nvs_dirty = !SET_IND_B_DEF_VALUE.inRange(blob.bDefValue);
+    cDefaultValue_nvs_dirty = !SET_IND_C_DEF_VALUE.inRange(blob.cDefValue);
+
+    aState = aState_nvs_dirty ? SET_IND_A_STATE.defaultValue : (LED_STATE)blob.aState;
+    bState = bState_nvs_dirty ? SET_IND_B_STATE.defaultValue : (LED_STATE)blob.bState;
+    cState = cState_nvs_dirty ? SET_IND_C_STATE.defaultValue : (LED_STATE)blob.cState;
+    aDefaultValue = aDefaultValue_nvs_dirty ? SET_IND_A_DEF_VALUE.defaultValue : blob.aDefValue;
+    bDefaultValue = bDefaultValue_nvs_dirty ? SET_IND_B_DEF_VALUE.defaultValue : blob.bDefValue;
+    cDefaultValue = cDefaultValue_nvs_dirty ? SET_IND_C_DEF_VALUE.defaultValue : blob.cDefValue;
+
+    blnSaveNVSVariables |= aState_nvs_dirty || bState_nvs_dirty || cState_nvs_dirty || aDefaultValue_nvs_dirty ||
+                           bDefaultValue_nvs_dirty || cDefaultValue_nvs_dirty;
+    return true;
+}
+
+//
+// Called on every manual state change.  The log store skips a write when the states have not changed.
+//
+bool Indication::saveStatesToLog(void)
+{
+    if (sys == nullptr)
         return false;
-    }
 
-    key = "cDefValue";
+    uint8_t states[3] = {(uint8_t)aState, (uint8_t)bState, (uint8_t)cState};
 
-    if (sys->getU8IntegerFromNVS(key.c_str(), &int8Val))
+    if (!sys->setHotValue(IND_STATES_LOG_KEY, states, sizeof(states)))
     {
-        if (int8Val > 0)
-            cDefaultValue = int8Val;
-        else
-        {
-            cDefaultValue = 1;
-            cDefaultValue_nvs_dirty = true;
-            blnSaveNVSVariables = true;
-        }
-
         if (showNVSActions)
-            ESP_LOGI(TAG, "Color C Value Default %d", cDefaultValue);
-    }
-    else
-    {
-        ESP_LOGE(TAG, "getU8IntegerFromNVS failed on key %s", key.c_str());
-        sys->closeNVStorage(false); // No changes
-        xSemaphoreGive(semSYSEntry);
+            ESP_LOGW(TAG, "States not saved to the log store");
         return false;
     }
+    return true;
+}
 
-    sys->closeNVStorage(false); // No commit to any changes
-    xSemaphoreGive(semSYSEntry);
+//
+// Only takes the states when all three are in range -- otherwise the blob's states stand.
+//
+bool Indication::restoreStatesFromLog(void)
+{
+    if (sys == nullptr)
+        return false;
+
+    uint8_t states[3];
+    size_t length = sizeof(states);
+
+    if (!sys->getHotValue(IND_STATES_LOG_KEY, states, &length) || (length != sizeof(states)))
+        return false;
+
+    if (!SET_IND_A_STATE.inRange(states[0]) || !SET_IND_B_STATE.inRange(states[1]) || !SET_IND_C_STATE.inRange(states[2]))
+        return false;
+
+    aState = (LED_STATE)states[0];
+    bState = (LED_STATE)states[1];
+    cState = (LED_STATE)states[2];
     return true;
 }
 
+static_assert(sizeof(IND_ResumeState) <= SYS_RESUME_IND_SIZE, "IND_ResumeState must fit the System resume snapshot");
+
+//
+// Kept current on every change so a warm reset at any moment resumes where we were.
+//
+void Indication::saveResumeState(void)
+{
+    if (sys == nullptr)
+        return;
+
+    IND_ResumeState state = {};
+    state.aState = (uint8_t)aState;
+    state.bState = (uint8_t)bState;
+    state.cState = (uint8_t)cState;
+    state.aDefValue = aDefaultValue;
+    state.bDefValue = bDefaultValue;
+    state.cDefValue = cDefaultValue;
+
+    sys->saveResumeState(&state, sizeof(state));
+}
+
+//
+// False on a cold boot, or when anything in the snapshot is out of range -- the caller then takes the full init path.
+//
+bool Indication::restoreResumeState(void)
+{
+    if ((sys == nullptr) || !sys->isWarmResume())
+        return false;
+
+    IND_ResumeState state = {};
+    size_t length = sizeof(state);
+
+    if (!sys->getResumeState(&state, &length) || (length != sizeof(state)))
+        return false;
+
+    if (!SET_IND_A_STATE.inRange(state.aState) || !SET_IND_B_STATE.inRange(state.bState) || !SET_IND_C_STATE.inRange(state.cState) ||
+        !SET_IND_A_DEF_VALUE.inRange(state.aDefValue) || !SET_IND_B_DEF_VALUE.inRange(state.bDefValue) ||
+        !SET_IND_C_DEF_VALUE.inRange(state.cDefValue))
+        return false;
+
+    aState = (LED_STATE)state.aState;
+    bState = (LED_STATE)state.bState;
+    cState = (LED_STATE)state.cState;
+    aDefaultValue = state.aDefValue;
+    bDefaultValue = state.bDefValue;
+    cDefaultValue = state.cDefValue;
+    return true;
+}
+
+//
+// Every setting goes out in one blob write.  The cache drops the write if nothing actually changed.
+//
 bool Indication::saveVariblesToNVS(void)
 {
     if (showNVSActions)
@@ -755,114 +1453,80 @@ bool Indication::saveVariblesToNVS(void)
     if (sys == nullptr)
         return false;
 
-    if (xSemaphoreTake(semSYSEntry, portMAX_DELAY) == pdTRUE)
-    {
-        if (sys->openNVStorage("indication", true) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to OpenNVStorage inside saveVariblesToNVS");
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-    }
+    auto startTime = esp_timer_get_time();
 
-    //
-    // Save Color States
-    //
-    if (aState_nvs_dirty)
-    {
-        if (showNVSActions)
-            ESP_LOGW(TAG, "aState ................ %d", (int)aState);
+    IND_SettingsBlob blob;
+    memset(&blob, 0, sizeof(blob)); // Padding is part of the CRC
 
-        if (sys->saveU8IntegerToNVS("aState", (uint8_t)aState) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS aState");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-        aState_nvs_dirty = false;
-    }
+    blob.version = IND_SETTINGS_VERSION;
+    blob.length = sizeof(blob);
+    blob.aState = (uint8_t)aState;
+    blob.bState = (uint8_t)bState;
+    blob.cState = (uint8_t)cState;
+    blob.aDefValue = aDefaultValue;
+    blob.bDefValue = bDefaultValue;
+    blob.cDefValue = cDefaultValue;
+    blob.crc = esp_rom_crc32_le(0, (const uint8_t *)&blob + sizeof(uint32_t), sizeof(blob) - sizeof(uint32_t));
+
+    bool blnOpened = false;
+    bool blnResult = false;
 
-    if (bState_nvs_dirty)
     {
-        if (showNVSActions)
-            ESP_LOGW(TAG, "bState ................ %d", (int)bState);
+        NvsTransaction txn("indication");
 
-        if (sys->saveU8IntegerToNVS("bState", (uint8_t)bState) == false)
+        if (txn.isOpen())
         {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS bState");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-        bState_nvs_dirty = false;
-    }
+            blnOpened = true;
+            blnResult = txn.setBlob(IND_SETTINGS_KEY, &blob, sizeof(blob));
 
-    if (cState_nvs_dirty)
-    {
-        if (showNVSActions)
-            ESP_LOGW(TAG, "cState ................ %d", (int)cState);
+            if (blnResult && blnLegacySettings) // The blob replaces the per-key layout
+            {
+                blnResult = txn.erase(SET_IND_A_STATE.key) && txn.erase(SET_IND_B_STATE.key) && txn.erase(SET_IND_C_STATE.key) &&
+                            txn.erase(SET_IND_A_DEF_VALUE.key) && txn.erase(SET_IND_B_DEF_VALUE.key) &&
+                            txn.erase(SET_IND_C_DEF_VALUE.key);
+            }
 
-        if (sys->saveU8IntegerToNVS("cState", (uint8_t)cState) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS cState");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
+            if (blnResult) // Any failure leaves everything staged to be discarded
+                blnResult = txn.commit();
         }
-        cState_nvs_dirty = false;
     }
 
-    //
-    // Save Default Color Values
-    //
-    if (aDefaultValue_nvs_dirty)
+    if (!blnOpened)
     {
-        if (showNVSActions)
-            ESP_LOGW(TAG, "aDefaultValue ................ %d", aDefaultValue);
-
-        if (sys->saveU8IntegerToNVS("aDefValue", aDefaultValue) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS aDefaultValue");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-        aDefaultValue_nvs_dirty = false;
+        ESP_LOGE(TAG, "Error, Unable to OpenNVStorage inside saveVariblesToNVS");
+        return false;
     }
 
-    if (bDefaultValue_nvs_dirty)
+    if (!blnResult)
     {
-        ESP_LOGW(TAG, "bDefaultValue ................ %d", bDefaultValue);
-
-        if (sys->saveU8IntegerToNVS("bDefValue", bDefaultValue) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS bDefaultValue");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-        bDefaultValue_nvs_dirty = false;
+        ESP_LOGE(TAG, "Error, Unable to save Indication variables to NVS");
+        return false;
     }
 
-    if (cDefaultValue_nvs_dirty)
+    auto saveUs = (uint32_t)(esp_timer_get_time() - startTime);
+
+    portENTER_CRITICAL(&statsMux);
+    settingsStats.saves++;
+    settingsStats.saveUs = saveUs;
+    portEXIT_CRITICAL(&statsMux);
+
+    if (showNVSActions)
     {
-        if (showNVSActions)
-            ESP_LOGW(TAG, "cDefaultValue ................ %d", cDefaultValue);
+        ESP_LOGW(TAG, "States ................ %d %d %d", (int)aState, (int)bState, (int)cState);
+        ESP_LOGW(TAG, "Default Values ........ %d %d %d", aDefaultValue, bDefaultValue, cDefaultValue);
 
-        if (sys->saveU8IntegerToNVS("cDefValue", cDefaultValue) == false)
-        {
-            ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS cDefaultValue");
-            sys->closeNVStorage(false); // Discard changes
-            xSemaphoreGive(semSYSEntry);
-            return false;
-        }
-        cDefaultValue_nvs_dirty = false;
+        if (blnLegacySettings)
+            ESP_LOGW(TAG, "Per-key settings migrated to the %s blob", IND_SETTINGS_KEY);
     }
 
+    blnLegacySettings = false;
+    aState_nvs_dirty = false;
+    bState_nvs_dirty = false;
+    cState_nvs_dirty = false;
+    aDefaultValue_nvs_dirty = false;
+    bDefaultValue_nvs_dirty = false;
+    cDefaultValue_nvs_dirty = false;
     blnSaveNVSVariables = false;
-    sys->closeNVStorage(true); // Commit changes
-    xSemaphoreGive(semSYSEntry);
     return true;
 }
 
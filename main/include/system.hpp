@@ -1,6 +1,10 @@
 #pragma once
 #include "sdkconfig.h"
 #include "system_defs.hpp"
+#include "system_settings.hpp"
+#include "system_logstore.hpp"
+#include "system_timerwheel.hpp"
+#include "system_bootprofile.hpp"
 
 #include <stddef.h> // Standard libraries
 #include <stdint.h>
@@ -16,6 +20,7 @@
 #include "freertos/semphr.h"
 
 #include <driver/gpio.h> // IDF Libraries
+#include <driver/uart.h>
 #include <esp_log.h>
 #include <esp_err.h>
 #include "esp_timer.h"
@@ -26,101 +31,277 @@
 #include "nvs.h"
 
 class Indication; // Forward declarations
+class NvsTransaction;
+class NvsImport;
 
-extern "C"
+class System
 {
-    class System
+public:
+    static System &getInstance() // Enforce use of System as a singleton object
     {
-    public:
-        static System &getInstance() // Enforce use of System as a singleton object
-        {
-            static System sysInstance;
-            return sysInstance;
-        }
+        static System sysInstance;
+        return sysInstance;
+    }
 
-        System(const System &) = delete;         // Disable copy constructor
-        void operator=(System const &) = delete; // Disable assignment operator
+    System(const System &) = delete;         // Disable copy constructor
+    void operator=(System const &) = delete; // Disable assignment operator
 
-        /* Task Handle Calls */
-        xTaskHandle getGenTaskHandle(void);
-        xTaskHandle getIOTTaskHandle(void);
+    /* Task Handle Calls */
+    xTaskHandle getGenTaskHandle(void);
+    xTaskHandle getIOTTaskHandle(void);
 
-        /* Non Volatile Storage */
-        bool openNVStorage(const char *, bool = true);
-        bool getBooleanFromNVS(const char *, bool *);
-        bool getStringFromNVS(const char *, std::string *);
-        bool getU8IntegerFromNVS(const char *, uint8_t *);
-        bool getU16IntegerFromNVS(const char *, uint16_t *);
-        bool saveBooleanToNVS(const char *, bool);
-        bool saveStringToNVS(const char *, std::string *);
-        bool saveU8IntegerToNVS(const char *, uint8_t);
-        bool saveU16IntegerToNVS(const char *, uint16_t);
-        void closeNVStorage(bool);
+    /* Settings */
+    template <typename T>
+    T get(const SYS_Setting<T> &); // Declared in system_settings.hpp
+    template <typename T>
+    bool set(const SYS_Setting<T> &, T);
 
-    private:
-        System(void); // Creating the singlton object with private construction
+    /* Non Volatile Storage */
+    bool flushNVSCache(void);                                       // Synchronous -- writes flash on the calling task
+    bool requestNVSFlush(SYS_NVSDoneCallback = nullptr, void * = nullptr); // Asynchronous -- on SYS::NVS
+    void logNVSTaskStats(void);
+    void getNVSCacheStats(SYS_NVSCacheStats *);
+    void logNVSCacheStats(void);
+    void getNVSPreloadStats(SYS_NVSPreloadStats *);
+    void getNVSLockStats(SYS_NVSLockStats *);               // Totals over every namespace
+    bool getNVSLockStats(const char *, SYS_NVSLockStats *); // One namespace
+    void logNVSLockStats(void);                             // One line pair per namespace
 
-        char TAG[5] = "SYS ";
+    bool exportNVS(const char *const *, uint8_t, SYS_NVSImageWriter, void *, SYS_NVSImageStats * = nullptr);
+    bool importNVS(const uint8_t *, size_t, SYS_NVSImageStats * = nullptr); // An image embedded in the firmware
+    bool importNVSFromUART(uart_port_t, TickType_t, SYS_NVSImageStats * = nullptr); // Driver must be installed.  Ends when idle.
 
-        /* Object Pointers */
-        Indication *ind = nullptr;
+    bool getHotValue(const char *, void *, size_t *); // Log store -- for state that changes too often for NVS
+    bool setHotValue(const char *, const void *, size_t);
+    void getLogStoreStats(SYS_LogStoreStats *);
+    void logLogStoreStats(void);
 
-        /* task handles */
-        xTaskHandle taskHandleSystemRun = nullptr;
+    /* Warm Resume */
+    bool isWarmResume(void);
+    bool getResumeState(void *, size_t *); // In: buffer size.  Out: saved size.
+    void saveResumeState(const void *, size_t);
 
-        static void runMarshaller(void *);
-        void run(void); // Handles most main System activites that are not periodic
+    /* System Timer */
+    bool schedulePeriodic(uint64_t, SYS_TimerCallback, void *, uint16_t * = nullptr, SYS_TIMER_POLICY = SYS_TIMER_POLICY::Skip);
+    bool scheduleOnce(uint64_t, SYS_TimerCallback, void *, uint16_t * = nullptr);
+    bool cancelTimerJob(uint16_t);
+    void getTimerStats(SYS_TimerStats *);
+    bool getTimerJobStats(uint16_t, SYS_TimerJobStats *);
+    void resetTimerStats(void);
+    void logTimerStats(void); // Wakeups/sec assumes the one minute job calls it
 
-        /* System GPIO */
-        xTaskHandle runTaskHandleSystemGPIO = nullptr;
+    /* System GPIO */
+    bool registerGPIOHandler(gpio_num_t, SYS_GPIOCallback, void *, gpio_int_type_t = GPIO_INTR_ANYEDGE);
+    void getGPIOStats(SYS_GPIOStats *);
+    void logGPIOStats(void);
+    bool registerButton(gpio_num_t, SYS_ButtonCallback, void *, bool = true);
+    void requestGPIOShutdown(void);
+    bool registerPulseCounter(gpio_num_t, uint32_t, SYS_PulseCallback, void *, gpio_int_type_t = GPIO_INTR_POSEDGE);
+    bool getPulseReading(gpio_num_t, SYS_PulseReading *);
 
-        static void runGPIOTaskMarshaller(void *);
-        void runGPIOTask(void); // Handles GPIO Interrupts on Change Events
+private:
+    friend class NvsTransaction;
+    friend class NvsImport;
 
-        void initGPIOPins(void);
-        void initGPIOTask(void);
+    System(void); // Creating the singlton object with private construction
 
-        /* System Timer */
-        esp_timer_handle_t General_timer;
-        xTaskHandle xTaskHandleSystemTimer = nullptr;
+    char TAG[5] = "SYS ";
 
-        static void runGenTimerTaskMarshaller(void *);
-        void runGenTimerTask(void); // Handles all Timer related events
+    /* Object Pointers */
+    Indication *ind = nullptr;
 
-        uint8_t SyncEventTimeOut_Counter = 0;
+    /* task handles */
+    xTaskHandle taskHandleSystemRun = nullptr;
 
-        void initGenTimer(void);
-        static void genTimerCallback(void *);
+    static void runMarshaller(void *);
+    void run(void); // Handles most main System activites that are not periodic
 
-        /* RTOS */
-        xTaskHandle taskHandleIOTRUN = nullptr; // Task Handles for notification
+    /* System GPIO */
+    xTaskHandle runTaskHandleSystemGPIO = nullptr;
 
-        /* State Variables */
-        SYS_OP SysOp = SYS_OP::Init;
-        SYS_INIT initSysStep = SYS_INIT::Finished;
+    static void runGPIOTaskMarshaller(void *);
+    void runGPIOTask(void); // Handles GPIO Interrupts on Change Events
 
-        /* Command Request Queues */
-        QueueHandle_t sysCmdRequestQue = nullptr;   // SYS <--  (Queue is in SYS)
-        SYS_CmdRequest *ptrSYSCmdRequest = nullptr; // Structs for Sending/Receiving data to/from System Object
-        SYS_Response *ptrSYSResponse = nullptr;
+    void initGPIOPins(void);
+    void initGPIOTask(void);
+    uint32_t drainGPIOEvents(void);
 
-        QueueHandle_t indColorCmdRequestQue = nullptr;
+    QueueHandle_t gpioConfigQue = nullptr; // Registrations from other tasks
+    bool isGPIOConfigDeferred(void);
+    bool queueGPIOConfigRequest(const SYS_GPIOConfigRequest &);
+    void applyGPIOConfigRequests(void);
+    bool addGPIOHandler(gpio_num_t, SYS_GPIOCallback, void *, gpio_int_type_t);
+    bool addButton(gpio_num_t, SYS_ButtonCallback, void *, bool);
+    bool addPulseCounter(gpio_num_t, uint32_t, SYS_PulseCallback, void *, gpio_int_type_t);
+    bool isGPIOPinClaimed(gpio_num_t);
 
-        /* Non Volatile Storage */
-        nvs_handle_t nvsHandle = 0;
-        void initNVS(void);
-        uint16_t retrieveLengthOfStringInNVM(const char *);
-        bool retrieveStringWithKeyFromNVS(const char *, char *, size_t *);
+    SYS_GPIOHandler gpioHandlers[SYS_GPIO_MAX_HANDLERS] = {};
+    SYS_GPIOStats gpioStats = {};
+    uint64_t gpioLatencyTotal = 0;
 
-        uint8_t TempFlag = 1;
+    /* Buttons */
+    SYS_Button buttons[SYS_GPIO_MAX_BUTTONS] = {};
+    int64_t buttonTimerDeadline = INT64_MAX; // Earliest deadline a timer job is pending for
 
-        /* Debug Flags */
-        bool showRun = false;
-        bool showNVMDebug = false;
-        bool showRunCmd = true;
-        bool showInit = true;
-        bool showIdle = false;
-        bool showTimerSeconds = false;
-        bool showTimerMinutes = false;
+    static void onButtonEdge(void *, const SYS_GPIOEvent &);
+    static void onButtonDeadline(void *, uint32_t);
+    void serviceButtons(void);
+    void runButtonDeadline(SYS_Button *, int64_t, bool);
+    void armButtonTimer(void);
+    bool isButtonActive(SYS_Button *, bool);
+
+    /* Pulse Counters */
+    SYS_PulseCounter pulseCounters[SYS_GPIO_MAX_COUNTERS] = {};
+
+    static void onPulseWindow(void *, uint32_t);
+
+    static void onSwitch1Button(void *, uint8_t, SYS_BUTTON_EVENT, uint32_t);
+    void handleSwitch1Press(void);
+
+    /* System Timer */
+    esp_timer_handle_t General_timer;
+    xTaskHandle xTaskHandleSystemTimer = nullptr;
+
+    static void runGenTimerTaskMarshaller(void *);
+    void runGenTimerTask(void); // Handles all Timer related events
+
+    uint8_t SyncEventTimeOut_Counter = 0;
+
+    void initGenTimer(void);
+    static void genTimerCallback(void *);
+
+    TimerWheel timerWheel;
+    portMUX_TYPE timerStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+    bool scheduleTimerJob(uint64_t, uint64_t, SYS_TimerCallback, void *, uint16_t *, SYS_TIMER_POLICY);
+    void serviceTimerWheel(void);
+
+    volatile int64_t timerCallbackTime = 0; // Set by genTimerCallback, consumed by SYS::TIMER for wake latency
+    SYS_TimerStats timerStats = {};         // Reported with showTimerStats
+    uint16_t timerJobOneSecond = SYS_TIMER_INVALID_JOB;
+    void recordTimerWake(uint32_t);
+
+    uint32_t timerTickCount = 0; // Tick cost accounting
+    uint32_t timerTickCostTotal = 0;
+    uint32_t timerTickCostMax = 0;
+
+    static void onTimerOneSecond(void *, uint32_t);
+    static void onTimerFiveSeconds(void *, uint32_t);
+    static void onTimerTenSeconds(void *, uint32_t);
+    static void onTimerOneMinute(void *, uint32_t);
+    static void onTimerFiveMinutes(void *, uint32_t);
+
+    /* RTOS */
+    xTaskHandle taskHandleIOTRUN = nullptr; // Task Handles for notification
+
+    /* State Variables */
+    SYS_OP SysOp = SYS_OP::Init;
+    SYS_INIT initSysStep = SYS_INIT::Finished;
+
+    /* Init Graph */
+    SYS_InitNode initNodes[(uint8_t)SYS_INIT_NODE::Count] = {
+        {"NVS", 0, 0, 1024 * 4},
+        {"Indication", SYS_INIT_BIT(SYS_INIT_NODE::NVS), 1, 1024 * 3},
+        {"Timer", 0, 1, 1024 * 3},
     };
-}
+    EventGroupHandle_t initEventGroup = nullptr; // One bit per ready node
+    SemaphoreHandle_t initMutex = nullptr;       // Nodes are launched from whichever task finished last
+    int64_t initRunUs = 0;                       // When we entered SYS_OP::Run
+    bool blnInitTimelineShown = false;
+
+    void launchInitNodes(void);
+    static void runInitNodeMarshaller(void *);
+    void runInitNode(SYS_INIT_NODE);
+    void initIndication(void);
+    void checkInitTimeline(void);
+    void showInitTimeline(void);
+    void getInitPath(SYS_INIT_NODE, char *, size_t);
+
+    /* Command Request Queues */
+    QueueHandle_t sysCmdRequestQue = nullptr;   // SYS <--  (Queue is in SYS)
+    SYS_CmdRequest *ptrSYSCmdRequest = nullptr; // Structs for Sending/Receiving data to/from System Object
+    SYS_Response *ptrSYSResponse = nullptr;
+
+    QueueHandle_t indColorCmdRequestQue = nullptr;
+
+    /* Warm Resume */
+    bool blnWarmResume = false;
+    portMUX_TYPE resumeMux = portMUX_INITIALIZER_UNLOCKED; // Indication saves on its own task
+    void initResume(void);
+    void recordTimeToRun(void);
+
+    /* Non Volatile Storage */
+    void initNVS(void); // All access is reached through NvsTransaction
+
+    SYS_NVSNamespace nvsNamespaces[SYS_NVS_MAX_NAMESPACES] = {};
+    SemaphoreHandle_t nvsPoolMutex = nullptr; // Only held while a namespace is looked up or added
+    SYS_NVSNamespace *getNVSNamespace(const char *);
+    bool hasNVSNamespaceRoom(const char (*)[NVS_KEY_NAME_MAX_SIZE], uint8_t); // Every name is in the pool or would fit
+    nvs_handle_t getNVSHandle(SYS_NVSNamespace *, bool);
+
+    SYS_NVSCacheEntry nvsCache[SYS_NVS_CACHE_ENTRIES] = {};
+    uint8_t nvsCacheOrder[SYS_NVS_CACHE_ENTRIES] = {}; // Entries in use, sorted by namespace then key
+    uint8_t nvsCacheCount = 0;
+    SYS_NVSPreloadStats nvsPreloadStats = {};
+    SYS_NVSCacheStats nvsCacheStats = {};
+    uint32_t nvsCacheClock = 0;
+    SemaphoreHandle_t nvsCacheMutex = nullptr;  // Guards the cache.  Held for cache work only -- never for a transaction.
+    int64_t nvsFlushDeadline = 0;                // Flush once writes have been quiet until this time
+    bool blnNVSFlushPending = false;             // SYS::NVS has been told about the deadline
+    SemaphoreHandle_t nvsFlushMutex = nullptr;   // One flush at a time.  Guards nvsFlushBatch and the write handles.
+    SYS_NVSFlushItem nvsFlushBatch[SYS_NVS_CACHE_ENTRIES] = {};
+
+    bool preloadNVS(const char *const *, uint8_t);
+    SYS_NVSCacheEntry *lookupNVSEntry(SYS_NVSNamespace *, const char *, uint8_t *);
+    SYS_NVSCacheEntry *insertNVSEntry(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE);
+    void removeNVSEntry(SYS_NVSCacheEntry *);
+    SYS_NVSCacheEntry *findNVSEntry(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE);
+    SYS_NVSCacheEntry *allocNVSEntry(void);
+    bool waitForNVSSpace(void);
+    static void onNVSSpaceFlushed(void *, bool);
+    bool readNVSEntryFromFlash(SYS_NVSCacheEntry *);
+    void loadNVSEntry(SYS_NVSCacheEntry *);
+    bool applyNVSWrite(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE, uint16_t, const std::string *, bool *);
+    bool applyNVSErase(SYS_NVSNamespace *, const char *, bool *);
+    bool readNVSValue(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE, uint16_t *, std::string *);
+    bool readNVSBytes(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE, void *, size_t *);
+    bool commitNVSValues(SYS_NVSNamespace *, const SYS_NVSStagedValue *, uint8_t);
+    bool importNVSValue(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE, uint16_t, const std::string &);
+    void reloadNVSValue(SYS_NVSNamespace *, const char *, SYS_NVS_TYPE);
+
+    portMUX_TYPE nvsLockMux = portMUX_INITIALIZER_UNLOCKED; // Lock stats.  Transactions may end on any task.
+    void recordNVSLock(SYS_NVSNamespace *, int64_t, int64_t, bool, bool, bool);
+    void scheduleNVSFlush(void);
+    static void onNVSShutdown(void);
+
+    xTaskHandle taskHandleSystemNVS = nullptr;
+    QueueHandle_t nvsRequestQue = nullptr;
+    SemaphoreHandle_t nvsSpaceSem = nullptr; // Given once for every flush a writer asked for in waitForNVSSpace()
+    static void runNVSTaskMarshaller(void *);
+    void runNVSTask(void);
+    TickType_t getNVSFlushWait(void);
+    bool writeNVSBatch(uint8_t);
+
+    LogStore logStore;
+    void requestLogCompaction(void);
+
+    uint8_t TempFlag = 1;
+
+    /* Debug Flags */
+    bool showRun = false;
+    bool showNVMDebug = false;
+    bool showRunCmd = true;
+    bool showInit = true;
+    bool showIdle = false;
+    bool showTimerSeconds = false;
+    bool showTimerMinutes = false;
+    bool showTimerStats = false;
+    bool showGPIOStats = false;
+    bool showButtonEvents = false;
+    bool showPulseReadings = false;
+    bool showNVSCacheStats = false;
+    bool showLogStoreStats = false;
+    bool showIndicationStats = false;
+};
+
+#include "system_nvs.hpp"
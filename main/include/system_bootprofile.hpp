@@ -0,0 +1,47 @@
+#pragma once
+#include "sdkconfig.h"
+#include "system_defs.hpp"
+
+#include "esp_timer.h" // IDF Libraries
+
+//
+// Boot profiler marks.  Usable from any task and from before System exists.  A mark is one timer read, one atomic slot claim
+// and four stores.  With CONFIG_SYS_BOOT_PROFILE off every mark compiles to nothing.
+//
+//     SYS_BOOT_MARK("SYS", "Start");           // A new phase on the SYS track
+//     SYS_BOOT_WAIT("SYS", "init nodes");      // SYS waits -- until its next mark the time belongs to someone else
+//     SYS_BOOT_SIGNAL("NVS", "Ready");         // Whoever was waiting on NVS may go on
+//
+#if CONFIG_SYS_BOOT_PROFILE
+extern SYS_BootProfile sysBootProfile;
+
+void sysBootProfileReport(const char *, const char *); // Timeline, then the critical path to that track's phase
+
+static inline void sysBootRecord(SYS_BootProfile *profile, const char *track, const char *phase, SYS_BOOT_MARK_TYPE type)
+{
+    auto us = (uint32_t)esp_timer_get_time();
+    auto index = __atomic_fetch_add(&profile->count, 1, __ATOMIC_RELAXED);
+
+    if (index < SYS_BOOT_PROFILE_MARKS)
+    {
+        auto &mark = profile->marks[index];
+        mark.phase = phase;
+        mark.us = us;
+        mark.type = type;
+        __atomic_store_n(&mark.track, track, __ATOMIC_RELEASE); // Last -- the report skips a slot until its track is set
+    }
+}
+
+#define SYS_BOOT_MARK(track, phase) sysBootRecord(&sysBootProfile, (track), (phase), SYS_BOOT_MARK_TYPE::Phase)
+#define SYS_BOOT_WAIT(track, phase) sysBootRecord(&sysBootProfile, (track), (phase), SYS_BOOT_MARK_TYPE::Wait)
+#define SYS_BOOT_SIGNAL(track, phase) sysBootRecord(&sysBootProfile, (track), (phase), SYS_BOOT_MARK_TYPE::Signal)
+#define SYS_BOOT_REPORT(track, phase) sysBootProfileReport((track), (phase))
+#else
+#define SYS_BOOT_MARK(track, phase) \
+    do                              \
+    {                               \
+    } while (0)
+#define SYS_BOOT_WAIT(track, phase) SYS_BOOT_MARK(track, phase)
+#define SYS_BOOT_SIGNAL(track, phase) SYS_BOOT_MARK(track, phase)
+#define SYS_BOOT_REPORT(track, phase) SYS_BOOT_MARK(track, phase)
+#endif
@@ -6,8 +6,365 @@
 
 #define SWITCH_1 GPIO_NUM_0 // Boot Switch -- GPIO_EN.  This a strapping pin is pulled-up by default
 
+#include <string> // Native Libraries
+
 #include "freertos/FreeRTOS.h" // RTOS Libraries
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+#include "nvs.h" // IDF Libraries
+
+//
+// System Timer Wheel - Periodic and one-shot jobs are kept in a hierarchical timing wheel.  Each level holds 64 slots and
+// each slot on a level spans 64 slots of the level below it.  A job lands in the lowest level that can hold its deadline and
+// is cascaded downward as its time approaches.  The cost of a tick stays constant no matter how many jobs are registered.
+//
+#define SYS_TIMER_TICK_US 1000  // Wheel resolution in microseconds (1 ms)
+#define SYS_TIMER_WHEEL_BITS 6  // 64 slots per level
+#define SYS_TIMER_WHEEL_LEVELS 4 // 4 levels cover 2^24 ticks (~4.6 hours).  Longer jobs are parked and re-inserted.
+#define SYS_TIMER_WHEEL_SLOTS (1 << SYS_TIMER_WHEEL_BITS)
+#define SYS_TIMER_WHEEL_MASK (SYS_TIMER_WHEEL_SLOTS - 1)
+#ifndef SYS_TIMER_MAX_JOBS // test/host builds a larger table for its benchmark
+#define SYS_TIMER_MAX_JOBS 24
+#endif
+#define SYS_TIMER_INVALID_JOB 0xFFFF // Job IDs are uint16_t
+#define SYS_TIMER_LATENCY_BUCKETS 16 // Power of two microsecond buckets.  The last bucket collects everything >= 16ms.
+//
+// NVS Write-Back Cache - Values read or written through the System NVS calls are held in RAM.  Writes only mark an entry
+// dirty.  Dirty entries are written to flash together, with one commit per namespace, once writes have been quiet for
+// CONFIG_SYS_NVS_FLUSH_QUIET_MS or when the system restarts.
+//
+#define SYS_NVS_CACHE_ENTRIES CONFIG_SYS_NVS_CACHE_ENTRIES // Entries are indexed with a uint8_t
+
+//
+// Namespaces read into the cache by one pass over the partition at boot.  Components that read NVS during init belong here.
+//
+#define SYS_NVS_PRELOAD_NAMESPACES {"indication"}
+#define SYS_NVS_STRING_KEEP 64 // Evicted entries keep string buffers up to this capacity for reuse
+
+enum class SYS_NVS_TYPE : uint8_t
+{
+    None,
+    U8, // Booleans are stored as U8
+    U16,
+    String,
+    Blob, // Raw bytes.  Like strings they are held in strValue.
+};
+
+//
+// One entry per namespace, created on first use and never released.  Writers of a namespace serialize on its mutex --
+// a FreeRTOS mutex rather than a binary semaphore, so a low priority holder inherits the priority of whoever is waiting.
+// Different namespaces never wait on each other.  Read-only transactions take no namespace lock at all.
+//
+#define SYS_NVS_MAX_NAMESPACES 6
+
+enum class SYS_NVS_MODE : uint8_t
+{
+    ReadWrite,
+    ReadOnly, // Concurrent with other readers and with the writer.  Sees committed values only.
+};
+
+struct SYS_NVSLockStats
+{
+    uint32_t acquires;
+    uint32_t contended; // Acquires that had to wait for another writer
+    uint32_t timeouts;  // Transactions that never got the lock
+    uint32_t readers;   // Read-only transactions -- never locked
+    uint32_t commits;
+    uint32_t rollbacks; // Transactions that ended with staged values and no commit
+    uint32_t holdAvgUs;
+    uint32_t holdMaxUs;
+    uint32_t waitMaxUs;
+};
+
+struct SYS_NVSNamespace
+{
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    SemaphoreHandle_t mutex;  // Held by a read-write transaction for its lifetime
+    nvs_handle_t readHandle;  // Cache misses.  Opened on the first miss and kept.
+    nvs_handle_t writeHandle; // The flush.  Opened on the first flush and kept.
+    bool inUse;
+    bool blnPreloaded; // Every key is in the cache -- a key we do not hold is not in flash either
+    SYS_NVSLockStats lockStats;
+    uint64_t holdTotal;
+};
+
+struct SYS_NVSCacheEntry
+{
+    SYS_NVSNamespace *ns;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    SYS_NVS_TYPE type;
+    bool present; // False when flash holds no value for the key.  Misses are cached too.
+    bool dirty;   // RAM differs from flash.  A dirty entry that is not present is erased by the flush.
+    bool inUse;
+    bool blnPreloaded;
+    uint16_t value;       // U8 and U16 values
+    std::string strValue; // String values
+    uint32_t lastUsed;    // For eviction of clean entries
+    uint32_t version;     // Bumped on every change.  A flush only cleans an entry that did not change while it was written.
+};
+
+struct SYS_NVSPreloadStats
+{
+    uint16_t capacity;   // SYS_NVS_CACHE_ENTRIES
+    uint16_t entries;    // In use now
+    uint16_t keys;       // Read by the boot preload
+    uint8_t namespaces;  // Preloaded and still complete
+    bool blnTruncated;   // The cache filled up before the preload finished
+    uint32_t bytes;      // RAM held by the cache, its index and the flush batch, including string and blob storage
+    uint32_t preloadUs;  // The one pass over the partition
+    uint32_t hits;       // Reads served by a preloaded entry
+    uint32_t absentHits; // Reads of a missing key answered without flash
+};
+
+//
+// A dirty entry as the flush copied it.  Flash is written from the copy with the cache unlocked.
+//
+struct SYS_NVSFlushItem
+{
+    SYS_NVSNamespace *ns;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    SYS_NVS_TYPE type;
+    bool present;
+    bool blnDone;    // Handled as part of its namespace's batch
+    bool blnWritten; // Reached flash and was committed
+    uint8_t index;   // Cache entry it came from
+    uint16_t value;
+    uint32_t version;
+    std::string strValue;
+};
+
+//
+// Requests for the SYS::NVS persistence task.  Dirty only wakes the task so it can wait out the quiet period.  Flush writes
+// everything now and then calls the callback (on SYS::NVS) with the result.  Compact makes room in the log store.
+//
+#define SYS_NVS_REQUEST_QUEUE_SIZE 8
+#define SYS_NVS_SPACE_FLUSHES 3 // Flushes a writer waits out for a free cache entry before its write fails
+
+typedef void (*SYS_NVSDoneCallback)(void *, bool);
+
+enum class SYS_NVS_REQUEST : uint8_t
+{
+    Dirty,
+    Flush,
+    Compact,
+};
+
+struct SYS_NVSRequest
+{
+    SYS_NVS_REQUEST type;
+    SYS_NVSDoneCallback callback;
+    void *ctx;
+};
+
+struct SYS_NVSCacheStats
+{
+    uint32_t reads;
+    uint32_t flashReads;      // Reads and write compares that missed the cache
+    uint32_t flashReadUs;     // Spent on those reads
+    uint32_t writes;
+    uint32_t writesUnchanged; // Writes of the value already held -- never reach flash
+    uint32_t writesCoalesced; // Writes to an entry that was already dirty -- absorbed into one flash write
+    uint32_t flashWrites;
+    uint32_t commits;
+    uint32_t flushes;
+    uint32_t evictions;
+    uint32_t errors;
+    uint32_t spanReads;       // String and blob reads copied straight into a caller's buffer
+    uint32_t spanBytes;
+    uint32_t flushRequests;   // Explicit requests.  Several arriving together share one flush.
+    uint32_t flushMaxUs;      // Longest flush -- spent on SYS::NVS, not on the writer
+    uint32_t cacheHoldMaxUs;  // Longest the flush held the cache
+    uint32_t spaceWaits;      // Writers that found every entry dirty and waited on SYS::NVS for a flush
+};
+
+//
+// A read-write NvsTransaction holds its namespace mutex for its lifetime and stages its sets until commit().  Staged values never touch the cache
+// unless the transaction commits, so an early return simply throws them away.
+//
+#define SYS_NVS_TXN_MAX_STAGED 8
+#define SYS_NVS_LOCK_TIMEOUT_MS 1000
+
+struct SYS_NVSStagedValue
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    SYS_NVS_TYPE type;
+    bool blnErase; // Remove the key instead of writing it
+    uint16_t value;
+    std::string strValue;
+};
+
+//
+// NVS image -- whole namespaces in a compact binary form for provisioning.  Little endian, no padding.
+//
+//   Header     'S' 'N' 'V' version
+//   Namespace  0x01  length (1)  name                         -- applies to the values that follow
+//   U8         0x02  length (1)  key  value (1)
+//   U16        0x03  length (1)  key  value (2)
+//   String     0x04  length (1)  key  length (2)  bytes       -- no terminator
+//   Blob       0x05  length (1)  key  length (2)  bytes
+//   End        0x00  values (2)  crc32 (4)                    -- crc of every byte before it
+//
+#define SYS_NVS_IMAGE_VERSION 1
+#define SYS_NVS_IMAGE_HEADER_SIZE 4
+#define SYS_NVS_IMAGE_MAX_VALUE 4000      // Largest string or blob an import will buffer
+#define SYS_NVS_IMAGE_MAX_STAGED (24 * 1024) // An import holds the whole image until it checks out.  The nvs partition is 0x6000.
+
+enum class SYS_NVS_RECORD : uint8_t
+{
+    End,
+    Namespace,
+    U8,
+    U16,
+    String,
+    Blob,
+};
+
+typedef bool (*SYS_NVSImageWriter)(void *, const uint8_t *, size_t); // Export sink.  False stops the export.
+
+struct SYS_NVSImageStats
+{
+    uint16_t namespaces;
+    uint16_t keys;
+    uint16_t skipped; // Export only -- value types the image does not carry
+    uint32_t bytes;
+    uint32_t elapsedUs;
+};
+
+//
+// Log Store
+//
+// Small values that change often (indication states and the like) are appended to their own data partition instead of
+// being rewritten in NVS.  Every sector begins with a SYS_LogSectorHeader.  The erase half is written straight after the
+// erase and the sequence half when the sector is put into use, so a power cut in either step leaves a header that fails
+// its CRC and the sector is simply erased again.  Records follow the header, 4 byte aligned:
+//
+//   SYS_LogRecordHeader | key (keyLength) | value (valueLength) | 0xFF padding
+//
+// The record CRC covers the first 8 header bytes, the key and the value.  A record that fails it was torn by a power cut;
+// nothing after it in that sector is trusted and the sector takes no more writes.
+//
+#define SYS_LOG_PARTITION_SUBTYPE 0x40
+#define SYS_LOG_PARTITION_LABEL "logstore"
+#define SYS_LOG_SECTOR_SIZE 4096
+#define SYS_LOG_MAX_SECTORS 16
+#define SYS_LOG_MAX_KEYS 32
+#define SYS_LOG_MAX_KEY 15    // Characters, without the terminator
+#define SYS_LOG_MAX_VALUE 64  // Every live value fits in one sector, so compaction always has room to finish
+#define SYS_LOG_COMPACT_FREE 2 // Ask SYS::NVS to compact once this few erased sectors remain
+#define SYS_LOG_SECTOR_MAGIC 0x474F4C53
+#define SYS_LOG_RECORD_MAGIC 0xA55A
+#define SYS_LOG_FLAG_ERASED 0x01 // Tombstone
+
+struct SYS_LogSectorHeader
+{
+    uint32_t magic;
+    uint32_t eraseCount;
+    uint32_t eraseCRC;    // Over magic and eraseCount
+    uint32_t sequence;    // 0xFFFFFFFF until the sector is put into use
+    uint32_t sequenceCRC;
+    uint32_t reserved[3];
+};
+
+struct SYS_LogRecordHeader
+{
+    uint16_t magic;
+    uint8_t keyLength;
+    uint8_t flags;
+    uint16_t valueLength;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+enum class SYS_LOG_SECTOR : uint8_t
+{
+    Dirty,   // Unknown contents -- erased before use
+    Erased,  // Free
+    Active,  // Takes the next record
+    Full,    // Closed, still holds records
+    Retired, // Compacted and waiting for its erase
+};
+
+struct SYS_LogSector
+{
+    SYS_LOG_SECTOR state;
+    uint16_t writeOffset;
+    uint32_t sequence;
+    uint32_t eraseCount;
+};
+
+struct SYS_LogIndexEntry
+{
+    char key[SYS_LOG_MAX_KEY + 1];
+    uint8_t value[SYS_LOG_MAX_VALUE]; // Reads are served from RAM -- flash is only read at mount
+    uint8_t valueLength;
+    uint8_t sector;
+    uint16_t offset;
+    bool inUse;
+};
+
+struct SYS_LogStoreStats
+{
+    uint32_t sets;
+    uint32_t setsUnchanged;  // Never reach flash
+    uint32_t bytesRequested; // Key and value bytes of the sets that were written
+    uint32_t bytesWritten;   // Everything that reached flash -- framing, padding, headers and compaction copies
+    uint32_t compactions;
+    uint32_t compactedBytes;
+    uint32_t erases;
+    uint32_t eraseMin;       // Per sector erase counts, for wear
+    uint32_t eraseMax;
+    uint32_t tornRecords;    // Found at mount
+    uint32_t errors;
+    uint16_t liveKeys;
+    uint8_t freeSectors;
+    uint8_t sectors;
+};
+
+//
+// Warm Resume - A snapshot of System and Indication state is kept in RTC memory that survives a software restart, panic,
+// watchdog reset or deep sleep wake.  When the reset was one of those and the snapshot's CRC and firmware version check out,
+// init skips the NVS preload, the settings restore and the version blink.  Power-on, brownout and the reset pin always take
+// the cold path.
+//
+#define SYS_RESUME_MAGIC 0x454D5352
+#define SYS_RESUME_IND_SIZE 16 // Opaque to System -- laid out by Indication
+
+struct SYS_ResumeSnapshot
+{
+    uint32_t crc;       // esp_rom_crc32_le over every byte after this field
+    uint32_t magic;
+    uint16_t length;    // sizeof(SYS_ResumeSnapshot) of the firmware that wrote it
+    uint8_t major;      // Only the firmware that wrote it trusts it
+    uint8_t minor;
+    uint8_t revision;
+    uint8_t indLength;  // Zero until Indication has saved its state
+    uint16_t reserved;
+    uint32_t warmBoots; // Warm resumes since the last cold boot
+    uint32_t coldRunUs; // Time-to-Run of the last cold boot
+    uint32_t warmRunUs; // Time-to-Run of the last warm resume
+    uint8_t ind[SYS_RESUME_IND_SIZE];
+};
+
+//
+// Fixed capacity string for allocation-free NVS reads.  N includes the terminator.
+//
+template <size_t N>
+struct SYS_FixedString
+{
+    char data[N] = {};
+    size_t length = 0;
+
+    const char *c_str(void) const { return data; }
+    constexpr size_t capacity(void) const { return N - 1; }
+    void clear(void)
+    {
+        data[0] = 0;
+        length = 0;
+    }
+};
+
 //
 // Run - This is our primary loop where we service periodic tasks.  We handle SNTP and Task Notifications.  Task Notifications
 //       are simple flags sent between tasks which are fundemental to the system - like connected states.
@@ -25,13 +382,73 @@ enum class SYS_OP : uint8_t // System Operations
 enum class SYS_INIT : uint8_t // System Initialization states
 {
     Start,
-    InitNVS,
-    RestoreSysVaribles,
-    CreateIND,
-    WaitOnIND,
+    WaitOnNodes,
     Finished,
 };
 
+//
+// Init Graph - Each component is a node with the nodes it depends on and the core it starts on.  A node starts on its own
+// short-lived task as soon as its dependencies are ready and sets its bit in the init event group once it is ready itself,
+// so nodes that do not depend on each other come up together on both cores.  System enters SYS_OP::Run once the nodes in
+// SYS_INIT_RUN_DEPS are ready -- the rest keep going and are hooked in as they finish.
+//
+enum class SYS_INIT_NODE : uint8_t
+{
+    NVS,        // NVS, the persistence task, the preload and the log store
+    Indication, // Returns once the version blink and the settings restore are done
+    Timer,      // Timer wheel jobs and the timer task
+    Count,
+};
+
+#define SYS_INIT_BIT(node) ((EventBits_t)1 << (uint8_t)(node))
+#define SYS_INIT_ALL_BITS (SYS_INIT_BIT(SYS_INIT_NODE::Count) - 1)
+#define SYS_INIT_RUN_DEPS (SYS_INIT_BIT(SYS_INIT_NODE::NVS) | SYS_INIT_BIT(SYS_INIT_NODE::Timer))
+#define SYS_INIT_WAIT_LOG_MS 5000 // Report the nodes still pending every so often
+
+class System;
+
+struct SYS_InitNode
+{
+    const char *name;
+    EventBits_t deps;
+    BaseType_t core;   // 0 PRO_CPU, 1 APP_CPU
+    uint32_t stack;
+    bool blnStarted;
+    int64_t startUs;   // Since boot
+    int64_t readyUs;
+    System *owner;     // The node task's way back
+};
+
+//
+// Boot Profiler - Compiled in with CONFIG_SYS_BOOT_PROFILE.  Marks are stored in the order they claimed a slot, from any task,
+// and sorted when the timeline is shown.  A phase lasts until the next mark on the same track.  A wait mark starts a phase
+// that is spent waiting on another track, and the critical path follows it to the last signal given during the wait.
+//
+#if CONFIG_SYS_BOOT_PROFILE
+#define SYS_BOOT_PROFILE_MARKS CONFIG_SYS_BOOT_PROFILE_MARKS
+
+enum class SYS_BOOT_MARK_TYPE : uint8_t
+{
+    Phase,
+    Wait,   // This track is blocked until its next mark
+    Signal, // This track just released someone -- a node became ready, a semaphore was given
+};
+
+struct SYS_BootMark
+{
+    const char *track; // "SYS", "IND", an init node name ...
+    const char *phase;
+    uint32_t us;       // esp_timer_get_time()
+    SYS_BOOT_MARK_TYPE type;
+};
+
+struct SYS_BootProfile
+{
+    SYS_BootMark marks[SYS_BOOT_PROFILE_MARKS];
+    uint32_t count; // Slots claimed.  Can pass SYS_BOOT_PROFILE_MARKS -- the rest were dropped.
+};
+#endif
+
 //
 // System Command are not currently in use.
 //
@@ -55,4 +472,219 @@ struct SYS_Response
 {
     SYS_CMD ResponseCmd;
     void *data;
-};
\ No newline at end of file
+};
+
+//
+// Timer jobs are called from the SYS::TIMER task -- never from an ISR.  Keep them short.
+//
+// Periodic jobs are anchored to absolute esp_timer deadlines (start + n * period) so they never accumulate drift.  When the timer
+// task falls behind by one or more whole periods, the job's policy decides what happens:
+//
+// Skip     - Run once and drop the missed periods.  The callback always sees 0 and the next deadline stays on the original
+//            grid.  The dropped periods are only counted in the job's stats.  (default)
+// CatchUp  - Run once for every missed period, back to back.  The callback always sees 0.
+// Coalesce - Run once for all of them.  The callback is passed the number of missed periods it stands in for, and is
+//            expected to do their work as well (a counter adds them, a sampler scales by them ...).
+//
+// The second callback argument is only ever non-zero for Coalesce jobs.
+//
+enum class SYS_TIMER_POLICY : uint8_t
+{
+    Skip,
+    CatchUp,
+    Coalesce,
+};
+
+typedef void (*SYS_TimerCallback)(void *, uint32_t);
+
+struct SYS_TimerJob
+{
+    SYS_TimerJob *next; // Intrusive links into a wheel slot
+    SYS_TimerJob *prev;
+    SYS_TimerCallback callback;
+    void *ctx;
+    uint64_t expires; // Absolute wheel tick at which this job is due
+    uint32_t period;  // Period in ticks.  Zero for one-shot jobs.
+    SYS_TIMER_POLICY policy;
+    uint8_t level;    // Where the job currently sits in the wheel
+    uint8_t slot;
+    bool inUse;  // Job entry is allocated
+    bool linked; // Job is sitting in a wheel slot
+
+    uint32_t runs; // Instrumentation -- see SYS_TimerJobStats
+    uint32_t overruns;
+    uint32_t dropped;
+    uint32_t maxLateUs;
+};
+
+//
+// Timer instrumentation snapshots.  Wake latency is measured from genTimerCallback to the moment SYS::TIMER runs.  A missed tick
+// is a notification that was coalesced into another one.  A job overrun is a job that ran a full period (or more) late.
+//
+struct SYS_TimerStats
+{
+    uint32_t wakeups;
+    uint32_t missedTicks;
+    uint32_t latencySamples;
+    uint32_t latencyP50Us; // Upper bound of the bucket holding the percentile
+    uint32_t latencyP99Us;
+    uint32_t latencyMaxUs; // Exact
+    uint32_t histogram[SYS_TIMER_LATENCY_BUCKETS];
+};
+
+struct SYS_TimerJobStats
+{
+    uint32_t periodUs; // Zero for one-shot jobs
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t dropped; // Periods a Skip job let pass without a call
+    uint32_t maxLateUs;
+};
+
+//
+// GPIO Event Router - ISRs push timestamped {pin, level} events into a single-producer/single-consumer ring.  The SYS::GPIO
+// task drains the ring in batches and routes each event to the handler registered for that pin.
+//
+#define SYS_GPIO_MAX_HANDLERS 8
+#define SYS_GPIO_RING_SIZE 64 // Must be a power of two
+#define SYS_GPIO_BATCH_SIZE 16
+
+#define SYS_GPIO_CONFIG_QUEUE_SIZE 4
+
+#define SYS_GPIO_NOTIFY_EVENTS 0x01   // Task notification bits for SYS::GPIO.  The task blocks until one of these arrives.
+#define SYS_GPIO_NOTIFY_BUTTONS 0x02  // A button deadline has come due
+#define SYS_GPIO_NOTIFY_CONFIG 0x04   // Registrations are waiting in the config queue
+#define SYS_GPIO_NOTIFY_RUN 0x08      // System reached SYS_OP::Run -- replay the events held during Init
+#define SYS_GPIO_NOTIFY_SHUTDOWN 0x10 // Remove our ISR handlers and end the task
+
+struct SYS_GPIOEvent
+{
+    int64_t timestamp; // esp_timer time of the edge
+    uint8_t pin;
+    uint8_t level;
+};
+
+typedef void (*SYS_GPIOCallback)(void *, const SYS_GPIOEvent &); // Called from the SYS::GPIO task
+
+struct SYS_GPIOHandler
+{
+    uint8_t pin;
+    SYS_GPIOCallback callback;
+    void *ctx;
+    bool inUse;
+};
+
+struct SYS_GPIOStats
+{
+    uint32_t wakeups;     // SYS::GPIO wakeups
+    uint32_t idleWakeups; // Wakeups that found nothing to do
+    uint32_t events;      // Events delivered to handlers
+    uint32_t drops;   // Edges lost because the ring was full
+    uint32_t batches; // Ring drains
+    uint32_t maxBatch;
+    uint32_t latencyAvgUs; // ISR timestamp to handler call
+    uint32_t latencyMaxUs;
+};
+
+//
+// Button Engine - Each button pin has its own timestamp based debounce state machine.  Edges only restart a deadline, and the
+// level is sampled once the line has been quiet for SYS_BUTTON_DEBOUNCE_US.  A single one-shot timer job covers the earliest
+// deadline of all buttons.  When no button is moving there are no deadlines, no timer job and no wakeups.  Edges that reach us
+// after their deadline has passed (those held in the ring during Init) are judged on their recorded level and time instead.
+//
+#define SYS_GPIO_MAX_BUTTONS 4
+#define SYS_BUTTON_DEBOUNCE_US (20 * 1000)      // Line must be quiet this long before we trust the level
+#define SYS_BUTTON_LONG_PRESS_US (800 * 1000)   // Held this long is a long press
+#define SYS_BUTTON_REPEAT_US (200 * 1000)       // Auto-repeat interval after a long press
+#define SYS_BUTTON_DOUBLE_CLICK_US (400 * 1000) // Release to next press inside this window is a double click
+
+enum class SYS_BUTTON_EVENT : uint8_t
+{
+    Press,
+    Release, // Always follows a Press.  heldMs carries the press duration.
+    LongPress,
+    DoubleClick, // Sent right after the second Press
+    AutoRepeat,
+};
+
+enum class SYS_BUTTON_STATE : uint8_t
+{
+    Idle,
+    PressSettling,
+    Pressed,
+    Held, // Long press reached -- auto-repeating
+    ReleaseSettling,
+};
+
+typedef void (*SYS_ButtonCallback)(void *, uint8_t, SYS_BUTTON_EVENT, uint32_t); // ctx, pin, event, heldMs
+
+struct SYS_Button
+{
+    uint8_t pin;
+    bool activeLow;
+    SYS_BUTTON_STATE state;
+    bool blnWasHeld;         // State to return to if a release turns out to be a bounce
+    int64_t deadline;        // Zero when nothing is pending
+    int64_t pressTime;       // esp_timer time of the confirmed press
+    int64_t lastReleaseTime; // For double click detection
+    uint8_t clickCount;
+    uint8_t edgeLevel;       // Level the ISR recorded with the latest edge
+    bool blnReplayed;        // The latest edge arrived after its deadline -- judge it on edgeLevel, not the pin
+    SYS_ButtonCallback callback;
+    void *ctx;
+    bool inUse;
+};
+
+//
+// Pulse counters.  The ISR only counts edges and stamps the first and last one.  A timer wheel job closes each measurement
+// window and publishes the reading, so a pin running at tens of kHz costs no queue traffic and no task wakeups per edge.
+//
+#define SYS_GPIO_MAX_COUNTERS 4
+
+struct SYS_PulseReading
+{
+    uint32_t count;    // Edges in the window
+    uint64_t total;    // Edges since registration
+    uint32_t periodUs; // Mean edge to edge time.  Zero when the window did not hold a full period.
+    float frequencyHz; // From periodUs, so it is not quantized to the window length
+    uint32_t windowUs; // Actual length of the window
+};
+
+typedef void (*SYS_PulseCallback)(void *, uint8_t, const SYS_PulseReading &); // ctx, pin, reading
+
+struct SYS_PulseCounter
+{
+    volatile uint32_t edges;     // Written by the ISR.  Edges in the open window.
+    volatile int64_t firstEdge;  // Written by the ISR
+    volatile int64_t lastEdge;   // Written by the ISR
+    int64_t prevEdge;            // Last edge of any earlier window.  Zero until the first edge.
+    int64_t windowStart;
+    SYS_PulseReading reading;    // Last published reading
+    SYS_PulseCallback callback;
+    void *ctx;
+    uint16_t jobID;
+    uint8_t pin;
+    bool inUse;
+};
+
+//
+// Registrations made from other tasks are handed to SYS::GPIO so the handler and button tables are only ever touched by one task.
+//
+enum class SYS_GPIO_CONFIG : uint8_t
+{
+    Handler,
+    Button,
+    PulseCounter,
+};
+
+struct SYS_GPIOConfigRequest
+{
+    SYS_GPIO_CONFIG type;
+    uint8_t pin;
+    uint8_t option; // gpio_int_type_t for handlers and pulse counters, activeLow for buttons
+    uint32_t windowMs; // Pulse counters only
+    SYS_GPIOCallback gpioCallback;
+    SYS_ButtonCallback buttonCallback;
+    SYS_PulseCallback pulseCallback;
+    void *ctx;
+};
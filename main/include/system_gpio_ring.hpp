@@ -0,0 +1,17 @@
+#pragma once
+#include "system_defs.hpp"
+
+#include <stdint.h> // Standard libraries
+
+#include "freertos/FreeRTOS.h" // RTOS Libraries
+#include "freertos/task.h"
+
+//
+// The event ring between the GPIO ISR and SYS::GPIO.  None of it touches System or the GPIO hardware, so it is also built
+// off target by test/host.
+//
+extern xTaskHandle gpioEventTask; // Notified with SYS_GPIO_NOTIFY_EVENTS for every event pushed.  Null stops the notifies.
+
+bool pushGPIOEvent(uint8_t, uint8_t);               // ISR only.  Pin, level.  False when the ring was full and the edge dropped.
+uint32_t takeGPIOEvents(SYS_GPIOEvent *, uint32_t); // SYS::GPIO only.  Copies out up to the count and frees their slots.
+uint32_t getGPIORingDrops(void);
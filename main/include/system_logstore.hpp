@@ -0,0 +1,62 @@
+#pragma once
+#include "system_defs.hpp"
+
+#include <stddef.h> // Standard libraries
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h" // RTOS Libraries
+#include "freertos/semphr.h"
+
+#include "esp_partition.h" // IDF Libraries
+
+//
+// Append-only key/value store for hot state.  A set appends one small record to the active sector -- no erase, no page
+// rewrite -- and the RAM index points at the newest copy of each key.  Sectors are used oldest first and the least worn
+// erased sector is taken next.  When free sectors run low, SYS::NVS copies the live records out of the oldest sector and
+// erases it.
+//
+// NVS still holds configuration that rarely changes.  This is for values that may change on every button press.
+//
+class LogStore
+{
+public:
+    LogStore(void) = default;
+
+    LogStore(const LogStore &) = delete;
+    void operator=(LogStore const &) = delete;
+
+    bool mount(void);
+    bool isMounted(void) const { return partition != nullptr; }
+
+    bool get(const char *, void *, size_t *); // In: buffer size.  Out: stored size.  False if absent or it did not fit.
+    bool set(const char *, const void *, size_t);
+    bool erase(const char *);
+
+    bool wantsCompaction(void);
+    bool compact(void); // Background work -- erases happen without the lock held
+    void getStats(SYS_LogStoreStats *);
+
+private:
+    char TAG[5] = "LOG ";
+
+    const esp_partition_t *partition = nullptr;
+    SemaphoreHandle_t mutex = nullptr;
+
+    SYS_LogSector sectors[SYS_LOG_MAX_SECTORS] = {};
+    uint8_t sectorCount = 0;
+    uint8_t head = 0xFF; // Active sector
+    uint32_t nextSequence = 0;
+
+    SYS_LogIndexEntry index[SYS_LOG_MAX_KEYS] = {};
+    SYS_LogStoreStats stats = {};
+
+    bool scanSector(uint8_t);
+    SYS_LogIndexEntry *findEntry(const char *);
+    SYS_LogIndexEntry *allocEntry(void);
+    bool appendRecord(const char *, uint8_t, const void *, size_t, bool, uint8_t *, uint16_t *);
+    bool advanceHead(bool);
+    bool prepareSector(uint8_t, uint32_t);
+    void finishErase(uint8_t, bool);
+    uint8_t retireOldest(void);
+    uint8_t countFree(void);
+};
@@ -0,0 +1,204 @@
+#pragma once
+#include "system_defs.hpp"
+#include "system_settings.hpp"
+
+#include <string> // Native Libraries
+
+#include "freertos/FreeRTOS.h" // RTOS Libraries
+
+class System;
+
+//
+// Scoped NVS access.  A read-write transaction takes its namespace's mutex (with a timeout), so writers of one namespace
+// serialize while other namespaces carry on.  Sets are staged inside the transaction and reach the cache in one step when
+// commit() is called.  The destructor gives the lock back, dropping anything that was not committed -- so every early
+// return rolls back on its own.
+//
+// A read-only transaction takes no lock and any number may run at once.  It sees committed values only and every set fails.
+//
+// Nothing in here logs.  Callers gather what they need, let the transaction go out of scope and log afterwards so the
+// lock is held for as short a time as possible.
+//
+//     {
+//         NvsTransaction txn("indication");
+//
+//         if (!txn.isOpen())
+//             return false;
+//
+//         txn.setU8("aDefValue", aValue);
+//         blnResult = txn.commit();
+//     }
+//     ESP_LOGI(TAG, ...);
+//
+class NvsTransaction
+{
+public:
+    NvsTransaction(const char *, SYS_NVS_MODE = SYS_NVS_MODE::ReadWrite, TickType_t = pdMS_TO_TICKS(SYS_NVS_LOCK_TIMEOUT_MS));
+    ~NvsTransaction(void);
+
+    NvsTransaction(const NvsTransaction &) = delete;
+    void operator=(NvsTransaction const &) = delete;
+
+    bool isOpen(void) const { return blnOpen; }
+
+    bool getBool(const char *, bool *);
+    bool getU8(const char *, uint8_t *);
+    bool getU16(const char *, uint16_t *);
+    bool getString(const char *, std::string *);       // Assigned once from the cached length
+    bool getString(const char *, char *, size_t *);     // Caller's buffer.  In: size.  Out: stored size with terminator.
+    bool getStringLength(const char *, size_t *);       // Cached -- no flash access after the first read
+    template <size_t N>
+    bool getString(const char *, SYS_FixedString<N> *);
+
+    bool setBool(const char *, bool);
+    bool setU8(const char *, uint8_t);
+    bool setU16(const char *, uint16_t);
+    bool setString(const char *, const std::string &);
+
+    bool getBlob(const char *, void *, size_t *); // In: buffer size.  Out: stored size.  False if it did not fit.
+    bool setBlob(const char *, const void *, size_t);
+    bool erase(const char *);
+
+    template <typename T>
+    bool get(const SYS_Setting<T> &, T *); // False when the default was used
+    template <typename T>
+    bool set(const SYS_Setting<T> &, T);
+
+    bool commit(void);                                // The cache has it.  SYS::NVS writes flash after the quiet period.
+    bool commit(SYS_NVSDoneCallback, void * = nullptr); // Written to flash now.  The callback runs on SYS::NVS.
+
+private:
+    System *sys = nullptr;
+    SYS_NVSNamespace *ns = nullptr;
+    bool blnOpen = false;
+    bool blnReadOnly = false;
+    bool blnContended = false;
+    bool blnCommitted = false;
+    int64_t lockTime = 0;
+    int64_t waitUs = 0;
+
+    SYS_NVSStagedValue staged[SYS_NVS_TXN_MAX_STAGED] = {};
+    uint8_t stagedCount = 0;
+
+    SYS_NVSStagedValue *findStaged(const char *);
+    bool isNamespace(const char *);
+    bool getValue(const char *, SYS_NVS_TYPE, uint16_t *, std::string *);
+    bool getBytes(const char *, SYS_NVS_TYPE, void *, size_t *);
+    bool setValue(const char *, SYS_NVS_TYPE, uint16_t, const std::string *);
+};
+
+//
+// Writes an NVS image (see SYS_NVS_RECORD) straight to flash, bypassing the cache.  Feed it the image in chunks of any
+// size.  Each record is checked as it arrives and staged in RAM, up to SYS_NVS_IMAGE_MAX_STAGED bytes -- a larger image is
+// rejected.  finish() checks the trailer and that every namespace fits the pool.  Only then does it take the flush, write
+// the staged records, commit each namespace once and bring the cache in line, so a slow sender never holds up SYS::NVS
+// and a rejected image leaves flash and the cache exactly as they were.
+//
+// With blnVerifyOnly the image is only checked.  Nothing is staged or written and no namespace is added to the pool.
+//
+//     NvsImport import;
+//
+//     if (import.feed(data, length) && import.finish(&stats))
+//         ESP_LOGI(TAG, "%d keys in %d us", stats.keys, stats.elapsedUs);
+//
+class NvsImport
+{
+public:
+    NvsImport(TickType_t = pdMS_TO_TICKS(SYS_NVS_LOCK_TIMEOUT_MS), bool = false); // Flush wait in finish().  True to only check the image.
+
+    NvsImport(const NvsImport &) = delete;
+    void operator=(NvsImport const &) = delete;
+
+    bool isOpen(void) const { return blnOpen; }
+    bool isComplete(void) const { return blnEnd; } // The trailer has arrived
+
+    bool feed(const uint8_t *, size_t); // False once the image has gone bad
+    bool finish(SYS_NVSImageStats * = nullptr);
+
+private:
+    System *sys = nullptr;
+    TickType_t lockTimeout = 0;
+    bool blnOpen = false;
+    bool blnFailed = false;
+    bool blnHeader = false;
+    bool blnEnd = false;
+    bool blnNamespace = false; // A namespace record has been seen
+    bool blnVerifyOnly = false;
+    bool blnWritten = false;
+    uint32_t crc = 0;
+    uint32_t imageCRC = 0;
+    uint16_t imageValues = 0;
+    char names[SYS_NVS_MAX_NAMESPACES][NVS_KEY_NAME_MAX_SIZE] = {}; // Every namespace in the image, once each
+    SYS_NVSNamespace *namespaces[SYS_NVS_MAX_NAMESPACES] = {};       // Looked up in finish()
+    uint8_t nameCount = 0;
+    std::string pending; // Bytes of a record that has not fully arrived
+    std::string staged;  // Checked records, waiting for the trailer
+    std::string value;
+    SYS_NVSImageStats stats = {};
+    int64_t start = 0;
+
+    size_t recordLength(const uint8_t *, size_t); // Zero until the whole record is there
+    bool checkRecord(const uint8_t *, size_t);
+    bool writeStaged(void);
+    void reloadStaged(void);
+    int8_t findName(const char *);
+    bool fail(void);
+};
+
+template <size_t N>
+bool NvsTransaction::getString(const char *key, SYS_FixedString<N> *str)
+{
+    size_t length = N;
+
+    if (!getString(key, str->data, &length))
+    {
+        str->clear();
+        return false;
+    }
+    str->length = length - 1;
+    return true;
+}
+
+template <typename T>
+bool NvsTransaction::get(const SYS_Setting<T> &setting, T *value)
+{
+    uint16_t raw = 0;
+    *value = setting.defaultValue;
+
+    if (!isNamespace(setting.name_space) || !getValue(setting.key, sysSettingType<T>(), &raw, nullptr) || !setting.inRange(raw))
+        return false;
+
+    *value = static_cast<T>(raw);
+    return true;
+}
+
+template <typename T>
+bool NvsTransaction::set(const SYS_Setting<T> &setting, T value)
+{
+    auto raw = static_cast<uint16_t>(value);
+
+    if (!isNamespace(setting.name_space) || !setting.inRange(raw))
+        return false;
+
+    return setValue(setting.key, sysSettingType<T>(), raw, nullptr);
+}
+
+//
+// Single setting access.  Each call is its own transaction -- use an NvsTransaction to read or write several together.
+//
+template <typename T>
+T System::get(const SYS_Setting<T> &setting)
+{
+    T value = setting.defaultValue;
+    NvsTransaction txn(setting.name_space, SYS_NVS_MODE::ReadOnly);
+
+    txn.get(setting, &value);
+    return value;
+}
+
+template <typename T>
+bool System::set(const SYS_Setting<T> &setting, T value)
+{
+    NvsTransaction txn(setting.name_space);
+    return txn.set(setting, value) && txn.commit();
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include "system_defs.hpp"
+
+#include <stdint.h> // Standard libraries
+
+#include "freertos/FreeRTOS.h" // RTOS Libraries
+
+//
+// The counting half of the pulse counters -- the edge ISR and the window math.  None of it touches System, so it is also
+// built off target by test/host.
+//
+extern portMUX_TYPE pulseCounterMux;
+
+void GPIOPulseIsrHandler(void *);
+SYS_PulseReading closePulseWindow(SYS_PulseCounter *, int64_t); // Takes the ISR counts, publishes the reading and returns it
@@ -0,0 +1,70 @@
+#pragma once
+#include "system_defs.hpp"
+
+#include <stdint.h> // Standard libraries
+#include <type_traits>
+
+#include "indication/indication_defs.hpp" // Components
+
+//
+// Settings Schema
+//
+// Every persistent setting is declared once here with its namespace, key, type, default and allowed range.  The
+// declaration is a constexpr object, so keys are string literals, the storage type is picked from the C++ type and a bad
+// key length or an out of range default fails the build.  Read and write settings with System::get()/set() or, to touch
+// several at once under one lock, NvsTransaction::get()/set().
+//
+// A value missing from flash or outside its range reads back as the default.  A set outside the range is refused.
+//
+// Supported types are bool, uint8_t, uint16_t and enums with an unsigned 8 or 16 bit underlying type.
+//
+template <typename T>
+struct SYS_Setting
+{
+    const char *name_space;
+    const char *key;
+    T defaultValue;
+    T minValue;
+    T maxValue;
+
+    constexpr bool inRange(uint16_t raw) const
+    {
+        return (raw >= static_cast<uint16_t>(minValue)) && (raw <= static_cast<uint16_t>(maxValue));
+    }
+};
+
+template <typename T>
+constexpr SYS_NVS_TYPE sysSettingType(void)
+{
+    static_assert(sizeof(T) <= sizeof(uint16_t), "Settings are stored as U8 or U16");
+    static_assert(std::is_enum<T>::value || !std::is_signed<T>::value, "Signed settings are not supported");
+    return (sizeof(T) == sizeof(uint8_t)) ? SYS_NVS_TYPE::U8 : SYS_NVS_TYPE::U16;
+}
+
+constexpr size_t sysSettingKeyLength(const char *str)
+{
+    return (*str == 0) ? 0 : 1 + sysSettingKeyLength(str + 1);
+}
+
+template <typename T>
+constexpr bool sysSettingIsValid(const SYS_Setting<T> &setting)
+{
+    return (sysSettingKeyLength(setting.name_space) < NVS_KEY_NAME_MAX_SIZE) &&
+           (sysSettingKeyLength(setting.key) < NVS_KEY_NAME_MAX_SIZE) &&
+           (static_cast<uint16_t>(setting.minValue) <= static_cast<uint16_t>(setting.maxValue)) &&
+           setting.inRange(static_cast<uint16_t>(setting.defaultValue));
+}
+
+#define SYS_SETTING_DEF(name, type, name_space, key, def, min, max)    \
+    constexpr SYS_Setting<type> name = {name_space, key, def, min, max}; \
+    static_assert(sysSettingIsValid(name), #name ": key too long or default out of range")
+
+//
+//              Name                    Type       Namespace     Key          Default          Min             Max
+//
+SYS_SETTING_DEF(SET_IND_A_STATE,        LED_STATE, "indication", "aState",    LED_STATE::AUTO, LED_STATE::OFF, LED_STATE::ON);
+SYS_SETTING_DEF(SET_IND_B_STATE,        LED_STATE, "indication", "bState",    LED_STATE::AUTO, LED_STATE::OFF, LED_STATE::ON);
+SYS_SETTING_DEF(SET_IND_C_STATE,        LED_STATE, "indication", "cState",    LED_STATE::AUTO, LED_STATE::OFF, LED_STATE::ON);
+SYS_SETTING_DEF(SET_IND_A_DEF_VALUE,    uint8_t,   "indication", "aDefValue", 1,               1,              255);
+SYS_SETTING_DEF(SET_IND_B_DEF_VALUE,    uint8_t,   "indication", "bDefValue", 1,               1,              255);
+SYS_SETTING_DEF(SET_IND_C_DEF_VALUE,    uint8_t,   "indication", "cDefValue", 1,               1,              255);
@@ -0,0 +1,52 @@
+#pragma once
+#include "system_defs.hpp"
+
+#include <stdint.h> // Standard libraries
+
+#include "freertos/FreeRTOS.h" // RTOS Libraries
+
+//
+// Hierarchical timing wheel behind SYS::TIMER.  The wheel keeps the jobs and moves them through its levels.  System owns the
+// esp_timer and the task that wakes it, so the wheel only needs esp_timer_get_time() and is also built off target by
+// test/host.
+//
+class TimerWheel
+{
+public:
+    TimerWheel(void) = default;
+
+    TimerWheel(const TimerWheel &) = delete;
+    void operator=(TimerWheel const &) = delete;
+
+    void start(int64_t); // esp_timer time of tick zero.  Jobs may be scheduled before the first advance.
+
+    bool schedule(uint64_t, uint64_t, SYS_TimerCallback, void *, uint16_t *, SYS_TIMER_POLICY, bool *); // delay, period ... Out: new earliest deadline
+    bool cancel(uint16_t);
+
+    uint64_t currentTick(void);
+    void advance(uint64_t); // Runs every job that falls due up to and including the target tick
+    uint64_t armNextTick(void); // Next tick with work, remembered as the armed deadline.  UINT64_MAX when there are no jobs.
+    int64_t tickTime(uint64_t) const; // esp_timer time of a tick
+
+    bool getJobStats(uint16_t, SYS_TimerJobStats *);
+    void resetJobStats(void);
+
+private:
+    char TAG[5] = "TMR ";
+
+    static_assert(SYS_TIMER_MAX_JOBS < SYS_TIMER_INVALID_JOB, "SYS_TIMER_MAX_JOBS must leave room for SYS_TIMER_INVALID_JOB");
+
+    SYS_TimerJob jobs[SYS_TIMER_MAX_JOBS] = {};
+    SYS_TimerJob *slots[SYS_TIMER_WHEEL_LEVELS][SYS_TIMER_WHEEL_SLOTS] = {};
+    uint64_t occupied[SYS_TIMER_WHEEL_LEVELS] = {}; // One bit per non-empty slot
+    uint64_t now = 0;                               // Current wheel tick
+    int64_t epoch = 0;                              // esp_timer time of wheel tick zero
+    uint64_t armedTick = UINT64_MAX;                // Deadline the one-shot timer is armed for (tickless)
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    void insertJob(SYS_TimerJob *);
+    void unlinkJob(SYS_TimerJob *);
+    void cascade(uint8_t, uint8_t);
+    void processTick(void);
+    uint64_t nextEventTick(void);
+};
@@ -2,6 +2,8 @@
 
 extern "C" void app_main(void)
 {
+    SYS_BOOT_MARK("MAIN", "app_main");
+
     //
     // System Info
     //
@@ -9,7 +11,9 @@ extern "C" void app_main(void)
     ESP_LOGI("MAIN", "Free heap memory: %d bytes", esp_get_free_heap_size());
     ESP_LOGI("MAIN", "IDF version: %s", esp_get_idf_version());
 
+    SYS_BOOT_MARK("MAIN", "System");
     __attribute__((unused)) auto &sys = System::getInstance(); // Create the system singleton object...
+    SYS_BOOT_MARK("MAIN", "Idle");
 
     while (true)
     {
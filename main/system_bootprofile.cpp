@@ -0,0 +1,178 @@
+#include "system_bootprofile.hpp"
+
+#if CONFIG_SYS_BOOT_PROFILE
+
+#include <string.h>
+
+#include "esp_log.h"
+
+//
+// Boot Profiler
+//
+// Marks are only sorted and walked once, when the report is asked for, so a mark itself stays under a microsecond.  The
+// report measures that cost the same way marks are taken and shows it with the timeline.
+//
+SYS_BootProfile sysBootProfile = {};
+
+static SYS_BootProfile scratchProfile = {}; // Only for timing a mark
+static SYS_BootMark reportMarks[SYS_BOOT_PROFILE_MARKS];
+
+static bool isSameTrack(const SYS_BootMark &a, const SYS_BootMark &b)
+{
+    return (a.track == b.track) || (strcmp(a.track, b.track) == 0);
+}
+
+//
+// Walks back from the end mark.  Inside a phase we step to the previous mark on the same track.  A wait hands the path to the
+// last signal given on another track while we waited.  The first mark of a track hands it to whichever track marked last
+// before it -- usually the one that created our task.
+//
+static uint32_t getCriticalPath(const SYS_BootMark *marks, uint32_t count, uint32_t end, uint8_t *path)
+{
+    uint32_t length = 0;
+    int32_t cursor = end;
+
+    while ((cursor >= 0) && (length < count))
+    {
+        path[length++] = (uint8_t)cursor;
+
+        int32_t prev = -1;
+
+        for (int32_t j = cursor - 1; j >= 0; j--)
+        {
+            if (isSameTrack(marks[j], marks[cursor]))
+            {
+                prev = j;
+                break;
+            }
+        }
+
+        bool blnWait = (prev >= 0) && (marks[prev].type == SYS_BOOT_MARK_TYPE::Wait);
+
+        if ((prev >= 0) && !blnWait)
+        {
+            cursor = prev;
+            continue;
+        }
+
+        int32_t handoff = -1;
+        uint32_t since = (prev >= 0) ? marks[prev].us : 0;
+
+        for (int32_t j = cursor - 1; j >= 0; j--)
+        {
+            if (marks[j].us < since)
+                break;
+
+            if (isSameTrack(marks[j], marks[cursor]) || (blnWait && (marks[j].type != SYS_BOOT_MARK_TYPE::Signal)))
+                continue;
+
+            handoff = j;
+            break;
+        }
+
+        cursor = (handoff >= 0) ? handoff : prev;
+    }
+    return length;
+}
+
+void sysBootProfileReport(const char *endTrack, const char *endPhase)
+{
+    static const char *TAG = "BOOT";
+
+    uint32_t count = __atomic_load_n(&sysBootProfile.count, __ATOMIC_RELAXED);
+    uint32_t dropped = 0;
+
+    if (count > SYS_BOOT_PROFILE_MARKS)
+    {
+        dropped = count - SYS_BOOT_PROFILE_MARKS;
+        count = SYS_BOOT_PROFILE_MARKS;
+    }
+
+    //
+    // A task may have claimed a slot below count and not yet filled it in, so we copy the marks out and sort the copy.  A slot
+    // whose track is still null is left out.
+    //
+    auto marks = reportMarks;
+    uint32_t claimed = count;
+    uint32_t pending = 0;
+
+    count = 0;
+    for (uint32_t i = 0; i < claimed; i++)
+    {
+        auto track = __atomic_load_n(&sysBootProfile.marks[i].track, __ATOMIC_ACQUIRE);
+
+        if (track == nullptr)
+        {
+            pending++;
+            continue;
+        }
+
+        marks[count] = sysBootProfile.marks[i];
+        marks[count++].track = track;
+    }
+
+    if (count == 0)
+        return;
+
+    auto startTime = esp_timer_get_time();
+
+    for (uint8_t i = 0; i < 64; i++)
+        sysBootRecord(&scratchProfile, "", "", SYS_BOOT_MARK_TYPE::Phase);
+
+    auto costNs = (uint32_t)((esp_timer_get_time() - startTime) * 1000 / 64);
+
+    for (uint32_t i = 1; i < count; i++) // Insertion sort -- marks arrive almost in order
+    {
+        auto mark = marks[i];
+        int32_t j = i - 1;
+
+        while ((j >= 0) && (marks[j].us > mark.us))
+        {
+            marks[j + 1] = marks[j];
+            j--;
+        }
+        marks[j + 1] = mark;
+    }
+
+    ESP_LOGI(TAG, "Boot profile  %d marks  %d dropped  %d unfinished  mark cost %d ns", count, dropped, pending, costNs);
+    ESP_LOGI(TAG, "        at us   phase us  track       phase");
+
+    uint32_t end = count - 1;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int32_t next = -1;
+
+        for (uint32_t j = i + 1; j < count; j++)
+        {
+            if (isSameTrack(marks[j], marks[i]))
+            {
+                next = j;
+                break;
+            }
+        }
+
+        if (next >= 0)
+            ESP_LOGI(TAG, "  %10d %10d  %-10s  %s%s", marks[i].us, marks[next].us - marks[i].us, marks[i].track, marks[i].phase,
+                     (marks[i].type == SYS_BOOT_MARK_TYPE::Wait) ? " (wait)" : "");
+        else
+            ESP_LOGI(TAG, "  %10d %10s  %-10s  %s%s", marks[i].us, "-", marks[i].track, marks[i].phase,
+                     (marks[i].type == SYS_BOOT_MARK_TYPE::Wait) ? " (wait)" : "");
+
+        if ((strcmp(marks[i].track, endTrack) == 0) && (strcmp(marks[i].phase, endPhase) == 0))
+            end = i;
+    }
+
+    uint8_t path[SYS_BOOT_PROFILE_MARKS];
+    auto length = getCriticalPath(marks, count, end, path);
+
+    ESP_LOGI(TAG, "Critical path to %s %s: %d us", endTrack, endPhase, marks[end].us - marks[path[length - 1]].us);
+
+    for (int32_t i = length - 1; i > 0; i--)
+    {
+        auto &mark = marks[path[i]];
+        ESP_LOGI(TAG, "  %10d  %-10s  %s", marks[path[i - 1]].us - mark.us, mark.track, mark.phase);
+    }
+}
+
+#endif
@@ -0,0 +1,252 @@
+#include "system.hpp"
+
+//
+// Button Engine
+//
+// Every registered button runs its own debounce state machine inside the SYS::GPIO task:
+//
+//   Idle --edge--> PressSettling --quiet + active--> Pressed --long press--> Held (auto-repeat)
+//                                                        |                     |
+//                                                        +------edge-----------+--> ReleaseSettling --quiet + inactive--> Idle
+//
+// Edges only push a deadline out.  When a deadline comes due the pin level is sampled, so contact bounce of any length
+// collapses into a single transition.  The timer callback does nothing but wake SYS::GPIO, which keeps all button state
+// on one task and lets us run the state machine without any locking.
+//
+// Edges held in the ring during Init are delivered long after they happened, when the pin says nothing about them.  Each
+// transition is therefore timed from the deadline itself, never from when we got around to it.  A deadline that fell due
+// before the next edge was recorded is run ahead of that edge, and a replayed edge is judged on the level the ISR recorded
+// with it.  The pin is only sampled for live edges.
+//
+bool System::registerButton(gpio_num_t pin, SYS_ButtonCallback callback, void *ctx, bool activeLow)
+{
+    if (callback == nullptr)
+        return false;
+
+    if (isGPIOConfigDeferred()) // The button table belongs to SYS::GPIO
+    {
+        SYS_GPIOConfigRequest request = {};
+        request.type = SYS_GPIO_CONFIG::Button;
+        request.pin = (uint8_t)pin;
+        request.option = activeLow;
+        request.buttonCallback = callback;
+        request.ctx = ctx;
+        return queueGPIOConfigRequest(request);
+    }
+
+    return addButton(pin, callback, ctx, activeLow);
+}
+
+bool System::addButton(gpio_num_t pin, SYS_ButtonCallback callback, void *ctx, bool activeLow)
+{
+    SYS_Button *button = nullptr;
+
+    for (auto &entry : buttons)
+    {
+        if (!entry.inUse)
+        {
+            button = &entry;
+            break;
+        }
+    }
+
+    if (button == nullptr)
+    {
+        ESP_LOGE(TAG, "Error, No free buttons.  Raise SYS_GPIO_MAX_BUTTONS");
+        return false;
+    }
+
+    *button = {};
+    button->pin = (uint8_t)pin;
+    button->activeLow = activeLow;
+    button->state = SYS_BUTTON_STATE::Idle;
+    button->callback = callback;
+    button->ctx = ctx;
+    button->inUse = true;
+
+    if (addGPIOHandler(pin, &System::onButtonEdge, this, GPIO_INTR_ANYEDGE) == false) // We need both edges to time a press
+    {
+        button->inUse = false;
+        return false;
+    }
+    return true;
+}
+
+bool System::isButtonActive(SYS_Button *button, bool blnLive)
+{
+    int level = blnLive ? gpio_get_level((gpio_num_t)button->pin) : button->edgeLevel;
+    return button->activeLow ? (level == 0) : (level != 0);
+}
+
+void System::onButtonEdge(void *arg, const SYS_GPIOEvent &evt)
+{
+    auto obj = (System *)arg;
+
+    for (auto &button : obj->buttons)
+    {
+        if (!button.inUse || (button.pin != evt.pin))
+            continue;
+
+        while ((button.deadline != 0) && (button.deadline <= evt.timestamp)) // The line was quiet until this edge
+            obj->runButtonDeadline(&button, button.deadline, false);
+
+        switch (button.state)
+        {
+        case SYS_BUTTON_STATE::Idle:
+        {
+            button.state = SYS_BUTTON_STATE::PressSettling;
+            break;
+        }
+
+        case SYS_BUTTON_STATE::Pressed:
+        case SYS_BUTTON_STATE::Held:
+        {
+            button.blnWasHeld = (button.state == SYS_BUTTON_STATE::Held);
+            button.state = SYS_BUTTON_STATE::ReleaseSettling;
+            break;
+        }
+
+        case SYS_BUTTON_STATE::PressSettling:
+        case SYS_BUTTON_STATE::ReleaseSettling:
+            break; // Still bouncing -- just push the deadline out
+        }
+
+        button.deadline = evt.timestamp + SYS_BUTTON_DEBOUNCE_US;
+        button.edgeLevel = evt.level;
+        button.blnReplayed = (button.deadline <= esp_timer_get_time());
+        break;
+    }
+
+    obj->armButtonTimer();
+}
+
+void System::onButtonDeadline(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->runTaskHandleSystemGPIO != nullptr)
+        xTaskNotify(obj->runTaskHandleSystemGPIO, SYS_GPIO_NOTIFY_BUTTONS, eSetBits);
+}
+
+void System::serviceButtons(void)
+{
+    buttonTimerDeadline = INT64_MAX; // The pending job has fired
+    auto now = esp_timer_get_time();
+
+    for (auto &button : buttons)
+    {
+        if (!button.inUse)
+            continue;
+
+        while ((button.deadline != 0) && (button.deadline <= now + SYS_TIMER_TICK_US)) // Timer wheel resolution
+            runButtonDeadline(&button, button.deadline, !button.blnReplayed);
+    }
+
+    armButtonTimer();
+}
+
+//
+// "now" is the deadline being run -- the moment the line had been quiet long enough -- not the time we got to it.
+//
+void System::runButtonDeadline(SYS_Button *button, int64_t now, bool blnLive)
+{
+    button->deadline = 0;
+
+    switch (button->state)
+    {
+    case SYS_BUTTON_STATE::Idle:
+        break;
+
+    case SYS_BUTTON_STATE::PressSettling:
+    {
+        if (!isButtonActive(button, blnLive)) // Noise -- nothing happened
+        {
+            button->state = SYS_BUTTON_STATE::Idle;
+            break;
+        }
+
+        button->pressTime = now - SYS_BUTTON_DEBOUNCE_US;
+        button->state = SYS_BUTTON_STATE::Pressed;
+        button->deadline = button->pressTime + SYS_BUTTON_LONG_PRESS_US;
+
+        button->callback(button->ctx, button->pin, SYS_BUTTON_EVENT::Press, 0);
+
+        if ((button->clickCount == 1) && ((button->pressTime - button->lastReleaseTime) <= SYS_BUTTON_DOUBLE_CLICK_US))
+        {
+            button->clickCount = 0;
+            button->callback(button->ctx, button->pin, SYS_BUTTON_EVENT::DoubleClick, 0);
+        }
+        else
+            button->clickCount = 1;
+        break;
+    }
+
+    case SYS_BUTTON_STATE::Pressed:
+    {
+        button->state = SYS_BUTTON_STATE::Held;
+        button->clickCount = 0; // A long press never counts toward a double click
+        button->deadline = now + SYS_BUTTON_REPEAT_US;
+        button->callback(button->ctx, button->pin, SYS_BUTTON_EVENT::LongPress, (uint32_t)((now - button->pressTime) / 1000));
+        break;
+    }
+
+    case SYS_BUTTON_STATE::Held:
+    {
+        button->deadline = now + SYS_BUTTON_REPEAT_US;
+        button->callback(button->ctx, button->pin, SYS_BUTTON_EVENT::AutoRepeat, (uint32_t)((now - button->pressTime) / 1000));
+        break;
+    }
+
+    case SYS_BUTTON_STATE::ReleaseSettling:
+    {
+        if (isButtonActive(button, blnLive)) // A bounce while held -- carry on where we were
+        {
+            if (button->blnWasHeld)
+            {
+                button->state = SYS_BUTTON_STATE::Held;
+                button->deadline = now + SYS_BUTTON_REPEAT_US;
+            }
+            else
+            {
+                button->state = SYS_BUTTON_STATE::Pressed;
+                button->deadline = button->pressTime + SYS_BUTTON_LONG_PRESS_US;
+
+                if (button->deadline <= now) // The long press time passed while we were settling
+                    button->deadline = now + 1;
+            }
+            break;
+        }
+
+        button->state = SYS_BUTTON_STATE::Idle;
+        button->lastReleaseTime = now - SYS_BUTTON_DEBOUNCE_US;
+        button->callback(button->ctx, button->pin, SYS_BUTTON_EVENT::Release, (uint32_t)((button->lastReleaseTime - button->pressTime) / 1000));
+        break;
+    }
+    }
+}
+
+//
+// Only ever adds a timer job when a button needs an earlier wakeup than the one already pending.  We never cancel a job by ID
+// here because it may have fired and been handed to someone else.  A stale job costs one harmless wakeup.
+//
+void System::armButtonTimer(void)
+{
+    int64_t earliest = INT64_MAX;
+
+    for (auto &button : buttons)
+    {
+        if (button.inUse && (button.deadline != 0) && (button.deadline < earliest))
+            earliest = button.deadline;
+    }
+
+    if ((earliest == INT64_MAX) || (earliest >= buttonTimerDeadline))
+        return;
+
+    int64_t delay = earliest - esp_timer_get_time();
+
+    if (delay < 0)
+        delay = 0;
+
+    if (scheduleOnce((uint64_t)delay, &System::onButtonDeadline, this))
+        buttonTimerDeadline = earliest;
+}
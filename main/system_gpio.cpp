@@ -1,25 +1,28 @@
 #include "system.hpp"
 
-extern xSemaphoreHandle semSYSEntry;
+#include "system_gpio_ring.hpp"
+#include "system_pulse.hpp"
+
+#include "hal/gpio_ll.h"
+#include "soc/gpio_struct.h"
+
 //
 // We generally handle GPIO interrupts here.  The idea is to route them to the handler which is
 // designed for that service.
 //
-// Right now, we have a tactile switch.  We can use this switch for debugging.  Notice that we debounce the
-// switch in software.   We handle switch input by the book -- first catching the ISR and then routing that
-// to a queue.
+// Every pin is registered in a table with the handler that services it.  The ISR does nothing but stamp the edge
+// with esp_timer time and the pin level and push it into a lock-free ring.  The SYS::GPIO task drains the ring in
+// batches and calls the handler for each pin.
+//
+// Right now, we have a tactile switch.  We can use this switch for debugging.  Switches are registered as buttons
+// and debounced in software by the button engine (system_button.cpp).
 //
 #define ESP_INTR_FLAG_DEFAULT 0
 
-#define SWITCH_1 GPIO_NUM_0 // Boot Switch -- GPIO_EN.  This a strapping pin is pulled-up by default
-
 //
 // NOTE: Pins GPIO_NUM_19 / GPIO_NUM_20 are reservied for JTAG
 //
 bool gpio_isr_service_started = false; // We would receive an error if we tried to start this service a second time.
-bool blnallowSwitchGPIOinput = true;   // These variables are used for switch input debouncing
-QueueHandle_t xQueueGPIOEvents = nullptr;
-uint8_t SwitchDebounceCounter = 0;
 
 extern bool blnSwitch1; // Switch variables needed for
 
@@ -41,49 +44,189 @@ void System::initGPIOPins(void)
 }
 
 //
-// This ISR is set apart because tactile switch input needs to be handled with a debouncing algorithm.
+// Normal GPIO ISR handling.  Keep this short -- everything else is deferred to the SYS::GPIO task.
 //
-void IRAM_ATTR GPIOSwitchIsrHandler(void *arg)
+void IRAM_ATTR GPIOIsrHandler(void *arg)
+{
+    auto pin = (uint32_t)(uintptr_t)arg;
+    pushGPIOEvent((uint8_t)pin, (uint8_t)gpio_ll_get_level(&GPIO, (gpio_num_t)pin));
+}
+
+void System::initGPIOTask(void)
 {
-    if (blnallowSwitchGPIOinput)
+    // ESP_LOGI(TAG, "InitGPIOTask");
+    if (!gpio_isr_service_started)
     {
-        xQueueSendToBackFromISR(xQueueGPIOEvents, &arg, NULL);
-        SwitchDebounceCounter = 50; // Reject all input for 1/2 of a second -- counter is running in system_timer
-        blnallowSwitchGPIOinput = false;
+        if (gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Started gpio isr service...");
+            gpio_isr_service_started = true;
+        }
+    }
+
+    gpioConfigQue = xQueueCreate(SYS_GPIO_CONFIG_QUEUE_SIZE, sizeof(SYS_GPIOConfigRequest));
+
+    if (gpio_isr_service_started && (gpioConfigQue != nullptr)) // Without the ISR service there is nothing for the task to route
+    {
+        registerButton(SWITCH_1, &System::onSwitch1Button, this); // Applied directly -- the task does not exist yet
+
+        xTaskCreate(runGPIOTaskMarshaller, "SYS::GPIO", 1024 * 3, this, 7, &runTaskHandleSystemGPIO); // (1) Low number indicates low priority task
+        gpioEventTask = runTaskHandleSystemGPIO;
     }
 }
 
 //
-// Normal (non-switch) GPIO ISR handling would warrant no delay.
+// Routes all edges on a pin to a handler.  Handlers run in the SYS::GPIO task, one event at a time, in the order the edges occured.
+// Calls from other tasks are queued and applied by SYS::GPIO, so a true return means the request was accepted.
 //
-void IRAM_ATTR GPIOIsrHandler(void *arg)
+bool System::registerGPIOHandler(gpio_num_t pin, SYS_GPIOCallback callback, void *ctx, gpio_int_type_t intrType)
 {
-    xQueueSendToBackFromISR(xQueueGPIOEvents, &arg, NULL);
+    if ((callback == nullptr) || !gpio_isr_service_started)
+        return false;
+
+    if (isGPIOConfigDeferred())
+    {
+        SYS_GPIOConfigRequest request = {};
+        request.type = SYS_GPIO_CONFIG::Handler;
+        request.pin = (uint8_t)pin;
+        request.option = (uint8_t)intrType;
+        request.gpioCallback = callback;
+        request.ctx = ctx;
+        return queueGPIOConfigRequest(request);
+    }
+
+    return addGPIOHandler(pin, callback, ctx, intrType);
 }
 
-void System::initGPIOTask(void)
+bool System::isGPIOConfigDeferred(void)
 {
-    // ESP_LOGI(TAG, "InitGPIOTask");
-    xQueueGPIOEvents = xQueueCreate(1, sizeof(uint32_t)); // Create a queue to handle gpio events from isr
+    return (runTaskHandleSystemGPIO != nullptr) && (xTaskGetCurrentTaskHandle() != runTaskHandleSystemGPIO);
+}
+
+bool System::queueGPIOConfigRequest(const SYS_GPIOConfigRequest &request)
+{
+    if (xQueueSendToBack(gpioConfigQue, &request, pdMS_TO_TICKS(100)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Error, GPIO config queue is full");
+        return false;
+    }
+
+    xTaskNotify(runTaskHandleSystemGPIO, SYS_GPIO_NOTIFY_CONFIG, eSetBits);
+    return true;
+}
+
+void System::applyGPIOConfigRequests(void)
+{
+    SYS_GPIOConfigRequest request;
+
+    while (xQueueReceive(gpioConfigQue, &request, 0) == pdTRUE)
+    {
+        bool blnResult = false;
 
-    if (xQueueGPIOEvents != NULL) // if QueueCreate fails to find memory, don't start ISR handlers
+        if (request.type == SYS_GPIO_CONFIG::Handler)
+            blnResult = addGPIOHandler((gpio_num_t)request.pin, request.gpioCallback, request.ctx, (gpio_int_type_t)request.option);
+        else if (request.type == SYS_GPIO_CONFIG::Button)
+            blnResult = addButton((gpio_num_t)request.pin, request.buttonCallback, request.ctx, request.option != 0);
+        else
+            blnResult = addPulseCounter((gpio_num_t)request.pin, request.windowMs, request.pulseCallback, request.ctx,
+                                        (gpio_int_type_t)request.option);
+
+        if (!blnResult)
+            ESP_LOGE(TAG, "Error, Unable to apply GPIO config for pin %d", request.pin);
+    }
+}
+
+void System::requestGPIOShutdown(void)
+{
+    if (runTaskHandleSystemGPIO != nullptr)
+        xTaskNotify(runTaskHandleSystemGPIO, SYS_GPIO_NOTIFY_SHUTDOWN, eSetBits);
+}
+
+//
+// gpio_isr_handler_add() quietly replaces whatever ISR a pin already had, so a pin may only be claimed once -- by a handler
+// (buttons included) or by a pulse counter.  Only called from SYS::GPIO, or before that task exists.
+//
+bool System::isGPIOPinClaimed(gpio_num_t pin)
+{
+    for (auto &handler : gpioHandlers)
+    {
+        if (handler.inUse && (handler.pin == (uint8_t)pin))
+            return true;
+    }
+
+    bool blnCounted = false;
+
+    portENTER_CRITICAL(&pulseCounterMux);
+    for (auto &counter : pulseCounters)
     {
-        if (!gpio_isr_service_started)
+        if (counter.inUse && (counter.pin == (uint8_t)pin))
         {
-            if (gpio_install_isr_service(ESP_INTR_FLAG_DEFAULT) == ESP_OK)
-            {
-                ESP_LOGI(TAG, "Started gpio isr service...");
-                gpio_isr_service_started = true;
-            }
+            blnCounted = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pulseCounterMux);
+    return blnCounted;
+}
+
+bool System::addGPIOHandler(gpio_num_t pin, SYS_GPIOCallback callback, void *ctx, gpio_int_type_t intrType)
+{
+    if (isGPIOPinClaimed(pin))
+    {
+        ESP_LOGE(TAG, "Error, Pin %d already has a GPIO handler or pulse counter", pin);
+        return false;
+    }
+
+    SYS_GPIOHandler *handler = nullptr;
+
+    for (uint8_t index = 0; index < SYS_GPIO_MAX_HANDLERS; index++)
+    {
+        if (!gpioHandlers[index].inUse)
+        {
+            handler = &gpioHandlers[index];
+            break;
         }
+    }
 
-        gpio_isr_handler_add(SWITCH_1, GPIOSwitchIsrHandler, (void *)SWITCH_1);
+    if (handler == nullptr)
+    {
+        ESP_LOGE(TAG, "Error, No free GPIO handlers.  Raise SYS_GPIO_MAX_HANDLERS");
+        return false;
+    }
 
-        SwitchDebounceCounter = 30;
-        blnallowSwitchGPIOinput = true;
+    handler->pin = (uint8_t)pin;
+    handler->callback = callback;
+    handler->ctx = ctx;
+    handler->inUse = true;
 
-        xTaskCreate(runGPIOTaskMarshaller, "SYS::GPIO", 1024 * 3, this, 7, &runTaskHandleSystemGPIO); // (1) Low number indicates low priority task
+    gpio_set_intr_type(pin, intrType);
+
+    if (gpio_isr_handler_add(pin, GPIOIsrHandler, (void *)pin) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error, Unable to add ISR handler for GPIO %d", pin);
+        handler->inUse = false;
+        return false;
     }
+    return true;
+}
+
+void System::getGPIOStats(SYS_GPIOStats *stats)
+{
+    *stats = gpioStats;
+    stats->drops = getGPIORingDrops();
+
+    if (stats->events > 0)
+        stats->latencyAvgUs = (uint32_t)(gpioLatencyTotal / stats->events);
+}
+
+void System::logGPIOStats(void)
+{
+    SYS_GPIOStats stats;
+    getGPIOStats(&stats);
+
+    ESP_LOGI(TAG, "GPIO events %d  drops %d  batches %d  max batch %d  latency avg %d us  max %d us", stats.events, stats.drops,
+             stats.batches, stats.maxBatch, stats.latencyAvgUs, stats.latencyMaxUs);
+    ESP_LOGI(TAG, "GPIO wakeups %d  idle wakeups %d", stats.wakeups, stats.idleWakeups); // Idle was 20/sec when we polled every 50 ms
 }
 
 void System::runGPIOTaskMarshaller(void *arg) // This function can be resolved at run time by the compiler.
@@ -91,96 +234,183 @@ void System::runGPIOTaskMarshaller(void *arg) // This function can be resolved a
     auto obj = (System *)arg;
     obj->runGPIOTask();
 
-    if (obj->runTaskHandleSystemGPIO != nullptr)
-        vTaskDelete(NULL);
+    if (obj->runTaskHandleSystemGPIO == nullptr)
+        return;
+
+    auto temp = obj->runTaskHandleSystemGPIO;
+    obj->runTaskHandleSystemGPIO = nullptr;
+    vTaskDelete(temp);
 }
 
+//
+// The task sleeps until something needs it.  ISR events, button deadlines, registrations, the move to SYS_OP::Run and shutdown
+// requests all arrive as notification bits, so an idle device never wakes this task.
+//
 void System::runGPIOTask(void)
 {
-    uint32_t io_num;
+    uint32_t notifyBits = 0;
 
     while (true)
     {
-        if (xQueueReceive(xQueueGPIOEvents, &io_num, pdMS_TO_TICKS(50)))
+        xTaskNotifyWait(0, UINT32_MAX, &notifyBits, portMAX_DELAY);
+        gpioStats.wakeups++;
+
+        if (notifyBits & SYS_GPIO_NOTIFY_SHUTDOWN)
+            break;
+
+        if (notifyBits & SYS_GPIO_NOTIFY_CONFIG)
+            applyGPIOConfigRequests();
+
+        auto delivered = drainGPIOEvents();
+
+        if (notifyBits & SYS_GPIO_NOTIFY_BUTTONS)
+            serviceButtons();
+
+        if ((delivered == 0) && !(notifyBits & (SYS_GPIO_NOTIFY_BUTTONS | SYS_GPIO_NOTIFY_CONFIG | SYS_GPIO_NOTIFY_RUN)))
+            gpioStats.idleWakeups++;
+    }
+
+    gpioEventTask = nullptr; // Stop the ISR from notifying us
+
+    for (auto &handler : gpioHandlers)
+    {
+        if (handler.inUse)
         {
-            // ESP_LOGI(TAG, "xQueueGPIOEvents   io_num  %d", io_num);
-            //  ESP_LOGI(TAG, "xQueueGPIOEvents ...SysOp = %x", (uint8_t)SysOp);
-            if (SysOp == SYS_OP::Init) // If we haven't finished out our initialization -- discard items in our queue.
-                continue;
+            gpio_isr_handler_remove((gpio_num_t)handler.pin);
+            handler.inUse = false;
+        }
+    }
 
-            switch (io_num)
-            {
-            case SWITCH_1:
-            {
-                ESP_LOGI(TAG, "SWITCH_1 triggered ...");
+    for (auto &counter : pulseCounters)
+    {
+        if (counter.inUse)
+        {
+            gpio_isr_handler_remove((gpio_num_t)counter.pin);
+            cancelTimerJob(counter.jobID); // Its window job would go on publishing a count nothing feeds
+            counter.inUse = false;
+        }
+    }
+    ESP_LOGI(TAG, "GPIO task shut down");
+}
 
-                // ESP_ERROR_CHECK(nvs_flash_erase());
-                // ESP_LOGI(TAG, "NVS Erased...");
+//
+// Events are copied out of the ring a batch at a time and the slots are handed back before any handler runs, so a slow
+// handler never holds up the ISR.  During SYS_OP::Init the ring itself is the holding buffer -- events stay in it (up to
+// SYS_GPIO_RING_SIZE of them) and are delivered in order once we reach SYS_OP::Run.
+//
+uint32_t System::drainGPIOEvents(void)
+{
+    SYS_GPIOEvent batch[SYS_GPIO_BATCH_SIZE];
+    uint32_t delivered = 0;
 
-                if (xSemaphoreTake(semSYSEntry, portMAX_DELAY) == pdTRUE)
-                {
-                    if (openNVStorage("indication", true) == false)
-                    {
-                        ESP_LOGE(TAG, "Error, Unable to OpenNVStorage inside restoreVariblesFromNVS");
-                        xSemaphoreGive(semSYSEntry);
-                        break;
-                    }
-                }
+    if (SysOp == SYS_OP::Init)
+        return 0;
 
-                uint8_t aValue = 0;
-                uint8_t bValue = 0;
-                uint8_t cValue = 0;
+    while (true)
+    {
+        auto available = takeGPIOEvents(batch, SYS_GPIO_BATCH_SIZE);
 
-                if (TempFlag == 1)
-                {
-                    TempFlag++;
-                    aValue = 255;
-                    bValue = 255;
-                    cValue = 255;
-                }
-                else if (TempFlag == 2)
-                {
-                    TempFlag++;
-                    aValue = 1;
-                    bValue = 1;
-                    cValue = 1;
-                }
-                else if (TempFlag == 3)
-                {
-                    aValue = 5;
-                    bValue = 10;
-                    cValue = 50;
-                    TempFlag = 1;
-                }
-                else
-                    TempFlag = 1;
+        if (available == 0)
+            break;
 
-                if (saveU8IntegerToNVS("aDefValue", aValue) == false)
-                    ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS aDefValue");
-                else
-                    ESP_LOGW(TAG, "aDefValue is now %d", aValue);
+        gpioStats.batches++;
+        if (available > gpioStats.maxBatch)
+            gpioStats.maxBatch = available;
 
-                if (saveU8IntegerToNVS("bDefValue", bValue) == false)
-                    ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS bDefValue");
-                else
-                    ESP_LOGW(TAG, "bDefValue is now %d", bValue);
+        for (uint32_t index = 0; index < available; index++)
+        {
+            auto &evt = batch[index];
+            bool blnHandled = false;
 
-                if (saveU8IntegerToNVS("cDefValue", cValue) == false)
-                    ESP_LOGE(TAG, "Error, Unable to saveU8IntegerToNVS cDefValue");
-                else
-                    ESP_LOGW(TAG, "cDefValue is now %d", cValue);
+            for (auto &handler : gpioHandlers)
+            {
+                if (handler.inUse && (handler.pin == evt.pin))
+                {
+                    auto latency = (uint32_t)(esp_timer_get_time() - evt.timestamp);
+                    gpioStats.events++;
+                    gpioLatencyTotal += latency;
 
-                closeNVStorage(true); // Commit changes
-                xSemaphoreGive(semSYSEntry);
+                    if (latency > gpioStats.latencyMaxUs)
+                        gpioStats.latencyMaxUs = latency;
 
-                // blnSwitch1 = true;
-                break;
+                    handler.callback(handler.ctx, evt);
+                    blnHandled = true;
+                    delivered++;
+                    break;
+                }
             }
 
-            default:
-                ESP_LOGI(TAG, "Missing Case for io_num  %d...(runGPIOTask)", io_num);
-                break;
-            }
+            if (!blnHandled)
+                ESP_LOGI(TAG, "Missing handler for io_num  %d...(runGPIOTask)", evt.pin);
         }
     }
+    return delivered;
+}
+
+//
+// Switch Handling
+//
+void System::onSwitch1Button(void *arg, uint8_t pin, SYS_BUTTON_EVENT event, uint32_t heldMs)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showButtonEvents)
+        ESP_LOGI(obj->TAG, "SWITCH_1 event %d held %d ms", (int)event, heldMs);
+
+    if (event == SYS_BUTTON_EVENT::Press)
+        obj->handleSwitch1Press();
+}
+
+void System::handleSwitch1Press(void)
+{
+    ESP_LOGI(TAG, "SWITCH_1 triggered ...");
+
+    //
+    // SYS::GPIO is released as soon as we enter Run, which only waits for NVS and the Timer.  Until its init node is ready
+    // Indication is still restoring and applying these same defaults on its own task, so the press is dropped.
+    //
+    if (!(xEventGroupGetBits(initEventGroup) & SYS_INIT_BIT(SYS_INIT_NODE::Indication)) || (ind == nullptr))
+    {
+        ESP_LOGW(TAG, "SWITCH_1 ignored -- Indication is not ready yet");
+        return;
+    }
+
+    // ESP_ERROR_CHECK(nvs_flash_erase());
+    // ESP_LOGI(TAG, "NVS Erased...");
+
+    uint8_t aValue = 0;
+    uint8_t bValue = 0;
+    uint8_t cValue = 0;
+
+    if (TempFlag == 1)
+    {
+        TempFlag++;
+        aValue = 255;
+        bValue = 255;
+        cValue = 255;
+    }
+    else if (TempFlag == 2)
+    {
+        TempFlag++;
+        aValue = 1;
+        bValue = 1;
+        cValue = 1;
+    }
+    else if (TempFlag == 3)
+    {
+        aValue = 5;
+        bValue = 10;
+        cValue = 50;
+        TempFlag = 1;
+    }
+    else
+        TempFlag = 1;
+
+    //
+    // The default values belong to Indication, which keeps all of its settings in one blob.  Let it store them.
+    //
+    if (!ind->setDefaultValues(aValue, bValue, cValue))
+        ESP_LOGE(TAG, "Error, Unable to save default values to NVS");
+    else
+        ESP_LOGW(TAG, "Default values are now %d %d %d", aValue, bValue, cValue);
 }
@@ -0,0 +1,66 @@
+#include "system_gpio_ring.hpp"
+
+#include <atomic>
+
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+//
+// GPIO Event Ring
+//
+// The GPIO ISR service dispatches every pin's handler from one interrupt on one core, so the ring has exactly one
+// producer (the ISR) and one consumer (SYS::GPIO).  Head and tail are free-running counters.
+//
+static SYS_GPIOEvent gpioEventRing[SYS_GPIO_RING_SIZE];
+static std::atomic<uint32_t> gpioRingHead(0); // Written only by the ISR
+static std::atomic<uint32_t> gpioRingTail(0); // Written only by SYS::GPIO
+static volatile uint32_t gpioRingDrops = 0;
+xTaskHandle gpioEventTask = nullptr;
+
+bool IRAM_ATTR pushGPIOEvent(uint8_t pin, uint8_t level)
+{
+    auto head = gpioRingHead.load(std::memory_order_relaxed);
+
+    if ((head - gpioRingTail.load(std::memory_order_acquire)) >= SYS_GPIO_RING_SIZE)
+    {
+        gpioRingDrops = gpioRingDrops + 1; // Ring is full.  Count it and let the task catch up.
+        return false;
+    }
+
+    auto &evt = gpioEventRing[head & (SYS_GPIO_RING_SIZE - 1)];
+    evt.timestamp = esp_timer_get_time();
+    evt.pin = pin;
+    evt.level = level;
+    gpioRingHead.store(head + 1, std::memory_order_release); // Publish the event
+
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    if (gpioEventTask != nullptr)
+        xTaskNotifyFromISR(gpioEventTask, SYS_GPIO_NOTIFY_EVENTS, eSetBits, &xHigherPriorityTaskWoken);
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+    return true;
+}
+
+//
+// The slots are handed back before the caller looks at the events, so a slow handler never holds up the ISR.
+//
+uint32_t takeGPIOEvents(SYS_GPIOEvent *batch, uint32_t count)
+{
+    auto tail = gpioRingTail.load(std::memory_order_relaxed);
+    auto available = gpioRingHead.load(std::memory_order_acquire) - tail;
+
+    if (available > count)
+        available = count;
+
+    for (uint32_t index = 0; index < available; index++)
+        batch[index] = gpioEventRing[(tail + index) & (SYS_GPIO_RING_SIZE - 1)];
+
+    gpioRingTail.store(tail + available, std::memory_order_release);
+    return available;
+}
+
+uint32_t getGPIORingDrops(void)
+{
+    return gpioRingDrops;
+}
@@ -0,0 +1,206 @@
+#include "system.hpp"
+
+//
+// Init Graph
+//
+// The nodes and their dependencies are declared in initNodes (system.hpp).  SYS::Run launches every node without
+// dependencies and then only waits for SYS_INIT_RUN_DEPS.  Each node runs on its own task, pinned to its core, and when it is
+// ready it sets its bit and launches whatever was waiting on it -- so the graph keeps moving after we have entered Run.
+//
+void System::launchInitNodes(void)
+{
+    if (xSemaphoreTake(initMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    auto ready = xEventGroupGetBits(initEventGroup);
+
+    for (auto &node : initNodes)
+    {
+        if (node.blnStarted || ((ready & node.deps) != node.deps))
+            continue;
+
+        node.blnStarted = true;
+        node.owner = this;
+        node.startUs = esp_timer_get_time();
+        SYS_BOOT_MARK(node.name, "Launched");
+
+        if (xTaskCreatePinnedToCore(runInitNodeMarshaller, node.name, node.stack, &node, 5, nullptr, node.core) != pdPASS)
+        {
+            ESP_LOGE(TAG, "Error, unable to start init node %s", node.name);
+            node.blnStarted = false; // Tried again when the next node is ready.  The wait in run() reports it as pending.
+        }
+    }
+
+    xSemaphoreGive(initMutex);
+}
+
+void System::runInitNodeMarshaller(void *arg)
+{
+    auto node = (SYS_InitNode *)arg;
+    auto obj = node->owner;
+    auto index = (SYS_INIT_NODE)(node - obj->initNodes);
+
+    SYS_BOOT_MARK(node->name, "Start");
+    obj->runInitNode(index);
+
+    SYS_BOOT_SIGNAL(node->name, "Ready");
+    node->readyUs = esp_timer_get_time();
+    xEventGroupSetBits(obj->initEventGroup, SYS_INIT_BIT(index));
+
+    obj->launchInitNodes(); // Start whatever was waiting on us
+    obj->checkInitTimeline();
+    vTaskDelete(nullptr);
+}
+
+void System::runInitNode(SYS_INIT_NODE node)
+{
+    switch (node)
+    {
+    case SYS_INIT_NODE::NVS:
+    {
+        initNVS();
+        break;
+    }
+
+    case SYS_INIT_NODE::Indication:
+    {
+        initIndication();
+        break;
+    }
+
+    case SYS_INIT_NODE::Timer:
+    {
+        initGenTimer(); // Starting General Task and Timer
+        break;
+    }
+
+    case SYS_INIT_NODE::Count:
+        break;
+    }
+}
+
+//
+// Indication runs its own init on IND::Run and gives semIndEntry back once the blink and the restore are done.  We wait for
+// that here, on the node task, so nothing else has to.
+//
+void System::initIndication(void)
+{
+    if (ind == nullptr)
+        ind = new Indication(this, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_REVISION);
+
+    if ((ind == nullptr) || (semIndEntry == nullptr))
+    {
+        ESP_LOGE(TAG, "Error, unable to create Indication");
+        return;
+    }
+
+    SYS_BOOT_WAIT("Indication", "semIndEntry");
+
+    if (xSemaphoreTake(semIndEntry, portMAX_DELAY) == pdTRUE)
+    {
+        indColorCmdRequestQue = ind->getColorCmdRequestQueue();
+        xSemaphoreGive(semIndEntry);
+    }
+}
+
+//
+// The timeline is shown once every node is ready and we are in Run, whichever of those happens last.
+//
+void System::checkInitTimeline(void)
+{
+    bool blnShow = false;
+
+    if (xSemaphoreTake(initMutex, portMAX_DELAY) == pdTRUE)
+    {
+        auto ready = xEventGroupGetBits(initEventGroup);
+
+        if (!blnInitTimelineShown && (initRunUs != 0) && ((ready & SYS_INIT_ALL_BITS) == SYS_INIT_ALL_BITS))
+        {
+            blnInitTimelineShown = true;
+            blnShow = true;
+        }
+        xSemaphoreGive(initMutex);
+    }
+
+    if (blnShow && showInit)
+        showInitTimeline();
+
+    if (blnShow)
+        SYS_BOOT_REPORT("SYS", "Run");
+}
+
+void System::showInitTimeline(void)
+{
+    char path[64];
+    uint8_t last = 0;
+    uint8_t runGate = 0xFF;
+
+    ESP_LOGI(TAG, "Boot timeline (us since boot)");
+
+    for (uint8_t i = 0; i < (uint8_t)SYS_INIT_NODE::Count; i++)
+    {
+        auto &node = initNodes[i];
+
+        ESP_LOGI(TAG, "  %-10s core %d  start %8lld  ready %8lld  took %8lld", node.name, node.core, node.startUs, node.readyUs,
+                 node.readyUs - node.startUs);
+
+        if (node.readyUs > initNodes[last].readyUs)
+            last = i;
+
+        if ((SYS_INIT_RUN_DEPS & SYS_INIT_BIT(i)) && ((runGate == 0xFF) || (node.readyUs > initNodes[runGate].readyUs)))
+            runGate = i;
+    }
+
+    getInitPath((SYS_INIT_NODE)runGate, path, sizeof(path));
+    ESP_LOGI(TAG, "  Run at %lld us  via %s", initRunUs, path);
+
+    getInitPath((SYS_INIT_NODE)last, path, sizeof(path));
+    ESP_LOGI(TAG, "  All ready at %lld us  critical path %s", initNodes[last].readyUs, path);
+
+    SYS_NVSPreloadStats preload;
+    SYS_NVSCacheStats cache;
+    getNVSPreloadStats(&preload);
+    getNVSCacheStats(&cache);
+
+    // All measured.  Reads that found their key in the preload, or found it missing from a preloaded namespace, never
+    // touched flash -- the misses that did are what init paid.  Shown here so Indication's restore is counted.
+    ESP_LOGI(TAG, "NVS preload %d keys in %d us (%d bytes)  init reads %d hits %d missing  %d from flash in %d us", preload.keys,
+             preload.preloadUs, preload.bytes, preload.hits, preload.absentHits, cache.flashReads, cache.flashReadUs);
+}
+
+//
+// Walks back from a node through whichever dependency was ready last -- the one it actually waited for.
+//
+void System::getInitPath(SYS_INIT_NODE last, char *text, size_t size)
+{
+    uint8_t chain[(uint8_t)SYS_INIT_NODE::Count];
+    uint8_t count = 0;
+    auto index = (uint8_t)last;
+
+    while (count < (uint8_t)SYS_INIT_NODE::Count)
+    {
+        chain[count++] = index;
+
+        auto deps = initNodes[index].deps;
+
+        if (deps == 0)
+            break;
+
+        int64_t latest = -1;
+
+        for (uint8_t i = 0; i < (uint8_t)SYS_INIT_NODE::Count; i++)
+        {
+            if ((deps & SYS_INIT_BIT(i)) && (initNodes[i].readyUs > latest))
+            {
+                latest = initNodes[i].readyUs;
+                index = i;
+            }
+        }
+    }
+
+    size_t used = 0;
+    text[0] = 0;
+
+    for (int8_t i = count - 1; (i >= 0) && (used < size); i--)
+        used += snprintf(text + used, size - used, "%s%s", initNodes[chain[i]].name, (i > 0) ? " -> " : "");
+}
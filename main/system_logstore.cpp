@@ -0,0 +1,665 @@
+#include "system_logstore.hpp"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+
+//
+// Log Store
+//
+// The layout is described with SYS_LogSectorHeader in system_defs.hpp.  All flash work except the background erase is done
+// with the mutex held.  Hot values are a few bytes, so a set is one small program operation.
+//
+static uint16_t recordSize(size_t keyLength, size_t valueLength)
+{
+    return (uint16_t)((sizeof(SYS_LogRecordHeader) + keyLength + valueLength + 3) & ~3);
+}
+
+//
+// Rebuilds the index by replaying every sector in sequence order -- the newest record of a key wins and a tombstone
+// removes it.  Headers that fail their CRC belong to an erase or activation that was cut short, so those sectors are erased
+// again before use.
+//
+bool LogStore::mount(void)
+{
+    if (partition != nullptr)
+        return true;
+
+    auto part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)SYS_LOG_PARTITION_SUBTYPE, SYS_LOG_PARTITION_LABEL);
+
+    if (part == nullptr)
+        return false;
+
+    auto count = part->size / SYS_LOG_SECTOR_SIZE;
+
+    if (count > SYS_LOG_MAX_SECTORS)
+        count = SYS_LOG_MAX_SECTORS;
+
+    if (count < 3) // Active, one being compacted into and one to erase
+    {
+        ESP_LOGE(TAG, "Error, partition %s is too small", SYS_LOG_PARTITION_LABEL);
+        return false;
+    }
+
+    if (mutex == nullptr)
+        mutex = xSemaphoreCreateMutex();
+
+    //
+    // Callers only check partition before taking the mutex, so we hold it for the whole scan.  Anyone who sees the partition
+    // early waits here until the index is complete.
+    //
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    partition = part;
+    sectorCount = (uint8_t)count;
+
+    uint8_t order[SYS_LOG_MAX_SECTORS] = {};
+    uint8_t used = 0;
+    uint32_t eraseMax = 0;
+    bool blnCountLost[SYS_LOG_MAX_SECTORS] = {};
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        SYS_LogSectorHeader header = {};
+
+        sectors[s] = {};
+        sectors[s].state = SYS_LOG_SECTOR::Dirty;
+
+        if (esp_partition_read(partition, s * SYS_LOG_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+            continue;
+
+        if ((header.magic != SYS_LOG_SECTOR_MAGIC) || (header.eraseCRC != esp_rom_crc32_le(0, (const uint8_t *)&header, 8)))
+        {
+            blnCountLost[s] = true; // Blank, or the erase was cut short
+            continue;
+        }
+
+        sectors[s].eraseCount = header.eraseCount;
+
+        if (header.eraseCount > eraseMax)
+            eraseMax = header.eraseCount;
+
+        if ((header.sequence == 0xFFFFFFFF) && (header.sequenceCRC == 0xFFFFFFFF))
+        {
+            sectors[s].state = SYS_LOG_SECTOR::Erased;
+            continue;
+        }
+
+        if (header.sequenceCRC != esp_rom_crc32_le(0, (const uint8_t *)&header.sequence, sizeof(header.sequence)))
+            continue; // Activation was cut short -- no record can follow it
+
+        sectors[s].state = SYS_LOG_SECTOR::Full;
+        sectors[s].sequence = header.sequence;
+
+        uint8_t pos = used++; // Insertion sort -- there are only a handful of sectors
+        while ((pos > 0) && (sectors[order[pos - 1]].sequence > header.sequence))
+        {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = s;
+    }
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        if (blnCountLost[s])
+            sectors[s].eraseCount = eraseMax; // Assume the worst, so it is not picked ahead of sectors we know are fresher
+    }
+
+    for (uint8_t i = 0; i < used; i++)
+        scanSector(order[i]);
+
+    if (used > 0)
+    {
+        auto last = order[used - 1];
+        nextSequence = sectors[last].sequence + 1;
+
+        if (sectors[last].writeOffset + recordSize(1, 0) <= SYS_LOG_SECTOR_SIZE)
+        {
+            sectors[last].state = SYS_LOG_SECTOR::Active;
+            head = last;
+        }
+    }
+
+    xSemaphoreGive(mutex);
+    return true;
+}
+
+bool LogStore::scanSector(uint8_t sector)
+{
+    uint8_t buffer[SYS_LOG_MAX_KEY + SYS_LOG_MAX_VALUE];
+    uint16_t offset = sizeof(SYS_LogSectorHeader);
+
+    while (offset + sizeof(SYS_LogRecordHeader) <= SYS_LOG_SECTOR_SIZE)
+    {
+        SYS_LogRecordHeader record = {};
+        auto address = sector * SYS_LOG_SECTOR_SIZE + offset;
+        bool blnValid = (esp_partition_read(partition, address, &record, sizeof(record)) == ESP_OK);
+
+        if (blnValid)
+        {
+            auto bytes = (const uint8_t *)&record;
+            bool blnBlank = true;
+
+            for (size_t i = 0; i < sizeof(record); i++)
+                blnBlank &= (bytes[i] == 0xFF);
+
+            if (blnBlank)
+                break; // End of the log in this sector
+        }
+
+        auto size = recordSize(record.keyLength, record.valueLength);
+
+        blnValid = blnValid && (record.magic == SYS_LOG_RECORD_MAGIC) && (record.keyLength > 0) && (record.keyLength <= SYS_LOG_MAX_KEY) &&
+                   (record.valueLength <= SYS_LOG_MAX_VALUE) && (offset + size <= SYS_LOG_SECTOR_SIZE);
+
+        if (blnValid)
+            blnValid = (esp_partition_read(partition, address + sizeof(record), buffer, record.keyLength + record.valueLength) == ESP_OK);
+
+        if (blnValid)
+        {
+            auto crc = esp_rom_crc32_le(0, (const uint8_t *)&record, 8);
+            blnValid = (esp_rom_crc32_le(crc, buffer, record.keyLength + record.valueLength) == record.crc);
+        }
+
+        if (!blnValid) // Torn by a power cut.  Nothing after it can be trusted and the sector takes no more writes.
+        {
+            stats.tornRecords++;
+            ESP_LOGW(TAG, "Torn record in sector %d at 0x%04X -- sector sealed", sector, offset);
+            sectors[sector].writeOffset = SYS_LOG_SECTOR_SIZE;
+            return false;
+        }
+
+        char key[SYS_LOG_MAX_KEY + 1];
+        memcpy(key, buffer, record.keyLength);
+        key[record.keyLength] = 0;
+
+        auto entry = findEntry(key);
+
+        if (record.flags & SYS_LOG_FLAG_ERASED)
+        {
+            if (entry != nullptr)
+                entry->inUse = false;
+        }
+        else
+        {
+            if (entry == nullptr)
+                entry = allocEntry();
+
+            if (entry == nullptr)
+            {
+                stats.errors++;
+                ESP_LOGE(TAG, "Error, index is full -- %s dropped", key);
+            }
+            else
+            {
+                strcpy(entry->key, key);
+                memcpy(entry->value, buffer + record.keyLength, record.valueLength);
+                entry->valueLength = (uint8_t)record.valueLength;
+                entry->sector = sector;
+                entry->offset = offset;
+                entry->inUse = true;
+            }
+        }
+        offset += size;
+    }
+
+    sectors[sector].writeOffset = offset;
+    return true;
+}
+
+bool LogStore::get(const char *key, void *value, size_t *length)
+{
+    if (!isMounted() || (key == nullptr) || (length == nullptr))
+        return false;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    bool blnResult = false;
+    auto entry = findEntry(key);
+
+    if (entry != nullptr)
+    {
+        blnResult = (*length >= entry->valueLength) && (value != nullptr);
+
+        if (blnResult)
+            memcpy(value, entry->value, entry->valueLength);
+
+        *length = entry->valueLength;
+    }
+
+    xSemaphoreGive(mutex);
+    return blnResult;
+}
+
+//
+// A value equal to the one held is not written at all.  When the reserve sector is all that is left the oldest sector is
+// compacted here on the caller -- SYS::NVS normally gets there first.
+//
+bool LogStore::set(const char *key, const void *value, size_t length)
+{
+    if (!isMounted() || (key == nullptr) || ((value == nullptr) && (length > 0)))
+        return false;
+
+    auto keyLength = strlen(key);
+
+    if ((keyLength == 0) || (keyLength > SYS_LOG_MAX_KEY) || (length > SYS_LOG_MAX_VALUE))
+        return false;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    stats.sets++;
+
+    auto entry = findEntry(key);
+
+    if ((entry != nullptr) && (entry->valueLength == length) && (memcmp(entry->value, value, length) == 0))
+    {
+        stats.setsUnchanged++;
+        xSemaphoreGive(mutex);
+        return true;
+    }
+
+    if (entry == nullptr)
+        entry = allocEntry();
+
+    bool blnResult = false;
+
+    if (entry != nullptr)
+    {
+        uint8_t sector = 0;
+        uint16_t offset = 0;
+
+        blnResult = appendRecord(key, 0, value, length, false, &sector, &offset);
+
+        if (!blnResult)
+        {
+            if (countFree() <= 1)
+            {
+                auto victim = retireOldest();
+
+                if (victim != 0xFF)
+                    finishErase(victim, prepareSector(victim, sectors[victim].eraseCount + 1));
+            }
+            blnResult = appendRecord(key, 0, value, length, false, &sector, &offset);
+        }
+
+        if (blnResult)
+        {
+            strcpy(entry->key, key);
+            memcpy(entry->value, value, length);
+            entry->valueLength = (uint8_t)length;
+            entry->sector = sector;
+            entry->offset = offset;
+            entry->inUse = true;
+            stats.bytesRequested += keyLength + length;
+        }
+    }
+
+    if (!blnResult)
+        stats.errors++;
+
+    xSemaphoreGive(mutex);
+    return blnResult;
+}
+
+bool LogStore::erase(const char *key)
+{
+    if (!isMounted() || (key == nullptr))
+        return false;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    bool blnResult = true;
+    auto entry = findEntry(key);
+
+    if (entry != nullptr)
+    {
+        uint8_t sector = 0;
+        uint16_t offset = 0;
+
+        blnResult = appendRecord(key, SYS_LOG_FLAG_ERASED, nullptr, 0, false, &sector, &offset);
+
+        if (blnResult)
+            entry->inUse = false;
+        else
+            stats.errors++;
+    }
+
+    xSemaphoreGive(mutex);
+    return blnResult;
+}
+
+bool LogStore::wantsCompaction(void)
+{
+    if (!isMounted())
+        return false;
+
+    bool blnResult = false;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE)
+    {
+        for (uint8_t s = 0; s < sectorCount; s++)
+            blnResult |= (sectors[s].state == SYS_LOG_SECTOR::Dirty);
+
+        blnResult |= (countFree() <= SYS_LOG_COMPACT_FREE);
+        xSemaphoreGive(mutex);
+    }
+    return blnResult;
+}
+
+//
+// Runs on SYS::NVS.  A sector is claimed (Retired) with the mutex held, so no writer will pick it, and the erase itself runs
+// with the mutex given back -- writers only ever wait for the copy of a few live records.  Sectors left Dirty at mount are
+// erased here too, so writers do not have to.
+//
+bool LogStore::compact(void)
+{
+    if (!isMounted())
+        return false;
+
+    bool blnResult = true;
+
+    for (uint8_t pass = 0; pass < sectorCount; pass++)
+    {
+        uint8_t sector = 0xFF;
+        uint32_t eraseCount = 0;
+
+        if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+            return false;
+
+        for (uint8_t s = 0; s < sectorCount; s++)
+        {
+            if (sectors[s].state == SYS_LOG_SECTOR::Dirty)
+            {
+                sectors[s].state = SYS_LOG_SECTOR::Retired;
+                sector = s;
+                break;
+            }
+        }
+
+        if ((sector == 0xFF) && (countFree() <= SYS_LOG_COMPACT_FREE))
+            sector = retireOldest();
+
+        if (sector != 0xFF)
+            eraseCount = sectors[sector].eraseCount + 1;
+
+        xSemaphoreGive(mutex);
+
+        if (sector == 0xFF)
+            break;
+
+        auto blnErased = prepareSector(sector, eraseCount);
+
+        if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE)
+        {
+            finishErase(sector, blnErased);
+            xSemaphoreGive(mutex);
+        }
+
+        if (!blnErased)
+        {
+            blnResult = false;
+            break; // Do not spin on a sector that will not erase
+        }
+    }
+    return blnResult;
+}
+
+void LogStore::getStats(SYS_LogStoreStats *result)
+{
+    if (result == nullptr)
+        return;
+
+    *result = {};
+
+    if (!isMounted())
+        return;
+
+    if (xSemaphoreTake(mutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    *result = stats;
+    result->sectors = sectorCount;
+    result->freeSectors = countFree();
+    result->eraseMin = UINT32_MAX;
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        if (sectors[s].eraseCount < result->eraseMin)
+            result->eraseMin = sectors[s].eraseCount;
+
+        if (sectors[s].eraseCount > result->eraseMax)
+            result->eraseMax = sectors[s].eraseCount;
+    }
+
+    for (const auto &entry : index)
+    {
+        if (entry.inUse)
+            result->liveKeys++;
+    }
+
+    xSemaphoreGive(mutex);
+}
+
+SYS_LogIndexEntry *LogStore::findEntry(const char *key)
+{
+    for (auto &entry : index)
+    {
+        if (entry.inUse && (strcmp(entry.key, key) == 0))
+            return &entry;
+    }
+    return nullptr;
+}
+
+SYS_LogIndexEntry *LogStore::allocEntry(void)
+{
+    for (auto &entry : index)
+    {
+        if (!entry.inUse)
+            return &entry;
+    }
+    return nullptr;
+}
+
+//
+// Appends one record to the active sector, moving to a new sector when it will not fit.  The record goes down in one
+// program operation so a power cut leaves either nothing or a record that fails its CRC.
+//
+bool LogStore::appendRecord(const char *key, uint8_t flags, const void *value, size_t length, bool blnCompacting, uint8_t *sector,
+                            uint16_t *offset)
+{
+    auto keyLength = strlen(key);
+    auto size = recordSize(keyLength, length);
+
+    if ((head == 0xFF) || (sectors[head].writeOffset + size > SYS_LOG_SECTOR_SIZE))
+    {
+        if (!advanceHead(blnCompacting))
+            return false;
+    }
+
+    uint8_t buffer[sizeof(SYS_LogRecordHeader) + SYS_LOG_MAX_KEY + SYS_LOG_MAX_VALUE + 3];
+    SYS_LogRecordHeader record = {};
+
+    memset(buffer, 0xFF, size);
+    memcpy(buffer + sizeof(record), key, keyLength);
+
+    if (length > 0)
+        memcpy(buffer + sizeof(record) + keyLength, value, length);
+
+    record.magic = SYS_LOG_RECORD_MAGIC;
+    record.keyLength = (uint8_t)keyLength;
+    record.flags = flags;
+    record.valueLength = (uint16_t)length;
+    record.reserved = 0xFFFF;
+    record.crc = esp_rom_crc32_le(0, (const uint8_t *)&record, 8);
+    record.crc = esp_rom_crc32_le(record.crc, buffer + sizeof(record), keyLength + length);
+    memcpy(buffer, &record, sizeof(record));
+
+    auto address = head * SYS_LOG_SECTOR_SIZE + sectors[head].writeOffset;
+
+    if (esp_partition_write(partition, address, buffer, size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error, write failed in sector %d -- sector sealed", head);
+        sectors[head].writeOffset = SYS_LOG_SECTOR_SIZE; // Whatever did land fails its CRC at the next mount
+        return false;
+    }
+
+    *sector = head;
+    *offset = sectors[head].writeOffset;
+    sectors[head].writeOffset += size;
+    stats.bytesWritten += size;
+    return true;
+}
+
+//
+// Puts the least worn free sector into use.  The last free sector is kept back for compaction, which needs somewhere to
+// copy live records before it can erase anything.
+//
+bool LogStore::advanceHead(bool blnCompacting)
+{
+    uint8_t reserve = blnCompacting ? 0 : 1;
+
+    if (countFree() <= reserve)
+        return false;
+
+    uint8_t best = 0xFF;
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        auto state = sectors[s].state;
+
+        if ((state != SYS_LOG_SECTOR::Erased) && (state != SYS_LOG_SECTOR::Dirty))
+            continue;
+
+        if (best == 0xFF)
+        {
+            best = s;
+            continue;
+        }
+
+        bool blnErased = (state == SYS_LOG_SECTOR::Erased);
+        bool blnBestErased = (sectors[best].state == SYS_LOG_SECTOR::Erased);
+
+        if ((blnErased && !blnBestErased) || ((blnErased == blnBestErased) && (sectors[s].eraseCount < sectors[best].eraseCount)))
+            best = s;
+    }
+
+    if (sectors[best].state == SYS_LOG_SECTOR::Dirty)
+    {
+        auto blnErased = prepareSector(best, sectors[best].eraseCount + 1);
+        finishErase(best, blnErased);
+
+        if (!blnErased)
+            return false;
+    }
+
+    uint32_t words[2] = {nextSequence, esp_rom_crc32_le(0, (const uint8_t *)&nextSequence, sizeof(nextSequence))};
+    auto address = best * SYS_LOG_SECTOR_SIZE + offsetof(SYS_LogSectorHeader, sequence);
+
+    if (esp_partition_write(partition, address, words, sizeof(words)) != ESP_OK)
+    {
+        sectors[best].state = SYS_LOG_SECTOR::Dirty;
+        stats.errors++;
+        return false;
+    }
+
+    if (head != 0xFF)
+        sectors[head].state = SYS_LOG_SECTOR::Full;
+
+    sectors[best].state = SYS_LOG_SECTOR::Active;
+    sectors[best].sequence = nextSequence++;
+    sectors[best].writeOffset = sizeof(SYS_LogSectorHeader);
+    head = best;
+    stats.bytesWritten += sizeof(words);
+    return true;
+}
+
+//
+// Flash work only, so SYS::NVS can call it without the mutex.  The caller settles the sector with finishErase().
+//
+bool LogStore::prepareSector(uint8_t sector, uint32_t eraseCount)
+{
+    if (esp_partition_erase_range(partition, sector * SYS_LOG_SECTOR_SIZE, SYS_LOG_SECTOR_SIZE) != ESP_OK)
+        return false;
+
+    uint32_t words[3] = {SYS_LOG_SECTOR_MAGIC, eraseCount, 0};
+    words[2] = esp_rom_crc32_le(0, (const uint8_t *)words, 8);
+
+    return (esp_partition_write(partition, sector * SYS_LOG_SECTOR_SIZE, words, sizeof(words)) == ESP_OK);
+}
+
+void LogStore::finishErase(uint8_t sector, bool blnErased)
+{
+    if (!blnErased)
+    {
+        sectors[sector].state = SYS_LOG_SECTOR::Dirty;
+        stats.errors++;
+        ESP_LOGE(TAG, "Error, erase of sector %d failed", sector);
+        return;
+    }
+
+    sectors[sector].state = SYS_LOG_SECTOR::Erased;
+    sectors[sector].eraseCount++;
+    sectors[sector].sequence = 0;
+    sectors[sector].writeOffset = sizeof(SYS_LogSectorHeader);
+    stats.erases++;
+    stats.bytesWritten += 12;
+}
+
+//
+// Copies the live records of the oldest closed sector to the head and marks it Retired.  It is the oldest, so any tombstone
+// in it has nothing older left to hide and is dropped.  Returns the sector to erase, or 0xFF.
+//
+uint8_t LogStore::retireOldest(void)
+{
+    uint8_t victim = 0xFF;
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        if ((sectors[s].state != SYS_LOG_SECTOR::Full) || (s == head))
+            continue;
+
+        if ((victim == 0xFF) || (sectors[s].sequence < sectors[victim].sequence))
+            victim = s;
+    }
+
+    if (victim == 0xFF)
+        return 0xFF;
+
+    for (auto &entry : index)
+    {
+        if (!entry.inUse || (entry.sector != victim))
+            continue;
+
+        uint8_t sector = 0;
+        uint16_t offset = 0;
+
+        if (!appendRecord(entry.key, 0, entry.value, entry.valueLength, true, &sector, &offset))
+            return 0xFF; // Victim is untouched -- try again later
+
+        entry.sector = sector;
+        entry.offset = offset;
+        stats.compactedBytes += recordSize(strlen(entry.key), entry.valueLength);
+    }
+
+    sectors[victim].state = SYS_LOG_SECTOR::Retired;
+    stats.compactions++;
+    return victim;
+}
+
+uint8_t LogStore::countFree(void)
+{
+    uint8_t count = 0;
+
+    for (uint8_t s = 0; s < sectorCount; s++)
+    {
+        if ((sectors[s].state == SYS_LOG_SECTOR::Erased) || (sectors[s].state == SYS_LOG_SECTOR::Dirty))
+            count++;
+    }
+    return count;
+}
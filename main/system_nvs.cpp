@@ -1,6 +1,26 @@
 #include "system.hpp"
 
-/* Non Volatile Storage */
+#include "esp_system.h"
+
+static bool isNVSByteType(SYS_NVS_TYPE type) // Strings and blobs keep their bytes in strValue
+{
+    return (type == SYS_NVS_TYPE::String) || (type == SYS_NVS_TYPE::Blob);
+}
+
+//
+// Non Volatile Storage
+//
+// Every value goes through a write-back cache in RAM.  Reads are served from the cache and only the first read of a key
+// goes to flash (a missing key is cached as well).  Writes compare against the cached value -- an unchanged value is
+// dropped, anything else marks the entry dirty and pushes the flush deadline out.  Repeated writes to one key collapse
+// into that one entry.  Once writes have been quiet for CONFIG_SYS_NVS_FLUSH_QUIET_MS the SYS::NVS task (system_nvs_task.cpp)
+// flushes all dirty entries with one commit per namespace.  A shutdown handler flushes anything still pending before a
+// restart.
+//
+// Callers use an NvsTransaction (system_nvs.hpp).  Writers serialize per namespace on the namespace's mutex, readers take
+// no transaction lock at all.  nvsCacheMutex is only held for the cache work itself, so it is never held across a caller's
+// transaction.  Each namespace keeps its own read and write handles open, so neither a miss nor a flush pays for nvs_open.
+//
 void System::initNVS()
 {
     auto err = nvs_flash_init();
@@ -15,358 +35,1288 @@ void System::initNVS()
             ESP_LOGI(TAG, "Error(%s) Initializeing NVS!", esp_err_to_name(err));
     }
     ESP_ERROR_CHECK(err);
+
+    if (nvsCacheMutex == nullptr)
+    {
+        nvsCacheMutex = xSemaphoreCreateMutex();
+        nvsPoolMutex = xSemaphoreCreateMutex();
+        nvsFlushMutex = xSemaphoreCreateMutex();
+        nvsRequestQue = xQueueCreate(SYS_NVS_REQUEST_QUEUE_SIZE, sizeof(SYS_NVSRequest));
+        nvsSpaceSem = xSemaphoreCreateCounting(SYS_NVS_REQUEST_QUEUE_SIZE, 0);
+        esp_register_shutdown_handler(&System::onNVSShutdown);
+
+        // Flash writes stall whoever makes them, so they belong to a task below everything that has timing to keep.
+        xTaskCreate(runNVSTaskMarshaller, "SYS::NVS", 1024 * 3, this, 2, &taskHandleSystemNVS); // (1) Low number indicates low priority task
+
+        if (!blnWarmResume) // A warm resume restores from RTC memory and reads nothing during init
+        {
+            SYS_BOOT_MARK("NVS", "Preload");
+            const char *preload[] = SYS_NVS_PRELOAD_NAMESPACES;
+            preloadNVS(preload, sizeof(preload) / sizeof(preload[0]));
+        }
+
+        SYS_BOOT_MARK("NVS", "Log store");
+
+        if (logStore.mount())
+            requestLogCompaction(); // Erases anything a power cut left half done, off the boot path
+        else
+            ESP_LOGW(TAG, "No %s partition -- hot values will not be kept", SYS_LOG_PARTITION_LABEL);
+    }
 }
 
-bool System::openNVStorage(const char *name_space, bool blnReadWrite)
+//
+// Finds or adds a namespace.  Entries are never released, so the pointer stays good after nvsPoolMutex is given back.
+//
+SYS_NVSNamespace *System::getNVSNamespace(const char *name_space)
 {
-    esp_err_t rc;
+    if ((name_space == nullptr) || (strlen(name_space) >= NVS_KEY_NAME_MAX_SIZE) || (nvsPoolMutex == nullptr))
+        return nullptr;
 
-    if (blnReadWrite)
-        rc = nvs_open(name_space, NVS_READWRITE, &nvsHandle);
-    else
-        rc = nvs_open(name_space, NVS_READONLY, &nvsHandle);
+    if (xSemaphoreTake(nvsPoolMutex, portMAX_DELAY) != pdTRUE)
+        return nullptr;
 
-    // We will always fail on the first READONLY attempt.  READWRITE is required when namespace is new.
-    if (rc == ESP_ERR_NVS_NOT_FOUND)
-    {
-        if (showNVMDebug)
-            ESP_LOGW(TAG, "ESP_ERR_NVS_NOT_FOUND, creating new NVS space...");
-        rc = nvs_open(name_space, NVS_READWRITE, &nvsHandle);
+    SYS_NVSNamespace *result = nullptr;
+    SYS_NVSNamespace *spare = nullptr;
 
-        if (blnReadWrite == false)
+    for (auto &ns : nvsNamespaces)
+    {
+        if (!ns.inUse)
         {
-            nvs_close(nvsHandle);
-            rc = nvs_open(name_space, NVS_READONLY, &nvsHandle); // Re-open as requested
+            if (spare == nullptr)
+                spare = &ns;
+        }
+        else if (strcmp(ns.name, name_space) == 0)
+        {
+            result = &ns;
+            break;
         }
     }
-    else if (rc != ESP_OK)
+
+    if ((result == nullptr) && (spare != nullptr))
     {
-        ESP_LOGE(TAG, "NVS ERROR - openNVStorage rc = 0x%04X", rc);
-        nvsHandle = 0;
+        spare->mutex = xSemaphoreCreateMutex(); // Priority inheritance -- a binary semaphore would not give us that
+
+        if (spare->mutex != nullptr)
+        {
+            strcpy(spare->name, name_space);
+            spare->inUse = true;
+            result = spare;
+        }
+    }
+    xSemaphoreGive(nvsPoolMutex);
+
+    if (result == nullptr)
+        ESP_LOGE(TAG, "Error, Unable to add NVS namespace %s.  Raise SYS_NVS_MAX_NAMESPACES", name_space);
+    return result;
+}
+
+//
+// Lets an import find out, before it writes anything, whether all of its namespaces can be had.  Nothing is added.
+//
+bool System::hasNVSNamespaceRoom(const char (*names)[NVS_KEY_NAME_MAX_SIZE], uint8_t count)
+{
+    if ((nvsPoolMutex == nullptr) || (xSemaphoreTake(nvsPoolMutex, portMAX_DELAY) != pdTRUE))
         return false;
+
+    uint8_t spare = 0;
+    uint8_t missing = 0;
+
+    for (auto &ns : nvsNamespaces)
+        spare += ns.inUse ? 0 : 1;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        bool blnFound = false;
+
+        for (auto &ns : nvsNamespaces)
+            blnFound |= (ns.inUse && (strcmp(ns.name, names[i]) == 0));
+
+        missing += blnFound ? 0 : 1;
     }
+    xSemaphoreGive(nvsPoolMutex);
+    return (missing <= spare);
+}
 
-    return true;
+//
+// Hands back the namespace's pooled handle, opening it the first time.  A namespace that has never been written has no
+// read handle yet (ESP_ERR_NVS_NOT_FOUND) -- we return 0 and try again on the next miss.
+// Read handles are used with nvsCacheMutex held, write handles with nvsFlushMutex held.
+//
+nvs_handle_t System::getNVSHandle(SYS_NVSNamespace *ns, bool blnReadWrite)
+{
+    auto handle = blnReadWrite ? &ns->writeHandle : &ns->readHandle;
+
+    if (*handle != 0)
+        return *handle;
+
+    auto rc = nvs_open(ns->name, blnReadWrite ? NVS_READWRITE : NVS_READONLY, handle);
+
+    if (rc != ESP_OK)
+    {
+        if ((rc != ESP_ERR_NVS_NOT_FOUND) || showNVMDebug)
+            ESP_LOGW(TAG, "nvs_open %s rc = %s", ns->name, esp_err_to_name(rc));
+        *handle = 0;
+    }
+    return *handle;
 }
 
-bool System::getBooleanFromNVS(const char *key, bool *blnValue)
+//
+// One pass over the partition at boot.  Every key of the listed namespaces is read into the cache, so init code finds its
+// values in RAM and a key we do not hold is known to be missing without asking flash.  If the cache fills up first, the
+// namespaces that did not fit go back to reading misses from flash.
+//
+bool System::preloadNVS(const char *const *namespaces, uint8_t count)
 {
-    if (nvsHandle == 0)
+    SYS_NVSNamespace *targets[SYS_NVS_MAX_NAMESPACES] = {};
+    uint8_t targetCount = 0;
+
+    for (uint8_t i = 0; (i < count) && (targetCount < SYS_NVS_MAX_NAMESPACES); i++)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
+        auto ns = getNVSNamespace(namespaces[i]);
+
+        if (ns != nullptr)
+            targets[targetCount++] = ns;
     }
-    else
+
+    auto start = esp_timer_get_time();
+    uint16_t keys = 0;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+
+    for (uint8_t i = 0; i < targetCount; i++)
+        targets[i]->blnPreloaded = true; // Until a key of it does not fit
+
+    nvs_entry_info_t info;
+    auto it = nvs_entry_find(NVS_DEFAULT_PART_NAME, NULL, NVS_TYPE_ANY);
+
+    while (it != NULL)
     {
-        esp_err_t rc;
-        uint8_t val;
+        nvs_entry_info(it, &info);
+        it = nvs_entry_next(it); // Releases the iterator after the last entry
 
-        rc = nvs_get_u8(nvsHandle, key, &val);
+        SYS_NVSNamespace *ns = nullptr;
 
-        if (rc == ESP_OK)
+        for (uint8_t i = 0; i < targetCount; i++)
         {
-            if (val == 1)
-                *blnValue = true;
-            else if (val == 0)
-                *blnValue = false;
-            else
-                ESP_LOGE(TAG, "No value stored in Boolean with key of %s", key);
+            if (strcmp(targets[i]->name, info.namespace_name) == 0)
+            {
+                ns = targets[i];
+                break;
+            }
         }
-        else
+
+        if (ns == nullptr)
+            continue;
+
+        SYS_NVS_TYPE type = SYS_NVS_TYPE::None;
+
+        switch (info.type)
         {
-            ESP_LOGE(TAG, "No value stored in Boolean with key of %s", key);
-            return false;
+        case NVS_TYPE_U8:
+            type = SYS_NVS_TYPE::U8;
+            break;
+        case NVS_TYPE_U16:
+            type = SYS_NVS_TYPE::U16;
+            break;
+        case NVS_TYPE_STR:
+            type = SYS_NVS_TYPE::String;
+            break;
+        case NVS_TYPE_BLOB:
+            type = SYS_NVS_TYPE::Blob;
+            break;
+        default:
+            break;
+        }
+
+        if ((type == SYS_NVS_TYPE::None) || (lookupNVSEntry(ns, info.key, nullptr) != nullptr))
+            continue; // A type we never read, or already cached (and possibly newer than flash)
+
+        if (nvsCacheCount >= SYS_NVS_CACHE_ENTRIES) // Full -- never evict one preloaded key for another
+        {
+            ns->blnPreloaded = false;
+            nvsPreloadStats.blnTruncated = true;
+            continue;
+        }
+
+        auto entry = insertNVSEntry(ns, info.key, SYS_NVS_TYPE::None); // Added without a load...
+
+        if (entry != nullptr)
+        {
+            entry->type = type; // ...which we do here as the type flash says it is
+            entry->blnPreloaded = true;
+            readNVSEntryFromFlash(entry);
+            keys++;
         }
     }
 
-    if (showNVMDebug)
+    nvsPreloadStats.keys += keys;
+    nvsPreloadStats.preloadUs += (uint32_t)(esp_timer_get_time() - start);
+    xSemaphoreGive(nvsCacheMutex);
+
+    if (showInit)
+        ESP_LOGI(TAG, "NVS preload %d keys from %d namespaces in %d us%s", keys, targetCount, nvsPreloadStats.preloadUs,
+                 nvsPreloadStats.blnTruncated ? "  (cache full -- raise SYS_NVS_CACHE_ENTRIES)" : "");
+    return !nvsPreloadStats.blnTruncated;
+}
+
+void System::getNVSPreloadStats(SYS_NVSPreloadStats *stats)
+{
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) != pdTRUE)
+        return;
+
+    *stats = nvsPreloadStats;
+    stats->capacity = SYS_NVS_CACHE_ENTRIES;
+    stats->entries = nvsCacheCount;
+    stats->bytes = sizeof(nvsCache) + sizeof(nvsCacheOrder) + sizeof(nvsFlushBatch);
+
+    for (auto &entry : nvsCache)
+        stats->bytes += entry.strValue.capacity();
+
+    for (auto &item : nvsFlushBatch)
+        stats->bytes += item.strValue.capacity();
+
+    stats->namespaces = 0;
+
+    for (auto &ns : nvsNamespaces)
     {
-        if (*blnValue)
-            ESP_LOGW(TAG, "getBooleanFromNVS  Sending value of 'true'");
-        else
-            ESP_LOGW(TAG, "getBooleanFromNVS  Sending value of 'false'");
+        if (ns.inUse && ns.blnPreloaded)
+            stats->namespaces++;
     }
-
-    return true;
+    xSemaphoreGive(nvsCacheMutex);
 }
 
-bool System::getStringFromNVS(const char *key, std::string *strValue)
+//
+// Writes every dirty entry to flash.  The cache is only held while the dirty entries are copied out and again while they
+// are marked clean -- the flash writes themselves run unlocked, so readers and writers never wait on flash.  An entry that
+// changed while it was being written stays dirty for the next flush.
+//
+bool System::flushNVSCache(void)
 {
-    if (showNVMDebug)
-        ESP_LOGW(TAG, "getStringFromNVS passed in a key of %s", key);
+    if ((nvsCacheMutex == nullptr) || (nvsFlushMutex == nullptr))
+        return true;
 
-    if (nvsHandle == 0)
+    if (xSemaphoreTake(nvsFlushMutex, pdMS_TO_TICKS(1000)) != pdTRUE)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
+        ESP_LOGE(TAG, "Error, flushNVSCache could not take the flush");
         return false;
     }
-    else
+
+    auto start = esp_timer_get_time();
+    uint8_t count = 0;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    nvsCacheStats.flushes++;
+
+    for (uint8_t i = 0; i < SYS_NVS_CACHE_ENTRIES; i++)
     {
-        size_t length = retrieveLengthOfStringInNVM(key);
+        auto entry = &nvsCache[i];
 
-        if (length > 0)
-        {
-            char *value = (char *)malloc(length);
+        if (!entry->inUse || !entry->dirty)
+            continue;
 
-            if (retrieveStringWithKeyFromNVS(key, value, &length))
-                strValue->append(value);
+        auto item = &nvsFlushBatch[count++];
+        item->ns = entry->ns;
+        strcpy(item->key, entry->key);
+        item->type = entry->type;
+        item->present = entry->present;
+        item->blnDone = false;
+        item->blnWritten = false;
+        item->index = i;
+        item->value = entry->value;
+        item->version = entry->version;
+        item->strValue = entry->strValue; // The batch keeps its capacity from one flush to the next
+    }
 
-            if (showNVMDebug)
-                ESP_LOGW(TAG, "getStringFromNVS  Sending value of %s", strValue->c_str());
-            free(value);
-        }
+    nvsFlushDeadline = 0; // Anything written from here on starts a new quiet period
+    blnNVSFlushPending = false;
+    auto copied = esp_timer_get_time();
+    xSemaphoreGive(nvsCacheMutex);
+
+    bool blnResult = writeNVSBatch(count);
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    auto settle = esp_timer_get_time();
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        auto item = &nvsFlushBatch[i];
+        auto entry = &nvsCache[item->index];
+
+        if (!item->blnWritten)
+            continue;
+
+        nvsCacheStats.flashWrites++;
+
+        if (entry->inUse && entry->dirty && (entry->version == item->version))
+            entry->dirty = false;
     }
 
-    return true;
+    if (!blnResult)
+    {
+        nvsCacheStats.errors++;
+
+        if (nvsFlushDeadline == 0) // Whatever failed is still dirty -- try again after another quiet period
+            nvsFlushDeadline = settle + (int64_t)CONFIG_SYS_NVS_FLUSH_QUIET_MS * 1000;
+    }
+
+    auto done = esp_timer_get_time();
+    auto holdUs = (uint32_t)((copied - start) + (done - settle));
+
+    if (holdUs > nvsCacheStats.cacheHoldMaxUs)
+        nvsCacheStats.cacheHoldMaxUs = holdUs;
+
+    if ((done - start) > nvsCacheStats.flushMaxUs)
+        nvsCacheStats.flushMaxUs = (uint32_t)(done - start);
+    xSemaphoreGive(nvsCacheMutex);
+
+    xSemaphoreGive(nvsFlushMutex);
+    return blnResult;
 }
 
-bool System::getU8IntegerFromNVS(const char *key, uint8_t *intValue)
+//
+// Writes the copied entries, grouped so each namespace is committed once.  A namespace whose commit fails has none of its
+// entries marked written, so they all stay dirty and are retried.  Runs with nvsFlushMutex held and the cache unlocked.
+//
+bool System::writeNVSBatch(uint8_t count)
 {
-    if (showNVMDebug)
-        ESP_LOGW(TAG, "getU8IntegerFromNVS passed in a key of %s", key);
+    bool blnResult = true;
+    uint32_t commits = 0;
 
-    if (nvsHandle == 0)
+    for (uint8_t i = 0; i < count; i++)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
-    }
-    else
-    {
-        esp_err_t rc = nvs_get_u8(nvsHandle, key, intValue);
+        if (nvsFlushBatch[i].blnDone)
+            continue;
 
-        if (rc != ESP_OK)
+        auto ns = nvsFlushBatch[i].ns;
+        auto handle = getNVSHandle(ns, true);
+        bool blnNamespaceOK = (handle != 0);
+
+        if (!blnNamespaceOK)
+            ESP_LOGE(TAG, "Error opening %s for flush", ns->name);
+
+        for (uint8_t j = i; j < count; j++)
         {
-            ESP_LOGW(TAG, "No value stored as u8int with key of %s", key);
-            *intValue = 0;
+            auto item = &nvsFlushBatch[j];
+
+            if (item->ns != ns)
+                continue;
+
+            item->blnDone = true;
+
+            if (!blnNamespaceOK)
+                continue;
+
+            esp_err_t rc = ESP_OK;
+
+            if (!item->present)
+            {
+                rc = nvs_erase_key(handle, item->key);
+
+                if (rc == ESP_ERR_NVS_NOT_FOUND)
+                    rc = ESP_OK;
+            }
+            else
+            {
+                switch (item->type)
+                {
+                case SYS_NVS_TYPE::U8:
+                    rc = nvs_set_u8(handle, item->key, (uint8_t)item->value);
+                    break;
+                case SYS_NVS_TYPE::U16:
+                    rc = nvs_set_u16(handle, item->key, item->value);
+                    break;
+                case SYS_NVS_TYPE::String:
+                    rc = nvs_set_str(handle, item->key, item->strValue.c_str());
+                    break;
+                case SYS_NVS_TYPE::Blob:
+                    rc = nvs_set_blob(handle, item->key, item->strValue.data(), item->strValue.size());
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (rc == ESP_OK)
+                item->blnWritten = true;
+            else
+            {
+                ESP_LOGE(TAG, "Error(%s) writing %s/%s", esp_err_to_name(rc), ns->name, item->key);
+                blnResult = false;
+            }
+        }
+
+        if (!blnNamespaceOK)
+        {
+            blnResult = false;
+            continue;
+        }
+
+        auto rc = nvs_commit(handle);
+
+        if (rc == ESP_OK)
+            commits++;
+        else
+        {
+            ESP_LOGI(TAG, "Error(%s) committing to NVS!", esp_err_to_name(rc));
+            blnResult = false;
+
+            for (uint8_t j = i; j < count; j++)
+            {
+                if (nvsFlushBatch[j].ns == ns)
+                    nvsFlushBatch[j].blnWritten = false;
+            }
         }
-        if (showNVMDebug)
-            ESP_LOGW(TAG, "Value restored is %d", *intValue);
     }
-    return true;
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    nvsCacheStats.commits += commits;
+    xSemaphoreGive(nvsCacheMutex);
+    return blnResult;
 }
 
-bool System::getU16IntegerFromNVS(const char *key, uint16_t *intValue)
+void System::getNVSCacheStats(SYS_NVSCacheStats *stats)
 {
-    if (showNVMDebug)
-        ESP_LOGW(TAG, "getU16IntegerFromNVS passed in a key of %s", key);
-
-    if (nvsHandle == 0)
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
+        *stats = nvsCacheStats;
+        xSemaphoreGive(nvsCacheMutex);
     }
-    else
+}
+
+void System::logNVSCacheStats(void)
+{
+    SYS_NVSCacheStats stats = {};
+    getNVSCacheStats(&stats);
+
+    ESP_LOGI(TAG, "NVS reads %d  flash reads %d  writes %d  unchanged %d  coalesced %d  evictions %d", stats.reads,
+             stats.flashReads, stats.writes, stats.writesUnchanged, stats.writesCoalesced, stats.evictions);
+    ESP_LOGI(TAG, "NVS flash writes %d  avoided %d  commits %d  flushes %d  errors %d", stats.flashWrites,
+             stats.writesUnchanged + stats.writesCoalesced, stats.commits, stats.flushes, stats.errors);
+    ESP_LOGI(TAG, "NVS span reads %d  bytes %d", stats.spanReads, stats.spanBytes);
+}
+
+//
+// Binary search of the sorted index.  position is where the key is, or where it would go.
+// Must be called with nvsCacheMutex held.
+//
+SYS_NVSCacheEntry *System::lookupNVSEntry(SYS_NVSNamespace *ns, const char *key, uint8_t *position)
+{
+    int16_t low = 0;
+    int16_t high = nvsCacheCount;
+
+    while (low < high)
     {
-        esp_err_t rc = nvs_get_u16(nvsHandle, key, intValue);
+        int16_t mid = (low + high) / 2;
+        auto entry = &nvsCache[nvsCacheOrder[mid]];
+        int cmp = (entry->ns == ns) ? strcmp(entry->key, key) : ((entry->ns < ns) ? -1 : 1); // Namespaces sort by pool slot
 
-        if (rc != ESP_OK)
+        if (cmp == 0)
         {
-            ESP_LOGW(TAG, "No value stored as u16int with key of %s", key);
-            *intValue = 0;
+            if (position != nullptr)
+                *position = (uint8_t)mid;
+            return entry;
         }
+
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
     }
-    return true;
+
+    if (position != nullptr)
+        *position = (uint8_t)low;
+    return nullptr;
 }
 
-bool System::saveBooleanToNVS(const char *key, bool blnVal)
+//
+// Adds a key and loads it as type.  A namespace that was preloaded answers a miss from RAM -- the key is not in flash.
+// allocNVSEntry() may give the cache up while it waits for a flush, so if someone else added the key meanwhile we hand theirs back.
+// Must be called with nvsCacheMutex held.
+//
+SYS_NVSCacheEntry *System::insertNVSEntry(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type)
 {
-    if (nvsHandle == 0)
+    auto entry = allocNVSEntry();
+
+    if (entry == nullptr)
+        return nullptr;
+
+    uint8_t position = 0;
+    auto existing = lookupNVSEntry(ns, key, &position);
+
+    if (existing != nullptr)
+        return existing; // Our entry was never marked in use, so it simply stays free
+
+    entry->ns = ns;
+    strncpy(entry->key, key, NVS_KEY_NAME_MAX_SIZE - 1);
+    entry->key[NVS_KEY_NAME_MAX_SIZE - 1] = 0;
+    entry->type = type;
+    entry->lastUsed = ++nvsCacheClock;
+    entry->inUse = true;
+
+    memmove(&nvsCacheOrder[position + 1], &nvsCacheOrder[position], nvsCacheCount - position);
+    nvsCacheOrder[position] = (uint8_t)(entry - nvsCache);
+    nvsCacheCount++;
+
+    if (type == SYS_NVS_TYPE::None) // An erase -- nothing to load
+        return entry;
+
+    if (ns->blnPreloaded)
+        nvsPreloadStats.absentHits++;
+    else
+        loadNVSEntry(entry);
+    return entry;
+}
+
+//
+// Takes an entry out of the sorted index.  Must be called with nvsCacheMutex held.
+//
+void System::removeNVSEntry(SYS_NVSCacheEntry *entry)
+{
+    uint8_t position = 0;
+
+    if (lookupNVSEntry(entry->ns, entry->key, &position) != entry)
+        return;
+
+    memmove(&nvsCacheOrder[position], &nvsCacheOrder[position + 1], nvsCacheCount - position - 1);
+    nvsCacheCount--;
+
+    entry->ns->blnPreloaded = false; // We no longer hold every key, so a miss has to ask flash again
+}
+
+//
+// Looks up a key in a namespace.  A miss is read from flash and cached -- present or not.
+// Must be called with nvsCacheMutex held.
+//
+SYS_NVSCacheEntry *System::findNVSEntry(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type)
+{
+    auto entry = lookupNVSEntry(ns, key, nullptr);
+
+    if (entry == nullptr)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
+        entry = insertNVSEntry(ns, key, type);
+
+        if ((entry == nullptr) || (entry->type == type))
+            return entry;
     }
-    else
+
+    entry->lastUsed = ++nvsCacheClock;
+
+    if (entry->type == type)
+    {
+        if (entry->blnPreloaded)
+            nvsPreloadStats.hits++;
+        return entry;
+    }
+
+    if (entry->dirty && !entry->present) // Pending erase -- reads as missing whatever the type
     {
-        esp_err_t rc;
-        uint8_t val;
+        entry->type = type;
+        return entry;
+    }
+
+    if (entry->dirty) // Pending value of a different type
+    {
+        ESP_LOGE(TAG, "Error, %s/%s has a pending value of another type", ns->name, key);
+        return nullptr;
+    }
 
-        if (showNVMDebug)
+    entry->type = type; // Read again as the type we were asked for
+    loadNVSEntry(entry);
+    return entry;
+}
+
+//
+// Hands out a free entry or evicts the least recently used clean one.  If everything is dirty we wait for SYS::NVS to flush,
+// at most SYS_NVS_SPACE_FLUSHES times, and then give up.
+//
+SYS_NVSCacheEntry *System::allocNVSEntry(void)
+{
+    SYS_NVSCacheEntry *victim = nullptr;
+
+    for (uint8_t attempt = 0; victim == nullptr; attempt++)
+    {
+        for (auto &entry : nvsCache)
         {
-            if (blnVal)
-                ESP_LOGW(TAG, "saveBooleanAsString key/value provided %s/true", key);
-            else
-                ESP_LOGW(TAG, "saveBooleanAsString key/value provided %s/false", key);
-        }
+            if (!entry.inUse)
+            {
+                victim = &entry;
+                break;
+            }
 
-        if (blnVal)
-            val = 0;
-        else
-            val = 1;
+            if (!entry.dirty && ((victim == nullptr) || (entry.lastUsed < victim->lastUsed)))
+                victim = &entry;
+        }
 
-        rc = nvs_set_u8(nvsHandle, key, val);
+        if (victim != nullptr)
+            break;
 
-        if (rc != ESP_OK)
+        if ((attempt == SYS_NVS_SPACE_FLUSHES) || !waitForNVSSpace())
         {
-            ESP_LOGE(TAG, "Error, Unable to saveBooleanToNVS.  esp_err_t code = %s", esp_err_to_name(rc));
-            return false;
+            ESP_LOGE(TAG, "Error, NVS cache is full of dirty entries.  Raise SYS_NVS_CACHE_ENTRIES");
+            nvsCacheStats.errors++;
+            return nullptr;
         }
-        return true;
     }
-}
 
-bool System::saveStringToNVS(const char *key, std::string *strValue)
-{
-    if (nvsHandle == 0)
+    if (victim->inUse)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
+        nvsCacheStats.evictions++;
+        removeNVSEntry(victim);
     }
+
+    victim->inUse = false;
+    victim->blnPreloaded = false;
+    victim->present = false;
+    victim->dirty = false;
+    victim->value = 0;
+
+    if (victim->strValue.capacity() > SYS_NVS_STRING_KEEP)
+        std::string().swap(victim->strValue); // Hand large buffers back to the heap rather than parking them in the cache
     else
+        victim->strValue.clear();
+    return victim;
+}
+
+//
+// Called with nvsCacheMutex held and returns with it held again.  The writer may be on a task that must never write flash
+// itself, so the flush is handed to SYS::NVS and we only wait for it.  The flush can wait SYS_NVS_LOCK_TIMEOUT_MS for the
+// flush lock before it starts, so we allow twice that.  Only SYS::NVS itself, or anyone before it exists, flushes inline.
+//
+bool System::waitForNVSSpace(void)
+{
+    bool blnInline = (taskHandleSystemNVS == nullptr) || (xTaskGetCurrentTaskHandle() == taskHandleSystemNVS);
+    bool blnFlushed = false;
+
+    nvsCacheStats.spaceWaits++;
+    xSemaphoreGive(nvsCacheMutex); // The flush needs the cache
+
+    if (blnInline)
+        blnFlushed = flushNVSCache();
+    else if (requestNVSFlush(&System::onNVSSpaceFlushed, this))
+        blnFlushed = (xSemaphoreTake(nvsSpaceSem, pdMS_TO_TICKS(2 * SYS_NVS_LOCK_TIMEOUT_MS)) == pdTRUE);
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    return blnFlushed;
+}
+
+//
+// Runs on SYS::NVS.  A writer that gave up waiting leaves its give behind -- the next writer then wakes early, finds no clean
+// entry and waits again, which costs one of its attempts and nothing else.
+//
+void System::onNVSSpaceFlushed(void *arg, bool blnResult)
+{
+    auto obj = (System *)arg;
+    xSemaphoreGive(obj->nvsSpaceSem);
+}
+
+//
+// A cache miss.  Counted and timed, so what the preload saved at boot is measured rather than worked out.
+// Must be called with nvsCacheMutex held.
+//
+void System::loadNVSEntry(SYS_NVSCacheEntry *entry)
+{
+    auto start = esp_timer_get_time();
+
+    nvsCacheStats.flashReads++;
+    readNVSEntryFromFlash(entry);
+    nvsCacheStats.flashReadUs += (uint32_t)(esp_timer_get_time() - start);
+}
+
+bool System::readNVSEntryFromFlash(SYS_NVSCacheEntry *entry)
+{
+    entry->present = false;
+    entry->value = 0;
+    entry->strValue.clear();
+
+    auto handle = getNVSHandle(entry->ns, false);
+
+    if (handle == 0) // Nothing has ever been written to this namespace
+        return false;
+
+    esp_err_t rc = ESP_OK;
+
+    switch (entry->type)
+    {
+    case SYS_NVS_TYPE::U8:
     {
-        esp_err_t rc;
+        uint8_t val = 0;
+        rc = nvs_get_u8(handle, entry->key, &val);
+        entry->value = val;
+        break;
+    }
 
-        if (showNVMDebug)
-            ESP_LOGW(TAG, "saveStringToNVS is key/value %s %s", key, strValue->c_str());
+    case SYS_NVS_TYPE::U16:
+        rc = nvs_get_u16(handle, entry->key, &entry->value);
+        break;
 
-        rc = nvs_set_str(nvsHandle, key, strValue->c_str());
+    case SYS_NVS_TYPE::String:
+    {
+        size_t length = 0;
+        rc = nvs_get_str(handle, entry->key, NULL, &length);
 
-        if (rc != ESP_OK)
+        if ((rc == ESP_OK) && (length > 0))
         {
-            ESP_LOGE(TAG, "saveStringToNVS failed esp_err_t code = %s", esp_err_to_name(rc));
-            return false;
+            entry->strValue.resize(length);
+            rc = nvs_get_str(handle, entry->key, &entry->strValue[0], &length);
+            entry->strValue.resize(length - 1); // Drop the terminator
         }
-        else
+        break;
+    }
+
+    case SYS_NVS_TYPE::Blob:
+    {
+        size_t length = 0;
+        rc = nvs_get_blob(handle, entry->key, NULL, &length);
+
+        if ((rc == ESP_OK) && (length > 0))
         {
-            if (showNVMDebug)
-                ESP_LOGW(TAG, "Saved key/value %s / %s", key, strValue->c_str()); // Debug print statements
-            return true;
+            entry->strValue.resize(length);
+            rc = nvs_get_blob(handle, entry->key, &entry->strValue[0], &length);
         }
+        break;
+    }
+
+    default:
+        rc = ESP_ERR_NVS_NOT_FOUND;
+        break;
     }
+
+    entry->present = (rc == ESP_OK);
+
+    if ((rc != ESP_OK) && (rc != ESP_ERR_NVS_NOT_FOUND))
+    {
+        ESP_LOGE(TAG, "Error(%s) reading %s/%s", esp_err_to_name(rc), entry->ns->name, entry->key);
+        nvsCacheStats.errors++;
+        return false;
+    }
+    return entry->present;
 }
 
-bool System::saveU8IntegerToNVS(const char *key, uint8_t intValue)
+//
+// The value we would write is compared against what flash holds (or will hold after the pending flush).  Only a real
+// change marks the entry dirty.  Must be called with nvsCacheMutex held.
+//
+bool System::applyNVSWrite(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type, uint16_t value, const std::string *strValue, bool *blnDirtied)
 {
-    if (nvsHandle == 0)
-    {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
+    nvsCacheStats.writes++;
+    auto entry = findNVSEntry(ns, key, type); // A miss loads the flash value so we can compare against it
+
+    if (entry == nullptr)
         return false;
+
+    bool blnSame = false;
+
+    if (entry->present)
+    {
+        if (isNVSByteType(type))
+            blnSame = (entry->strValue == *strValue);
+        else
+            blnSame = (entry->value == value);
     }
+
+    if (blnSame)
+    {
+        nvsCacheStats.writesUnchanged++;
+        return true;
+    }
+
+    if (entry->dirty)
+        nvsCacheStats.writesCoalesced++;
+
+    if (isNVSByteType(type))
+        entry->strValue = *strValue;
     else
+        entry->value = value;
+
+    entry->present = true;
+    entry->dirty = true;
+    entry->version++;
+    nvsFlushDeadline = esp_timer_get_time() + (int64_t)CONFIG_SYS_NVS_FLUSH_QUIET_MS * 1000; // Push the flush out
+    *blnDirtied = true;
+    return true;
+}
+
+//
+// Must be called with nvsCacheMutex held.  The key is dropped from RAM and the flush removes it from flash.
+//
+bool System::applyNVSErase(SYS_NVSNamespace *ns, const char *key, bool *blnDirtied)
+{
+    nvsCacheStats.writes++;
+
+    bool blnKnown = true; // We know what flash holds for this key
+    auto entry = lookupNVSEntry(ns, key, nullptr);
+
+    if (entry == nullptr)
     {
-        esp_err_t rc;
+        blnKnown = ns->blnPreloaded; // Never seen.  Unless we hold every key of the namespace, let the flush find out.
+        entry = insertNVSEntry(ns, key, SYS_NVS_TYPE::None);
+
+        if (entry == nullptr)
+            return false;
+    }
 
-        if (showNVMDebug)
-            ESP_LOGW(TAG, "saveU8IntegerToNVS is key/value %s %d", key, intValue);
+    entry->lastUsed = ++nvsCacheClock;
 
-        rc = nvs_set_u8(nvsHandle, key, intValue);
+    if (blnKnown && !entry->present && !entry->dirty) // Known to be missing from flash already
+    {
+        nvsCacheStats.writesUnchanged++;
+        return true;
+    }
 
-        if (rc != ESP_OK)
+    entry->present = false;
+    entry->strValue.clear();
+    entry->dirty = true;
+    entry->version++;
+    nvsFlushDeadline = esp_timer_get_time() + (int64_t)CONFIG_SYS_NVS_FLUSH_QUIET_MS * 1000;
+    *blnDirtied = true;
+    return true;
+}
+
+//
+// Reads for NvsTransaction.  Quiet -- nothing logs while a transaction may be holding its namespace.
+//
+bool System::readNVSValue(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type, uint16_t *value, std::string *strValue)
+{
+    bool blnFound = false;
+
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        nvsCacheStats.reads++;
+        auto entry = findNVSEntry(ns, key, type);
+
+        if ((entry != nullptr) && entry->present)
         {
-            ESP_LOGE(TAG, "saveU8IntegerToNVS failed esp_err_t code = %s", esp_err_to_name(rc));
-            return false;
+            if (isNVSByteType(type))
+                *strValue = entry->strValue;
+            else
+                *value = entry->value;
+            blnFound = true;
         }
-        else
+        xSemaphoreGive(nvsCacheMutex);
+    }
+    return blnFound;
+}
+
+//
+// Copies a string or blob from the cache into the caller's buffer.  *length is the buffer size going in and the stored size
+// (with the terminator for strings) coming out.  With no buffer, or one that is too small, nothing is copied -- the caller
+// learns the size it needs and only that probe is served from the cache.
+//
+bool System::readNVSBytes(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type, void *buffer, size_t *length)
+{
+    bool blnResult = false;
+
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        nvsCacheStats.reads++;
+        auto entry = findNVSEntry(ns, key, type);
+
+        if ((entry != nullptr) && entry->present)
         {
-            if (showNVMDebug)
-                ESP_LOGW(TAG, "Saved key/value %s / %d", key, intValue); // Debug print statements
-            return true;
+            auto bytes = entry->strValue.size();
+            auto size = bytes + ((type == SYS_NVS_TYPE::String) ? 1 : 0);
+
+            if (buffer == nullptr)
+                blnResult = true;
+            else if (size <= *length)
+            {
+                memcpy(buffer, entry->strValue.data(), bytes);
+
+                if (type == SYS_NVS_TYPE::String)
+                    ((char *)buffer)[bytes] = 0;
+                blnResult = true;
+
+                nvsCacheStats.spanReads++;
+                nvsCacheStats.spanBytes += bytes;
+            }
+            *length = size;
         }
+        else
+            *length = 0;
+
+        xSemaphoreGive(nvsCacheMutex);
     }
+    return blnResult;
 }
 
-bool System::saveU16IntegerToNVS(const char *key, uint16_t intValue)
+//
+// Applies a transaction's staged values in one pass under the cache mutex, so the flush sees all of them or none.
+//
+bool System::commitNVSValues(SYS_NVSNamespace *ns, const SYS_NVSStagedValue *values, uint8_t count)
 {
-    if (nvsHandle == 0)
-    {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) != pdTRUE)
         return false;
+
+    bool blnResult = true;
+    bool blnDirtied = false;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (values[i].blnErase)
+        {
+            if (!applyNVSErase(ns, values[i].key, &blnDirtied))
+                blnResult = false;
+        }
+        else if (!applyNVSWrite(ns, values[i].key, values[i].type, values[i].value, &values[i].strValue, &blnDirtied))
+            blnResult = false;
     }
-    else
+    xSemaphoreGive(nvsCacheMutex);
+
+    if (blnDirtied)
+        scheduleNVSFlush();
+    return blnResult;
+}
+
+void System::recordNVSLock(SYS_NVSNamespace *ns, int64_t waitUs, int64_t holdUs, bool blnContended, bool blnCommitted, bool blnRolledBack)
+{
+    auto stats = &ns->lockStats;
+
+    portENTER_CRITICAL(&nvsLockMux);
+    stats->acquires++;
+    ns->holdTotal += holdUs;
+    stats->holdAvgUs = (uint32_t)(ns->holdTotal / stats->acquires);
+
+    if (holdUs > stats->holdMaxUs)
+        stats->holdMaxUs = (uint32_t)holdUs;
+
+    if (waitUs > stats->waitMaxUs)
+        stats->waitMaxUs = (uint32_t)waitUs;
+
+    if (blnContended)
+        stats->contended++;
+
+    if (blnCommitted)
+        stats->commits++;
+
+    if (blnRolledBack)
+        stats->rollbacks++;
+    portEXIT_CRITICAL(&nvsLockMux);
+}
+
+void System::getNVSLockStats(SYS_NVSLockStats *stats)
+{
+    uint64_t holdTotal = 0;
+    *stats = {};
+
+    portENTER_CRITICAL(&nvsLockMux);
+    for (auto &ns : nvsNamespaces)
     {
-        esp_err_t rc;
+        if (!ns.inUse)
+            continue;
 
-        if (showNVMDebug)
-            ESP_LOGW(TAG, "saveU16IntegerToNVS is key/value %s %d", key, intValue);
+        stats->acquires += ns.lockStats.acquires;
+        stats->contended += ns.lockStats.contended;
+        stats->timeouts += ns.lockStats.timeouts;
+        stats->readers += ns.lockStats.readers;
+        stats->commits += ns.lockStats.commits;
+        stats->rollbacks += ns.lockStats.rollbacks;
+        holdTotal += ns.holdTotal;
 
-        rc = nvs_set_u16(nvsHandle, key, intValue);
+        if (ns.lockStats.holdMaxUs > stats->holdMaxUs)
+            stats->holdMaxUs = ns.lockStats.holdMaxUs;
 
-        if (rc != ESP_OK)
-        {
-            ESP_LOGE(TAG, "saveU16IntegerToNVS failed esp_err_t code = %s", esp_err_to_name(rc));
-            return false;
-        }
-        else
+        if (ns.lockStats.waitMaxUs > stats->waitMaxUs)
+            stats->waitMaxUs = ns.lockStats.waitMaxUs;
+    }
+    portEXIT_CRITICAL(&nvsLockMux);
+
+    if (stats->acquires > 0)
+        stats->holdAvgUs = (uint32_t)(holdTotal / stats->acquires);
+}
+
+bool System::getNVSLockStats(const char *name_space, SYS_NVSLockStats *stats)
+{
+    *stats = {};
+
+    for (auto &ns : nvsNamespaces)
+    {
+        if (ns.inUse && (strcmp(ns.name, name_space) == 0))
         {
-            if (showNVMDebug)
-                ESP_LOGW(TAG, "Saved key/value %s / %d", key, intValue); // Debug print statements
+            portENTER_CRITICAL(&nvsLockMux);
+            *stats = ns.lockStats;
+            portEXIT_CRITICAL(&nvsLockMux);
             return true;
         }
     }
+    return false;
 }
 
-uint16_t System::retrieveLengthOfStringInNVM(const char *key)
+//
+// One line per namespace shows where writers actually collide.
+//
+void System::logNVSLockStats(void)
 {
-    esp_err_t rc;
-    size_t required_size = 0;
+    SYS_NVSLockStats stats;
 
-    if (nvsHandle == 0)
+    for (auto &ns : nvsNamespaces)
     {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
-        return false;
+        if (!ns.inUse || !getNVSLockStats(ns.name, &stats))
+            continue;
+
+        ESP_LOGI(TAG, "NVS %s acquires %d  contended %d  timeouts %d  readers %d  commits %d  rollbacks %d", ns.name,
+                 stats.acquires, stats.contended, stats.timeouts, stats.readers, stats.commits, stats.rollbacks);
+        ESP_LOGI(TAG, "NVS %s hold avg %d us  max %d us  wait max %d us", ns.name, stats.holdAvgUs, stats.holdMaxUs,
+                 stats.waitMaxUs);
     }
-    else
+}
+
+void System::onNVSShutdown(void)
+{
+    System::getInstance().flushNVSCache();
+}
+
+/* NvsTransaction */
+NvsTransaction::NvsTransaction(const char *name_space, SYS_NVS_MODE mode, TickType_t timeout)
+{
+    sys = &System::getInstance();
+    ns = sys->getNVSNamespace(name_space);
+
+    if (ns == nullptr)
+        return;
+
+    if (mode == SYS_NVS_MODE::ReadOnly) // Reads only touch the cache, which has its own mutex
+    {
+        portENTER_CRITICAL(&sys->nvsLockMux);
+        ns->lockStats.readers++;
+        portEXIT_CRITICAL(&sys->nvsLockMux);
+
+        blnReadOnly = true;
+        blnOpen = true;
+        return;
+    }
+
+    auto start = esp_timer_get_time();
+
+    if (xSemaphoreTake(ns->mutex, 0) != pdTRUE) // Another writer has this namespace
     {
-        rc = nvs_get_str(nvsHandle, key, NULL, &required_size);
-        if (showNVMDebug)
-            ESP_LOGI(TAG, "retrieveLengthOfStringInNVM key = %s is of size %d", key, required_size);
+        blnContended = true;
 
-        if (rc != ESP_OK)
+        if (xSemaphoreTake(ns->mutex, timeout) != pdTRUE) // Never carry on without the lock
         {
-            if (rc == ESP_ERR_NVS_NOT_FOUND)
-                ESP_LOGI(TAG, "VALUE NOT FOUND IN NVM");
-            else
-                ESP_LOGI(TAG, "Error in  retrieveLengthOfStringInNVM code = %s", esp_err_to_name(rc));
+            portENTER_CRITICAL(&sys->nvsLockMux);
+            ns->lockStats.timeouts++;
+            portEXIT_CRITICAL(&sys->nvsLockMux);
+            return;
         }
     }
-    if (showNVMDebug)
-        ESP_LOGW(TAG, "retrieveLengthOfStringInNVM required_size is %d", required_size);
-    return required_size;
+
+    lockTime = esp_timer_get_time();
+    waitUs = lockTime - start;
+    blnOpen = true;
 }
 
-bool System::retrieveStringWithKeyFromNVS(const char *key, char *value, size_t *valLength)
+NvsTransaction::~NvsTransaction(void)
 {
-    esp_err_t rc;
+    if (!blnOpen || blnReadOnly)
+        return;
 
-    if (nvsHandle == 0)
-    {
-        ESP_LOGE(TAG, "You must openNVStorage() first!");
+    bool blnRolledBack = (stagedCount > 0); // Anything still staged was never committed
+    stagedCount = 0;
+
+    auto holdUs = esp_timer_get_time() - lockTime;
+    xSemaphoreGive(ns->mutex);
+
+    sys->recordNVSLock(ns, waitUs, holdUs, blnContended, blnCommitted, blnRolledBack);
+}
+
+bool NvsTransaction::getBool(const char *key, bool *blnValue)
+{
+    uint16_t value = 0;
+
+    if (!getValue(key, SYS_NVS_TYPE::U8, &value, nullptr))
         return false;
+
+    *blnValue = (value == 1);
+    return true;
+}
+
+bool NvsTransaction::getU8(const char *key, uint8_t *intValue)
+{
+    uint16_t value = 0;
+
+    if (!getValue(key, SYS_NVS_TYPE::U8, &value, nullptr))
+        return false;
+
+    *intValue = (uint8_t)value;
+    return true;
+}
+
+bool NvsTransaction::getU16(const char *key, uint16_t *intValue)
+{
+    return getValue(key, SYS_NVS_TYPE::U16, intValue, nullptr);
+}
+
+bool NvsTransaction::getString(const char *key, std::string *strValue)
+{
+    return getValue(key, SYS_NVS_TYPE::String, nullptr, strValue);
+}
+
+bool NvsTransaction::setBool(const char *key, bool blnValue)
+{
+    return setValue(key, SYS_NVS_TYPE::U8, blnValue ? 1 : 0, nullptr);
+}
+
+bool NvsTransaction::setU8(const char *key, uint8_t intValue)
+{
+    return setValue(key, SYS_NVS_TYPE::U8, intValue, nullptr);
+}
+
+bool NvsTransaction::setU16(const char *key, uint16_t intValue)
+{
+    return setValue(key, SYS_NVS_TYPE::U16, intValue, nullptr);
+}
+
+bool NvsTransaction::setString(const char *key, const std::string &strValue)
+{
+    return setValue(key, SYS_NVS_TYPE::String, 0, &strValue);
+}
+
+bool NvsTransaction::getBlob(const char *key, void *data, size_t *length)
+{
+    return getBytes(key, SYS_NVS_TYPE::Blob, data, length);
+}
+
+bool NvsTransaction::getString(const char *key, char *buffer, size_t *length)
+{
+    return getBytes(key, SYS_NVS_TYPE::String, buffer, length);
+}
+
+bool NvsTransaction::getStringLength(const char *key, size_t *length)
+{
+    return getBytes(key, SYS_NVS_TYPE::String, nullptr, length);
+}
+
+bool NvsTransaction::setBlob(const char *key, const void *data, size_t length)
+{
+    std::string bytes((const char *)data, length);
+    return setValue(key, SYS_NVS_TYPE::Blob, 0, &bytes);
+}
+
+bool NvsTransaction::erase(const char *key)
+{
+    return setValue(key, SYS_NVS_TYPE::None, 0, nullptr);
+}
+
+//
+// Hands every staged value to the cache at once.  The transaction stays open (and keeps the lock) until it goes out of scope.
+//
+bool NvsTransaction::commit(void)
+{
+    if (!blnOpen || blnReadOnly)
+        return false;
+
+    bool blnResult = sys->commitNVSValues(ns, staged, stagedCount);
+
+    for (uint8_t i = 0; i < stagedCount; i++)
+        staged[i].strValue.clear();
+
+    stagedCount = 0;
+    blnCommitted = true;
+    return blnResult;
+}
+
+bool NvsTransaction::commit(SYS_NVSDoneCallback callback, void *ctx)
+{
+    if (!commit())
+        return false;
+
+    return sys->requestNVSFlush(callback, ctx);
+}
+
+bool NvsTransaction::isNamespace(const char *other)
+{
+    return (ns != nullptr) && (strcmp(other, ns->name) == 0);
+}
+
+//
+// One staged slot per key.  Every set or erase overwrites it, so the last call made is the one commit() applies.
+//
+SYS_NVSStagedValue *NvsTransaction::findStaged(const char *key)
+{
+    for (uint8_t i = 0; i < stagedCount; i++)
+    {
+        if (strcmp(staged[i].key, key) == 0)
+            return &staged[i];
     }
-    else
+    return nullptr;
+}
+
+bool NvsTransaction::getValue(const char *key, SYS_NVS_TYPE type, uint16_t *value, std::string *strValue)
+{
+    if (!blnOpen)
+        return false;
+
+    auto entry = findStaged(key); // We read our own staged writes
+
+    if (entry != nullptr)
     {
-        if (showNVMDebug)
-            ESP_LOGI(TAG, "retrieveStringWithKeyFromNVS requires %d size to store value of %s", *valLength, key);
-        rc = nvs_get_str(nvsHandle, key, value, valLength);
+        if (entry->blnErase || (entry->type != type)) // Staged erase, or staged as another type
+            return false;
 
-        if (rc == ESP_OK)
-        {
-            if (showNVMDebug)
-                ESP_LOGW(TAG, "Retrieved %s from NVS of %s", key, value); // Debug print statements
-        }
+        if (isNVSByteType(type))
+            *strValue = entry->strValue;
         else
-        {
-            ESP_LOGE(TAG, "nvs_get_str failed for some reasone...");
-            return false;
-        }
+            *value = entry->value;
+        return true;
     }
+    return sys->readNVSValue(ns, key, type, value, strValue);
+}
 
-    return true;
+//
+// Span reads.  Staged values are served first, then the cache.  Nothing is allocated.
+//
+bool NvsTransaction::getBytes(const char *key, SYS_NVS_TYPE type, void *buffer, size_t *length)
+{
+    auto entry = blnOpen ? findStaged(key) : nullptr;
+
+    if (!blnOpen || ((entry != nullptr) && (entry->blnErase || (entry->type != type))))
+    {
+        *length = 0;
+        return false;
+    }
+
+    if (entry == nullptr)
+        return sys->readNVSBytes(ns, key, type, buffer, length);
+
+    auto bytes = entry->strValue.size();
+    auto size = bytes + ((type == SYS_NVS_TYPE::String) ? 1 : 0);
+    bool blnResult = (buffer == nullptr);
+
+    if ((buffer != nullptr) && (size <= *length))
+    {
+        memcpy(buffer, entry->strValue.data(), bytes);
+
+        if (type == SYS_NVS_TYPE::String)
+            ((char *)buffer)[bytes] = 0;
+        blnResult = true;
+    }
+    *length = size;
+    return blnResult;
 }
 
-void System::closeNVStorage(bool blnCommit)
+bool NvsTransaction::setValue(const char *key, SYS_NVS_TYPE type, uint16_t value, const std::string *strValue)
 {
-    esp_err_t rc;
+    if (!blnOpen || blnReadOnly || (strlen(key) >= NVS_KEY_NAME_MAX_SIZE))
+        return false;
+
+    auto entry = findStaged(key);
 
-    if (nvsHandle != 0)
+    if (entry == nullptr)
     {
-        if (blnCommit)
-        {
-            rc = nvs_commit(nvsHandle);
+        if (stagedCount >= SYS_NVS_TXN_MAX_STAGED)
+            return false;
 
-            if (rc != ESP_OK)
-                ESP_LOGI(TAG, "Error(%s) committing to NVS!", esp_err_to_name(rc));
-        }
-        nvs_close(nvsHandle);
-        nvsHandle = 0;
+        entry = &staged[stagedCount++];
+        strcpy(entry->key, key);
     }
+
+    entry->type = type;
+    entry->blnErase = (type == SYS_NVS_TYPE::None); // erase() stages the None type
+    entry->value = value;
+
+    if (isNVSByteType(type))
+        entry->strValue = *strValue;
+    else
+        entry->strValue.clear();
+    return true;
 }
@@ -0,0 +1,605 @@
+#include "system.hpp"
+
+#include "esp_rom_crc.h"
+
+//
+// NVS Images
+//
+// Export walks the chosen namespaces with the NVS iterator and streams them to a writer as one image.  Import checks each
+// record as it arrives and stages it, up to SYS_NVS_IMAGE_MAX_STAGED bytes.  Nothing reaches flash until the trailer has
+// checked out, and the flush is only held while the staged records are written and committed.  The format is described
+// with SYS_NVS_RECORD in system_defs.hpp.
+//
+static void putRecordName(std::string *record, SYS_NVS_RECORD tag, const char *name)
+{
+    auto length = strlen(name);
+
+    record->push_back((char)tag);
+    record->push_back((char)length);
+    record->append(name, length);
+}
+
+static void putRecordU16(std::string *record, uint16_t value)
+{
+    record->push_back((char)(value & 0xFF));
+    record->push_back((char)(value >> 8));
+}
+
+static bool writeImageRecord(const std::string &record, SYS_NVSImageWriter writer, void *ctx, uint32_t *crc, SYS_NVSImageStats *stats)
+{
+    *crc = esp_rom_crc32_le(*crc, (const uint8_t *)record.data(), record.size());
+    stats->bytes += record.size();
+    return writer(ctx, (const uint8_t *)record.data(), record.size());
+}
+
+//
+// The cache is flushed first so flash holds everything we know about.  Value types the image has no record for (the
+// signed and 32/64 bit integers) are counted as skipped.
+//
+bool System::exportNVS(const char *const *namespaces, uint8_t count, SYS_NVSImageWriter writer, void *ctx, SYS_NVSImageStats *result)
+{
+    SYS_NVSImageStats stats = {};
+    auto start = esp_timer_get_time();
+
+    if (!flushNVSCache())
+        ESP_LOGW(TAG, "exportNVS -- flush failed.  Unwritten values are not in the image.");
+
+    uint32_t crc = 0;
+    std::string record = {'S', 'N', 'V', (char)SYS_NVS_IMAGE_VERSION};
+    std::string value;
+    bool blnResult = writeImageRecord(record, writer, ctx, &crc, &stats);
+
+    for (uint8_t i = 0; blnResult && (i < count); i++)
+    {
+        nvs_handle_t handle = 0;
+
+        if (nvs_open(namespaces[i], NVS_READONLY, &handle) != ESP_OK) // Never written -- nothing to export
+            continue;
+
+        record.clear();
+        putRecordName(&record, SYS_NVS_RECORD::Namespace, namespaces[i]);
+        blnResult = writeImageRecord(record, writer, ctx, &crc, &stats);
+        stats.namespaces++;
+
+        nvs_entry_info_t info;
+        auto it = nvs_entry_find(NVS_DEFAULT_PART_NAME, namespaces[i], NVS_TYPE_ANY);
+
+        while (blnResult && (it != NULL))
+        {
+            nvs_entry_info(it, &info);
+            it = nvs_entry_next(it); // Releases the iterator after the last entry
+
+            esp_err_t rc = ESP_OK;
+            record.clear();
+
+            switch (info.type)
+            {
+            case NVS_TYPE_U8:
+            {
+                uint8_t val = 0;
+                rc = nvs_get_u8(handle, info.key, &val);
+                putRecordName(&record, SYS_NVS_RECORD::U8, info.key);
+                record.push_back((char)val);
+                break;
+            }
+
+            case NVS_TYPE_U16:
+            {
+                uint16_t val = 0;
+                rc = nvs_get_u16(handle, info.key, &val);
+                putRecordName(&record, SYS_NVS_RECORD::U16, info.key);
+                putRecordU16(&record, val);
+                break;
+            }
+
+            case NVS_TYPE_STR:
+            case NVS_TYPE_BLOB:
+            {
+                bool blnString = (info.type == NVS_TYPE_STR);
+                size_t length = 0;
+
+                rc = blnString ? nvs_get_str(handle, info.key, NULL, &length) : nvs_get_blob(handle, info.key, NULL, &length);
+
+                if (rc != ESP_OK)
+                    break;
+
+                value.resize(length);
+
+                if (length > 0)
+                    rc = blnString ? nvs_get_str(handle, info.key, &value[0], &length) : nvs_get_blob(handle, info.key, &value[0], &length);
+
+                if (blnString && (length > 0))
+                    value.resize(length - 1); // The image carries no terminator
+
+                if (value.size() > SYS_NVS_IMAGE_MAX_VALUE) // An import could not take it
+                {
+                    ESP_LOGW(TAG, "exportNVS -- %s/%s is too large for an image", namespaces[i], info.key);
+                    stats.skipped++;
+                    continue;
+                }
+
+                putRecordName(&record, blnString ? SYS_NVS_RECORD::String : SYS_NVS_RECORD::Blob, info.key);
+                putRecordU16(&record, (uint16_t)value.size());
+                record.append(value);
+                break;
+            }
+
+            default:
+                stats.skipped++;
+                continue;
+            }
+
+            if (rc != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Error(%s) exporting %s/%s", esp_err_to_name(rc), namespaces[i], info.key);
+                blnResult = false;
+                break;
+            }
+
+            blnResult = writeImageRecord(record, writer, ctx, &crc, &stats);
+            stats.keys++;
+        }
+
+        if (it != NULL) // Stopped early
+            nvs_release_iterator(it);
+        nvs_close(handle);
+    }
+
+    if (blnResult)
+    {
+        record.clear();
+        record.push_back((char)SYS_NVS_RECORD::End);
+        putRecordU16(&record, stats.keys);
+        crc = esp_rom_crc32_le(crc, (const uint8_t *)record.data(), record.size());
+
+        for (uint8_t i = 0; i < 4; i++)
+            record.push_back((char)((crc >> (8 * i)) & 0xFF));
+
+        stats.bytes += record.size();
+        blnResult = writer(ctx, (const uint8_t *)record.data(), record.size());
+    }
+
+    stats.elapsedUs = (uint32_t)(esp_timer_get_time() - start);
+
+    if (result != nullptr)
+        *result = stats;
+
+    if (!blnResult)
+        ESP_LOGE(TAG, "Error, exportNVS stopped after %d keys", stats.keys);
+    return blnResult;
+}
+
+//
+// An image embedded in the firmware.  It is checked end to end while it is staged, so a corrupt or truncated image never
+// touches flash.  Only a flash error can stop the import part way.
+//
+bool System::importNVS(const uint8_t *data, size_t length, SYS_NVSImageStats *result)
+{
+    SYS_NVSImageStats stats = {};
+    NvsImport import;
+
+    import.feed(data, length); // A bad image is remembered and finish() turns it away
+    bool blnResult = import.finish(&stats);
+
+    if (result != nullptr)
+        *result = stats;
+
+    if (blnResult)
+        ESP_LOGI(TAG, "NVS import %d keys in %d namespaces (%d bytes) in %d us", stats.keys, stats.namespaces, stats.bytes, stats.elapsedUs);
+    else
+        ESP_LOGE(TAG, "Error, NVS image rejected after %d keys", stats.keys);
+    return blnResult;
+}
+
+//
+// Reads until the trailer arrives or the sender has been quiet for idle ticks.  The flush is not held while we wait on
+// the sender, and an image that stops short or fails its CRC leaves flash exactly as it was.
+//
+bool System::importNVSFromUART(uart_port_t port, TickType_t idle, SYS_NVSImageStats *result)
+{
+    SYS_NVSImageStats stats = {};
+    NvsImport import;
+    uint8_t buffer[128];
+
+    while (!import.isComplete())
+    {
+        auto length = uart_read_bytes(port, buffer, sizeof(buffer), idle);
+
+        if (length <= 0) // Quiet -- or no driver installed on this port
+            break;
+
+        if (!import.feed(buffer, (size_t)length))
+            break;
+    }
+
+    bool blnResult = import.finish(&stats);
+
+    if (result != nullptr)
+        *result = stats;
+
+    if (blnResult)
+        ESP_LOGI(TAG, "NVS import %d keys in %d namespaces (%d bytes) in %d us", stats.keys, stats.namespaces, stats.bytes, stats.elapsedUs);
+    else
+        ESP_LOGE(TAG, "Error, NVS image from UART%d rejected after %d keys", port, stats.keys);
+    return blnResult;
+}
+
+//
+// Writes one imported value to flash.  The cache is left alone until the whole image has been written (reloadNVSValue).
+// Must be called with nvsFlushMutex held.
+//
+bool System::importNVSValue(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type, uint16_t value, const std::string &strValue)
+{
+    auto handle = getNVSHandle(ns, true);
+
+    if (handle == 0)
+        return false;
+
+    esp_err_t rc = ESP_OK;
+
+    switch (type)
+    {
+    case SYS_NVS_TYPE::U8:
+        rc = nvs_set_u8(handle, key, (uint8_t)value);
+        break;
+    case SYS_NVS_TYPE::U16:
+        rc = nvs_set_u16(handle, key, value);
+        break;
+    case SYS_NVS_TYPE::String:
+        rc = nvs_set_str(handle, key, strValue.c_str());
+        break;
+    case SYS_NVS_TYPE::Blob:
+        rc = nvs_set_blob(handle, key, strValue.data(), strValue.size());
+        break;
+    default:
+        rc = ESP_ERR_INVALID_ARG;
+        break;
+    }
+
+    if (rc != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Error(%s) importing %s/%s", esp_err_to_name(rc), ns->name, key);
+        return false;
+    }
+
+    xSemaphoreTake(nvsCacheMutex, portMAX_DELAY);
+    nvsCacheStats.flashWrites++;
+    xSemaphoreGive(nvsCacheMutex);
+    return true;
+}
+
+//
+// Brings one cached key in line with an import.  A cached value -- even a dirty one -- is replaced by what flash now holds.
+// Must be called with nvsFlushMutex and nvsCacheMutex held.
+//
+void System::reloadNVSValue(SYS_NVSNamespace *ns, const char *key, SYS_NVS_TYPE type)
+{
+    auto entry = lookupNVSEntry(ns, key, nullptr);
+
+    if (entry == nullptr)
+    {
+        ns->blnPreloaded = false; // A key we do not hold may now be in flash
+        return;
+    }
+
+    entry->type = type;
+    entry->dirty = false;
+    entry->version++;
+    loadNVSEntry(entry);
+}
+
+//
+// Splits a record that recordLength() has passed.  Returns None for a namespace record, whose name comes back in name.
+//
+static SYS_NVS_TYPE decodeImageRecord(const uint8_t *record, char *name, uint16_t *intValue, std::string *value)
+{
+    auto tag = (SYS_NVS_RECORD)record[0];
+    auto body = record + 2 + record[1];
+
+    memcpy(name, record + 2, record[1]);
+    name[record[1]] = 0;
+
+    switch (tag)
+    {
+    case SYS_NVS_RECORD::U8:
+        *intValue = body[0];
+        return SYS_NVS_TYPE::U8;
+
+    case SYS_NVS_RECORD::U16:
+        *intValue = body[0] | (body[1] << 8);
+        return SYS_NVS_TYPE::U16;
+
+    case SYS_NVS_RECORD::String:
+    case SYS_NVS_RECORD::Blob:
+        value->assign((const char *)body + 2, body[0] | (body[1] << 8));
+        return (tag == SYS_NVS_RECORD::String) ? SYS_NVS_TYPE::String : SYS_NVS_TYPE::Blob;
+
+    default:
+        return SYS_NVS_TYPE::None;
+    }
+}
+
+/* NvsImport */
+NvsImport::NvsImport(TickType_t timeout, bool blnCheckOnly)
+{
+    sys = &System::getInstance();
+    lockTimeout = timeout;
+    blnVerifyOnly = blnCheckOnly;
+    blnOpen = (sys->nvsFlushMutex != nullptr);
+    start = esp_timer_get_time();
+}
+
+bool NvsImport::feed(const uint8_t *data, size_t length)
+{
+    if (!blnOpen || blnFailed)
+        return false;
+
+    if (blnEnd) // Nothing may follow the trailer
+        return (length == 0) || fail();
+
+    stats.bytes += length;
+
+    //
+    // A chunk that starts on a record boundary is parsed where it lies.  Only a record split across chunks is copied.
+    //
+    const uint8_t *view = data;
+    size_t size = length;
+
+    if (!pending.empty())
+    {
+        pending.append((const char *)data, length);
+        view = (const uint8_t *)pending.data();
+        size = pending.size();
+    }
+
+    size_t offset = 0;
+
+    while (!blnEnd)
+    {
+        auto record = recordLength(view + offset, size - offset);
+
+        if (record == 0)
+            break;
+
+        if (!checkRecord(view + offset, record))
+            return false;
+
+        offset += record;
+    }
+
+    if (blnFailed || (blnEnd && (offset < size)))
+        return fail();
+
+    if (view == data)
+        pending.assign((const char *)data + offset, size - offset);
+    else
+        pending.erase(0, offset);
+    return true;
+}
+
+//
+// Checks the trailer, then writes what was staged and commits every namespace the image touched -- once each.  The flush
+// is held from the first write until the cache has taken the imported values, so SYS::NVS can never write an older cached
+// value over one of them.
+//
+bool NvsImport::finish(SYS_NVSImageStats *result)
+{
+    if (!blnOpen)
+        return false;
+
+    bool blnResult = !blnFailed && blnEnd && (imageCRC == crc) && (imageValues == stats.keys) &&
+                     sys->hasNVSNamespaceRoom(names, nameCount);
+
+    if (blnResult && !blnVerifyOnly && !blnWritten)
+    {
+        blnWritten = true; // Whatever happens, a second finish() writes nothing
+
+        for (uint8_t i = 0; blnResult && (i < nameCount); i++)
+        {
+            namespaces[i] = sys->getNVSNamespace(names[i]);
+            blnResult = (namespaces[i] != nullptr);
+        }
+
+        if (blnResult && (xSemaphoreTake(sys->nvsFlushMutex, lockTimeout) == pdTRUE))
+        {
+            blnResult = writeStaged();
+
+            for (uint8_t i = 0; i < nameCount; i++)
+            {
+                if ((namespaces[i]->writeHandle != 0) && (nvs_commit(namespaces[i]->writeHandle) != ESP_OK))
+                    blnResult = false;
+            }
+
+            reloadStaged(); // Only now does the rest of the firmware see the imported values
+            xSemaphoreGive(sys->nvsFlushMutex);
+        }
+        else
+            blnResult = false;
+
+        std::string().swap(staged);
+    }
+
+    stats.elapsedUs = (uint32_t)(esp_timer_get_time() - start);
+
+    if (result != nullptr)
+        *result = stats;
+    return blnResult;
+}
+
+size_t NvsImport::recordLength(const uint8_t *data, size_t size)
+{
+    if (!blnHeader)
+        return (size >= SYS_NVS_IMAGE_HEADER_SIZE) ? SYS_NVS_IMAGE_HEADER_SIZE : 0;
+
+    if (size < 2)
+        return 0;
+
+    auto tag = (SYS_NVS_RECORD)data[0];
+
+    if (tag == SYS_NVS_RECORD::End)
+        return (size >= 7) ? 7 : 0;
+
+    if ((tag > SYS_NVS_RECORD::Blob) || (data[1] == 0) || (data[1] >= NVS_KEY_NAME_MAX_SIZE))
+    {
+        fail();
+        return 0;
+    }
+
+    size_t length = 2 + data[1];
+
+    switch (tag)
+    {
+    case SYS_NVS_RECORD::U8:
+        length += 1;
+        break;
+
+    case SYS_NVS_RECORD::U16:
+        length += 2;
+        break;
+
+    case SYS_NVS_RECORD::String:
+    case SYS_NVS_RECORD::Blob:
+    {
+        if (size < length + 2)
+            return 0;
+
+        size_t valueLength = data[length] | (data[length + 1] << 8);
+
+        if (valueLength > SYS_NVS_IMAGE_MAX_VALUE)
+        {
+            fail();
+            return 0;
+        }
+        length += 2 + valueLength;
+        break;
+    }
+
+    default:
+        break;
+    }
+    return (size >= length) ? length : 0;
+}
+
+//
+// Checks one record and stages it.  Namespaces are only collected by name here -- the pool is not touched until finish().
+//
+bool NvsImport::checkRecord(const uint8_t *record, size_t length)
+{
+    if (!blnHeader)
+    {
+        if ((record[0] != 'S') || (record[1] != 'N') || (record[2] != 'V') || (record[3] != SYS_NVS_IMAGE_VERSION))
+            return fail();
+
+        crc = esp_rom_crc32_le(crc, record, length);
+        blnHeader = true;
+        return true;
+    }
+
+    auto tag = (SYS_NVS_RECORD)record[0];
+
+    if (tag == SYS_NVS_RECORD::End)
+    {
+        crc = esp_rom_crc32_le(crc, record, 3);
+        imageValues = record[1] | (record[2] << 8);
+        imageCRC = record[3] | (record[4] << 8) | (record[5] << 16) | ((uint32_t)record[6] << 24);
+        blnEnd = true;
+        return true;
+    }
+
+    crc = esp_rom_crc32_le(crc, record, length);
+
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    uint16_t intValue = 0;
+
+    if (decodeImageRecord(record, name, &intValue, &value) == SYS_NVS_TYPE::None)
+    {
+        if (findName(name) < 0)
+        {
+            if (nameCount == SYS_NVS_MAX_NAMESPACES) // More than the pool could ever hold
+                return fail();
+
+            strcpy(names[nameCount++], name);
+        }
+
+        blnNamespace = true;
+        stats.namespaces++;
+    }
+    else if (!blnNamespace) // A value before any namespace
+        return fail();
+    else
+        stats.keys++;
+
+    if (blnVerifyOnly)
+        return true;
+
+    if (staged.size() + length > SYS_NVS_IMAGE_MAX_STAGED)
+        return fail();
+
+    staged.append((const char *)record, length);
+    return true;
+}
+
+//
+// The staged records have all been checked, so they are walked without any checks of their own.
+//
+bool NvsImport::writeStaged(void)
+{
+    SYS_NVSNamespace *ns = nullptr;
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    uint16_t intValue = 0;
+    size_t offset = 0;
+
+    while (offset < staged.size())
+    {
+        auto record = (const uint8_t *)staged.data() + offset;
+        auto type = decodeImageRecord(record, name, &intValue, &value);
+
+        offset += recordLength(record, staged.size() - offset);
+
+        if (type == SYS_NVS_TYPE::None)
+            ns = namespaces[findName(name)];
+        else if (!sys->importNVSValue(ns, name, type, intValue, value))
+            return false;
+    }
+    return true;
+}
+
+void NvsImport::reloadStaged(void)
+{
+    SYS_NVSNamespace *ns = nullptr;
+    char name[NVS_KEY_NAME_MAX_SIZE];
+    uint16_t intValue = 0;
+    size_t offset = 0;
+
+    xSemaphoreTake(sys->nvsCacheMutex, portMAX_DELAY);
+
+    while (offset < staged.size())
+    {
+        auto record = (const uint8_t *)staged.data() + offset;
+        auto type = decodeImageRecord(record, name, &intValue, &value);
+
+        offset += recordLength(record, staged.size() - offset);
+
+        if (type == SYS_NVS_TYPE::None)
+            ns = namespaces[findName(name)];
+        else
+            sys->reloadNVSValue(ns, name, type);
+    }
+    xSemaphoreGive(sys->nvsCacheMutex);
+}
+
+int8_t NvsImport::findName(const char *name)
+{
+    for (uint8_t i = 0; i < nameCount; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+bool NvsImport::fail(void)
+{
+    blnFailed = true;
+    return false;
+}
@@ -0,0 +1,207 @@
+#include "system.hpp"
+
+//
+// NVS Persistence Task
+//
+// Writers only ever touch the RAM cache.  SYS::NVS runs below every other System task and is the only place flash is written
+// in normal operation, so a button press on SYS::GPIO or a transaction on any other task never waits on an erase or commit.
+//
+// The cache already merges repeated writes to a key into one dirty entry, so the queue does not carry values -- only a
+// Dirty nudge (wait out the quiet period) or a Flush request (write now, then report).  Every request waiting in the queue
+// when we wake is answered by the same flush.
+//
+// Log store compaction runs here as well.  It erases flash too, and nothing that keeps time should wait for that.
+//
+void System::runNVSTaskMarshaller(void *arg)
+{
+    auto obj = (System *)arg;
+    obj->runNVSTask();
+
+    auto temp = obj->taskHandleSystemNVS;
+    obj->taskHandleSystemNVS = nullptr;
+    vTaskDelete(temp);
+}
+
+void System::runNVSTask(void)
+{
+    SYS_NVSRequest request = {};
+    SYS_NVSRequest waiting[SYS_NVS_REQUEST_QUEUE_SIZE] = {};
+
+    while (true)
+    {
+        auto wait = getNVSFlushWait();
+        bool blnFlush = false;
+        bool blnCompact = false;
+        uint8_t count = 0;
+
+        if (xQueueReceive(nvsRequestQue, &request, wait) == pdTRUE)
+        {
+            do
+            {
+                if (request.type == SYS_NVS_REQUEST::Compact)
+                    blnCompact = true;
+                else if (request.type == SYS_NVS_REQUEST::Flush)
+                {
+                    blnFlush = true;
+
+                    if (request.callback != nullptr)
+                        waiting[count++] = request;
+                }
+            } while ((count < SYS_NVS_REQUEST_QUEUE_SIZE) && (xQueueReceive(nvsRequestQue, &request, 0) == pdTRUE));
+        }
+
+        if (blnCompact)
+            logStore.compact();
+
+        if (!blnFlush)
+            blnFlush = (getNVSFlushWait() == 0); // The quiet period is over
+
+        if (!blnFlush)
+            continue;
+
+        bool blnResult = flushNVSCache();
+
+        for (uint8_t i = 0; i < count; i++)
+            waiting[i].callback(waiting[i].ctx, blnResult);
+    }
+}
+
+//
+// How long SYS::NVS may sleep.  Zero once the quiet period has run out, forever when nothing is dirty.
+//
+TickType_t System::getNVSFlushWait(void)
+{
+    int64_t deadline = 0;
+
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        deadline = nvsFlushDeadline;
+        xSemaphoreGive(nvsCacheMutex);
+    }
+
+    if (deadline == 0)
+        return portMAX_DELAY;
+
+    auto remaining = deadline - esp_timer_get_time();
+
+    if (remaining <= 0)
+        return 0;
+
+    return pdMS_TO_TICKS((remaining + 999) / 1000) + 1; // Round up so we never wake a tick early and go back to sleep
+}
+
+//
+// Tells SYS::NVS a quiet period has started.  Later writes only push the deadline out -- the task reads it again when it wakes,
+// so one nudge per quiet period is enough.
+//
+void System::scheduleNVSFlush(void)
+{
+    bool blnNotify = false;
+
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        if (!blnNVSFlushPending && (nvsFlushDeadline != 0))
+        {
+            blnNVSFlushPending = true;
+            blnNotify = true;
+        }
+        xSemaphoreGive(nvsCacheMutex);
+    }
+
+    if (!blnNotify)
+        return;
+
+    SYS_NVSRequest request = {};
+    request.type = SYS_NVS_REQUEST::Dirty;
+
+    if ((nvsRequestQue == nullptr) || (taskHandleSystemNVS == nullptr))
+        flushNVSCache(); // No persistence task -- write through
+    else
+        xQueueSend(nvsRequestQue, &request, 0); // A full queue means the task is already awake and will see the deadline
+}
+
+//
+// Writes everything dirty without waiting for the quiet period.  Returns at once -- the callback, if any, runs on SYS::NVS
+// once the flush that covers this request has finished.
+//
+bool System::requestNVSFlush(SYS_NVSDoneCallback callback, void *ctx)
+{
+    if ((nvsRequestQue == nullptr) || (taskHandleSystemNVS == nullptr))
+        return false;
+
+    SYS_NVSRequest request = {};
+    request.type = SYS_NVS_REQUEST::Flush;
+    request.callback = callback;
+    request.ctx = ctx;
+
+    if (xQueueSend(nvsRequestQue, &request, pdMS_TO_TICKS(SYS_NVS_LOCK_TIMEOUT_MS)) != pdTRUE)
+    {
+        ESP_LOGE(TAG, "Error, NVS request queue is full");
+        return false;
+    }
+
+    if (xSemaphoreTake(nvsCacheMutex, portMAX_DELAY) == pdTRUE)
+    {
+        nvsCacheStats.flushRequests++;
+        xSemaphoreGive(nvsCacheMutex);
+    }
+    return true;
+}
+
+void System::logNVSTaskStats(void)
+{
+    SYS_NVSCacheStats stats = {}; // Left as is if the cache mutex is not there
+    getNVSCacheStats(&stats);
+
+    ESP_LOGI(TAG, "NVS flush requests %d  flush max %d us  cache held max %d us  space waits %d", stats.flushRequests,
+             stats.flushMaxUs, stats.cacheHoldMaxUs, stats.spaceWaits);
+}
+
+//
+// Log store.  Sets go straight to the store on the calling task -- one small append -- and anything that needs an erase is
+// handed to SYS::NVS.
+//
+bool System::getHotValue(const char *key, void *value, size_t *length)
+{
+    return logStore.get(key, value, length);
+}
+
+bool System::setHotValue(const char *key, const void *value, size_t length)
+{
+    bool blnResult = logStore.set(key, value, length);
+
+    if (logStore.wantsCompaction())
+        requestLogCompaction();
+
+    return blnResult;
+}
+
+void System::getLogStoreStats(SYS_LogStoreStats *stats)
+{
+    logStore.getStats(stats);
+}
+
+void System::logLogStoreStats(void)
+{
+    SYS_LogStoreStats stats;
+    getLogStoreStats(&stats);
+
+    auto amplification = (stats.bytesRequested > 0) ? (float)stats.bytesWritten / stats.bytesRequested : 0.0f;
+
+    ESP_LOGI(TAG, "LOG sets %d  unchanged %d  keys %d  requested %d  written %d  amplification %.2f  errors %d", stats.sets,
+             stats.setsUnchanged, stats.liveKeys, stats.bytesRequested, stats.bytesWritten, amplification, stats.errors);
+    ESP_LOGI(TAG, "LOG compactions %d  copied %d  erases %d  wear %d..%d  free %d/%d  torn %d", stats.compactions,
+             stats.compactedBytes, stats.erases, stats.eraseMin, stats.eraseMax, stats.freeSectors, stats.sectors,
+             stats.tornRecords);
+}
+
+void System::requestLogCompaction(void)
+{
+    SYS_NVSRequest request = {};
+    request.type = SYS_NVS_REQUEST::Compact;
+
+    if ((nvsRequestQue == nullptr) || (taskHandleSystemNVS == nullptr))
+        logStore.compact();
+    else
+        xQueueSend(nvsRequestQue, &request, 0); // A full queue means the task is awake and will be asked again by the next set
+}
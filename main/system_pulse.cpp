@@ -0,0 +1,133 @@
+#include "system.hpp"
+
+#include "system_pulse.hpp"
+
+//
+// Pulse Counters
+//
+// Flow meters and tachometers put out edge trains far faster than we could queue one message per edge.  A counter pin gets
+// its own ISR handler which does nothing but count the edge and stamp it.  There is no ring push and no task notification,
+// so the cost per edge is the ISR service dispatch plus a few stores, which holds up into the tens of kHz.
+//
+// Every counter owns a periodic timer wheel job.  When a window closes the job hands the edge counts to closePulseWindow()
+// (system_pulse_window.cpp) and passes the reading to the callback on the SYS::TIMER task.
+//
+extern bool gpio_isr_service_started;
+
+//
+// Counters are claimed the same way as GPIO handlers.  Calls from other tasks are queued and applied by SYS::GPIO, so the
+// check that the pin is free and the claim can not race a handler being added.  A true return means the request was accepted.
+//
+bool System::registerPulseCounter(gpio_num_t pin, uint32_t window_ms, SYS_PulseCallback callback, void *ctx, gpio_int_type_t intrType)
+{
+    if (!gpio_isr_service_started || (window_ms == 0))
+        return false;
+
+    if (isGPIOConfigDeferred())
+    {
+        SYS_GPIOConfigRequest request = {};
+        request.type = SYS_GPIO_CONFIG::PulseCounter;
+        request.pin = (uint8_t)pin;
+        request.option = (uint8_t)intrType;
+        request.windowMs = window_ms;
+        request.pulseCallback = callback;
+        request.ctx = ctx;
+        return queueGPIOConfigRequest(request);
+    }
+
+    return addPulseCounter(pin, window_ms, callback, ctx, intrType);
+}
+
+bool System::addPulseCounter(gpio_num_t pin, uint32_t window_ms, SYS_PulseCallback callback, void *ctx, gpio_int_type_t intrType)
+{
+    if (isGPIOPinClaimed(pin))
+    {
+        ESP_LOGE(TAG, "Error, Pin %d already has a GPIO handler or pulse counter", pin);
+        return false;
+    }
+
+    SYS_PulseCounter *counter = nullptr;
+
+    portENTER_CRITICAL(&pulseCounterMux);
+    for (auto &entry : pulseCounters)
+    {
+        if (!entry.inUse)
+        {
+            counter = &entry;
+            break;
+        }
+    }
+
+    if (counter != nullptr)
+    {
+        *counter = {};
+        counter->pin = (uint8_t)pin;
+        counter->callback = callback;
+        counter->ctx = ctx;
+        counter->windowStart = esp_timer_get_time();
+        counter->jobID = SYS_TIMER_INVALID_JOB;
+        counter->inUse = true;
+    }
+    portEXIT_CRITICAL(&pulseCounterMux);
+
+    if (counter == nullptr)
+    {
+        ESP_LOGE(TAG, "Error, No free pulse counters for pin %d.  Raise SYS_GPIO_MAX_COUNTERS", pin);
+        return false;
+    }
+
+    gpio_config_t gpioCounter;
+    gpioCounter.pin_bit_mask = 1LL << pin;
+    gpioCounter.mode = GPIO_MODE_INPUT;
+    gpioCounter.pull_up_en = GPIO_PULLUP_ENABLE; // Most flow meters and fan tachs are open collector
+    gpioCounter.pull_down_en = GPIO_PULLDOWN_DISABLE;
+    gpioCounter.intr_type = intrType;
+    gpio_config(&gpioCounter);
+
+    if (gpio_isr_handler_add(pin, GPIOPulseIsrHandler, counter) != ESP_OK)
+    {
+        counter->inUse = false;
+        return false;
+    }
+
+    if (!schedulePeriodic((uint64_t)window_ms * 1000, &System::onPulseWindow, counter, &counter->jobID))
+    {
+        gpio_isr_handler_remove(pin);
+        counter->inUse = false;
+        return false;
+    }
+    return true;
+}
+
+bool System::getPulseReading(gpio_num_t pin, SYS_PulseReading *reading)
+{
+    bool blnFound = false;
+
+    portENTER_CRITICAL(&pulseCounterMux);
+    for (auto &counter : pulseCounters)
+    {
+        if (counter.inUse && (counter.pin == (uint8_t)pin))
+        {
+            *reading = counter.reading;
+            blnFound = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pulseCounterMux);
+    return blnFound;
+}
+
+void System::onPulseWindow(void *arg, uint32_t missed)
+{
+    auto counter = (SYS_PulseCounter *)arg;
+    auto reading = closePulseWindow(counter, esp_timer_get_time());
+
+    if (counter->callback != nullptr)
+        counter->callback(counter->ctx, counter->pin, reading);
+
+    auto obj = &System::getInstance();
+
+    if (obj->showPulseReadings)
+        ESP_LOGI(obj->TAG, "Pulse pin %d  count %d  total %llu  period %d us  freq %.2f Hz  window %d us", counter->pin, reading.count,
+                 reading.total, reading.periodUs, reading.frequencyHz, reading.windowUs);
+}
@@ -0,0 +1,73 @@
+#include "system_pulse.hpp"
+
+#include "esp_timer.h"
+
+//
+// Pulse Windows
+//
+// The ISR only counts and stamps edges.  closePulseWindow() swaps the counts out and works out period and frequency from the
+// stamps.  The period is measured from the last edge seen in any earlier window, so no edge interval is ever lost between
+// windows and signals slower than the window still read correctly in the windows that hold an edge.  Empty windows report a
+// count and period of zero.
+//
+portMUX_TYPE pulseCounterMux = portMUX_INITIALIZER_UNLOCKED;
+
+void IRAM_ATTR GPIOPulseIsrHandler(void *arg)
+{
+    auto counter = (SYS_PulseCounter *)arg;
+    auto now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&pulseCounterMux);
+    if (counter->edges == 0)
+        counter->firstEdge = now;
+    counter->lastEdge = now;
+    counter->edges = counter->edges + 1;
+    portEXIT_CRITICAL_ISR(&pulseCounterMux);
+}
+
+SYS_PulseReading closePulseWindow(SYS_PulseCounter *counter, int64_t now)
+{
+    portENTER_CRITICAL(&pulseCounterMux);
+    uint32_t edges = counter->edges;
+    int64_t firstEdge = counter->firstEdge;
+    int64_t lastEdge = counter->lastEdge;
+    counter->edges = 0;
+    portEXIT_CRITICAL(&pulseCounterMux);
+
+    SYS_PulseReading reading = {};
+    reading.count = edges;
+    reading.total = counter->reading.total + edges;
+    reading.windowUs = (uint32_t)(now - counter->windowStart);
+
+    if (edges > 0)
+    {
+        int64_t span = 0;
+        uint32_t intervals = 0;
+
+        if (counter->prevEdge != 0)
+        {
+            span = lastEdge - counter->prevEdge;
+            intervals = edges;
+        }
+        else
+        {
+            span = lastEdge - firstEdge;
+            intervals = edges - 1;
+        }
+
+        if ((intervals > 0) && (span > 0))
+        {
+            reading.periodUs = (uint32_t)(span / intervals);
+            reading.frequencyHz = (float)intervals * 1000000.0f / (float)span;
+        }
+        counter->prevEdge = lastEdge;
+    }
+
+    counter->windowStart = now;
+
+    portENTER_CRITICAL(&pulseCounterMux);
+    counter->reading = reading;
+    portEXIT_CRITICAL(&pulseCounterMux);
+
+    return reading;
+}
@@ -0,0 +1,126 @@
+#include "system.hpp"
+
+#include "esp_attr.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+//
+// Warm Resume
+//
+// The snapshot lives in RTC no-init memory, so nothing clears it across a warm reset and it is garbage after power-on.  The
+// CRC, the layout length and the firmware version together decide whether it can be trusted.  Every save reseals it, so a
+// reset in the middle of one leaves a snapshot that fails its CRC and the next boot is simply cold.
+//
+RTC_NOINIT_ATTR static SYS_ResumeSnapshot rtcSnapshot;
+
+static uint32_t getSnapshotCRC(void)
+{
+    auto bytes = (const uint8_t *)&rtcSnapshot + sizeof(rtcSnapshot.crc);
+    return esp_rom_crc32_le(0, bytes, sizeof(rtcSnapshot) - sizeof(rtcSnapshot.crc));
+}
+
+void System::initResume(void)
+{
+    auto reason = esp_reset_reason();
+
+    bool blnWarmReason = (reason == ESP_RST_SW) || (reason == ESP_RST_PANIC) || (reason == ESP_RST_INT_WDT) ||
+                         (reason == ESP_RST_TASK_WDT) || (reason == ESP_RST_WDT) || (reason == ESP_RST_DEEPSLEEP);
+
+    bool blnValid = (rtcSnapshot.magic == SYS_RESUME_MAGIC) && (rtcSnapshot.length == sizeof(rtcSnapshot)) &&
+                    (rtcSnapshot.major == APP_VERSION_MAJOR) && (rtcSnapshot.minor == APP_VERSION_MINOR) &&
+                    (rtcSnapshot.revision == APP_VERSION_REVISION) && (rtcSnapshot.indLength <= SYS_RESUME_IND_SIZE) &&
+                    (rtcSnapshot.crc == getSnapshotCRC());
+
+    blnWarmResume = blnWarmReason && blnValid && (rtcSnapshot.indLength > 0);
+
+    if (blnWarmResume)
+    {
+        rtcSnapshot.warmBoots++;
+    }
+    else
+    {
+        uint32_t coldRunUs = blnValid ? rtcSnapshot.coldRunUs : 0; // Kept for comparison while the snapshot is good
+
+        rtcSnapshot = {};
+        rtcSnapshot.magic = SYS_RESUME_MAGIC;
+        rtcSnapshot.length = sizeof(rtcSnapshot);
+        rtcSnapshot.major = APP_VERSION_MAJOR;
+        rtcSnapshot.minor = APP_VERSION_MINOR;
+        rtcSnapshot.revision = APP_VERSION_REVISION;
+        rtcSnapshot.coldRunUs = coldRunUs;
+    }
+    rtcSnapshot.crc = getSnapshotCRC();
+
+    if (showInit)
+        ESP_LOGI(TAG, "%s  reset reason %d  snapshot %s", blnWarmResume ? "Warm resume" : "Cold boot", reason,
+                 blnValid ? "valid" : "invalid");
+}
+
+bool System::isWarmResume(void)
+{
+    return blnWarmResume;
+}
+
+//
+// Only answers during a warm resume.  On a cold boot whatever is in the snapshot came from before the reset and the caller
+// must restore from NVS instead.
+//
+bool System::getResumeState(void *state, size_t *length)
+{
+    if (!blnWarmResume || (state == nullptr) || (length == nullptr))
+        return false;
+
+    bool blnResult = false;
+
+    portENTER_CRITICAL(&resumeMux);
+    if (*length >= rtcSnapshot.indLength)
+    {
+        memcpy(state, rtcSnapshot.ind, rtcSnapshot.indLength);
+        blnResult = true;
+    }
+    *length = rtcSnapshot.indLength;
+    portEXIT_CRITICAL(&resumeMux);
+
+    return blnResult;
+}
+
+void System::saveResumeState(const void *state, size_t length)
+{
+    if ((state == nullptr) || (length == 0) || (length > SYS_RESUME_IND_SIZE))
+        return;
+
+    portENTER_CRITICAL(&resumeMux);
+    memcpy(rtcSnapshot.ind, state, length);
+    rtcSnapshot.indLength = (uint8_t)length;
+    rtcSnapshot.crc = getSnapshotCRC();
+    portEXIT_CRITICAL(&resumeMux);
+}
+
+//
+// Time-to-Run is measured from the start of the application (esp_timer starts at zero) to SYS_OP::Run.  Both paths are kept
+// in the snapshot so either one can be compared with the other.
+//
+void System::recordTimeToRun(void)
+{
+    auto runUs = (uint32_t)esp_timer_get_time();
+    uint32_t coldRunUs = 0;
+    uint32_t warmRunUs = 0;
+    uint32_t warmBoots = 0;
+
+    portENTER_CRITICAL(&resumeMux);
+    if (blnWarmResume)
+        rtcSnapshot.warmRunUs = runUs;
+    else
+        rtcSnapshot.coldRunUs = runUs;
+
+    coldRunUs = rtcSnapshot.coldRunUs;
+    warmRunUs = rtcSnapshot.warmRunUs;
+    warmBoots = rtcSnapshot.warmBoots;
+    rtcSnapshot.crc = getSnapshotCRC();
+    portEXIT_CRITICAL(&resumeMux);
+
+    if (blnWarmResume)
+        ESP_LOGI(TAG, "Time to Run %d us (warm resume %d)  last cold boot %d us", runUs, warmBoots, coldRunUs);
+    else
+        ESP_LOGI(TAG, "Time to Run %d us (cold boot)  last warm resume %d us", runUs, warmRunUs);
+}
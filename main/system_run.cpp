@@ -56,49 +56,33 @@ void System::run(void)
             {
             case SYS_INIT::Start:
             {
+                SYS_BOOT_MARK("SYS", "Start");
                 ESP_LOGI(TAG, "System Initialization");
-                initSysStep = SYS_INIT::InitNVS;
-                [[fallthrough]];
-            }
 
-            case SYS_INIT::InitNVS:
-            {
-                initNVS();
-                initSysStep = SYS_INIT::CreateIND;
-                break;
-            }
+                initEventGroup = xEventGroupCreate();
+                initMutex = xSemaphoreCreateMutex();
+                launchInitNodes(); // Everything without dependencies starts now, on both cores
 
-            case SYS_INIT::RestoreSysVaribles:
-            {
-                initSysStep = SYS_INIT::CreateIND;
-                break;
+                initSysStep = SYS_INIT::WaitOnNodes;
+                SYS_BOOT_WAIT("SYS", "WaitOnNodes");
+                [[fallthrough]];
             }
 
-            case SYS_INIT::CreateIND:
+            case SYS_INIT::WaitOnNodes:
             {
-                if (showInit)
-                    ESP_LOGI(TAG, "Step 1  - CreateIND");
+                // Only what Run really needs.  Indication may still be blinking -- it is hooked in when it is ready.
+                auto ready = xEventGroupWaitBits(initEventGroup, SYS_INIT_RUN_DEPS, pdFALSE, pdTRUE, pdMS_TO_TICKS(SYS_INIT_WAIT_LOG_MS));
 
-                if (ind == nullptr)
-                    ind = new Indication(this, APP_VERSION_MAJOR, APP_VERSION_MINOR, APP_VERSION_REVISION);
-
-                if (ind != nullptr)
+                if ((ready & SYS_INIT_RUN_DEPS) == SYS_INIT_RUN_DEPS)
                 {
-                    initSysStep = SYS_INIT::WaitOnIND;
-                    if (showInit)
-                        ESP_LOGI(TAG, "Step 2  - WaitOnIND");
+                    initSysStep = SYS_INIT::Finished;
+                    break;
                 }
-                break;
-            }
 
-            case SYS_INIT::WaitOnIND:
-            {
-                if (xSemaphoreTake(semIndEntry, 5) == pdTRUE)
+                for (uint8_t i = 0; i < (uint8_t)SYS_INIT_NODE::Count; i++)
                 {
-                    indColorCmdRequestQue = ind->getColorCmdRequestQueue();
-                    xSemaphoreGive(semIndEntry);
-                    ESP_LOGI(TAG, "BEFORE IDLE - Free heap memory: %d bytes", esp_get_free_heap_size());
-                    initSysStep = SYS_INIT::Finished;
+                    if ((SYS_INIT_RUN_DEPS & SYS_INIT_BIT(i)) && !(ready & SYS_INIT_BIT(i)))
+                        ESP_LOGW(TAG, "Waiting on init node %s (%s)", initNodes[i].name, initNodes[i].blnStarted ? "started" : "not started");
                 }
                 break;
             }
@@ -106,8 +90,18 @@ void System::run(void)
             case SYS_INIT::Finished:
             {
                 ESP_LOGI(TAG, "Initialization Finished");
-                initGenTimer(); // Starting General Task and Timer
+                recordTimeToRun();
+
+                ESP_LOGI(TAG, "BEFORE IDLE - Free heap memory: %d bytes", esp_get_free_heap_size());
+
+                initRunUs = esp_timer_get_time();
                 SysOp = SYS_OP::Run;
+                SYS_BOOT_MARK("SYS", "Run");
+
+                if (runTaskHandleSystemGPIO != nullptr) // GPIO events held during Init are replayed now
+                    xTaskNotify(runTaskHandleSystemGPIO, SYS_GPIO_NOTIFY_RUN, eSetBits);
+
+                checkInitTimeline(); // Shown here if every node was already ready
                 break;
             }
             }
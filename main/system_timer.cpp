@@ -1,21 +1,29 @@
 #include "system.hpp"
 
-extern bool blnallowSwitchGPIOinput;
-extern uint8_t SwitchDebounceCounter;
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
 
 #define TIMER_PERIOD_1kHz 1000 // 1000 microseconds = .001 second  = 1000Hz
 
-auto OneHundredHertz = 10;
-auto QuarterSeconds = 25;
-auto HalfSecond = 2;
-auto OneSecond = 2;
-auto FiveSeconds = 5;
-auto TenSeconds = 10;
-auto OneMinute = 6;
-auto FiveMinutes = 5;
+//
+// With CONFIG_SYS_TIMER_TICKLESS the general timer is a one-shot that is re-armed for the next timer wheel deadline after every
+// wakeup.  Without it, the timer free-runs at 1kHz.  Either way the wheel is advanced to the real clock on each wakeup, so dropped
+// or coalesced notifications never turn into drift.
+//
 
 void System::initGenTimer(void)
 {
+    //
+    // Periodic System work is registered as jobs on the timer wheel.  Add new periodic work here (or call
+    // schedulePeriodic from any object) rather than hand-coding another countdown counter.
+    //
+    schedulePeriodic(1000 * 1000, &System::onTimerOneSecond, this, &timerJobOneSecond); // 1Hz
+    schedulePeriodic(5 * 1000 * 1000, &System::onTimerFiveSeconds, this);
+    schedulePeriodic(10 * 1000 * 1000, &System::onTimerTenSeconds, this); // 0.1Hz
+    schedulePeriodic(60 * 1000 * 1000, &System::onTimerOneMinute, this);
+    schedulePeriodic(300 * 1000 * 1000, &System::onTimerFiveMinutes, this);
+
     xTaskCreate(runGenTimerTaskMarshaller, "SYS::TIMER", 1024 * 2, this, 5, &xTaskHandleSystemTimer);
 
     const esp_timer_create_args_t general_timer_args = {
@@ -26,7 +34,22 @@ void System::initGenTimer(void)
         .skip_unhandled_events = true};
 
     ESP_ERROR_CHECK(esp_timer_create(&general_timer_args, &General_timer));
+
+#if CONFIG_SYS_TIMER_TICKLESS
+    xTaskNotifyGive(xTaskHandleSystemTimer); // The timer task arms the first deadline itself
+
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    esp_pm_config_esp32s3_t pmConfig = {
+        .max_freq_mhz = CONFIG_ESP32S3_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = 40,
+        .light_sleep_enable = true}; // Nothing wakes us between timer wheel deadlines now
+
+    if (esp_pm_configure(&pmConfig) != ESP_OK)
+        ESP_LOGW(TAG, "Unable to enable automatic light sleep");
+#endif
+#else
     ESP_ERROR_CHECK(esp_timer_start_periodic(General_timer, TIMER_PERIOD_1kHz));
+#endif
 }
 
 void IRAM_ATTR System::genTimerCallback(void *arg)
@@ -36,6 +59,11 @@ void IRAM_ATTR System::genTimerCallback(void *arg)
     // NOTE: Any high priorty task will essentially run as if it were the ISR itself if there are no other equally high prioirty tasks running.
     //
     auto obj = (System *)arg;
+
+    portENTER_CRITICAL(&obj->timerStatsMux); // 64 bit store -- keep it whole for the reader
+    obj->timerCallbackTime = esp_timer_get_time();
+    portEXIT_CRITICAL(&obj->timerStatsMux);
+
     vTaskNotifyGiveFromISR(obj->xTaskHandleSystemTimer, NULL);
 }
 
@@ -52,102 +80,265 @@ void System::runGenTimerTask(void)
 {
     while (true)
     {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // We are using task notification to trigger this routine at 1000hz.
-        //
-        // 1000hz Processing
-        //
-        //
-        // Periodic Processes by Time
-        //
-        if (OneHundredHertz > 0)
+        auto notifications = ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // Task notification arrives at 1kHz or, when tickless, at each wheel deadline.
+        recordTimerWake(notifications);
+
+        auto tickStart = esp_timer_get_time();
+        serviceTimerWheel();
+        uint32_t tickCost = (uint32_t)(esp_timer_get_time() - tickStart);
+
+        timerTickCount++;
+        timerTickCostTotal += tickCost;
+        if (tickCost > timerTickCostMax)
+            timerTickCostMax = tickCost;
+    } // While loop
+}
+
+//
+// Timer Wheel - The jobs live in TimerWheel (system_timerwheel.cpp).  This side wakes SYS::TIMER for the wheel's deadlines.
+//
+bool System::schedulePeriodic(uint64_t period_us, SYS_TimerCallback callback, void *ctx, uint16_t *jobID, SYS_TIMER_POLICY policy)
+{
+    return scheduleTimerJob(period_us, period_us, callback, ctx, jobID, policy);
+}
+
+bool System::scheduleOnce(uint64_t delay_us, SYS_TimerCallback callback, void *ctx, uint16_t *jobID)
+{
+    return scheduleTimerJob(delay_us, 0, callback, ctx, jobID, SYS_TIMER_POLICY::Skip);
+}
+
+bool System::cancelTimerJob(uint16_t jobID)
+{
+    return timerWheel.cancel(jobID);
+}
+
+bool System::scheduleTimerJob(uint64_t delay_us, uint64_t period_us, SYS_TimerCallback callback, void *ctx, uint16_t *jobID, SYS_TIMER_POLICY policy)
+{
+    bool blnRearm = false;
+
+    if (!timerWheel.schedule(delay_us, period_us, callback, ctx, jobID, policy, &blnRearm))
+        return false;
+
+#if CONFIG_SYS_TIMER_TICKLESS
+    // A new earliest deadline needs the one-shot re-armed.  The timer task re-arms on its own after running jobs.
+    if (blnRearm && (xTaskHandleSystemTimer != nullptr) && (xTaskGetCurrentTaskHandle() != xTaskHandleSystemTimer))
+        xTaskNotifyGive(xTaskHandleSystemTimer);
+#else
+    (void)blnRearm;
+#endif
+    return true;
+}
+
+void System::serviceTimerWheel(void)
+{
+#if CONFIG_SYS_TIMER_TICKLESS
+    while (true)
+    {
+        timerWheel.advance(timerWheel.currentTick());
+
+        auto next = timerWheel.armNextTick();
+
+        esp_timer_stop(General_timer); // Harmless when the timer is not running
+
+        if (next == UINT64_MAX) // No jobs at all.  Sleep until someone schedules one.
+            return;
+
+        int64_t delay = timerWheel.tickTime(next) - esp_timer_get_time();
+
+        if (delay > 0)
         {
-            if (--OneHundredHertz < 1) // 100Hz Processing here
-            {
-                // Perform GPIO Switch Debouncing delay here.
-                if (SwitchDebounceCounter > 0)
-                {
-                    if (--SwitchDebounceCounter < 1)
-                        blnallowSwitchGPIOinput = true;
-                }
-
-                if (QuarterSeconds > 0)
-                {
-                    if (--QuarterSeconds < 1) // 4Hz Processing here
-                    {
-                        if (HalfSecond > 0)
-                        {
-                            if (--HalfSecond < 1) // Halfsecond activities
-                            {
-                                if (OneSecond > 0)
-                                {
-                                    if (--OneSecond < 1)
-                                    {
-                                        if (showTimerSeconds)
-                                            ESP_LOGI(TAG, "One Second");
-
-                                        // const int32_t val = 0x11000301; // 1 second heartbeat in red
-                                        // const int32_t val = 0x21000301; // 1 second heartbeat in green
-                                        // const int32_t val = 0x41000309; // 1 second heartbeat in blue
-                                        // const int32_t val = 0x31000309; // 1 second heartbeat in yellow
-                                        // const int32_t val = 0x61000309; // 1 second heartbeat in cyan
-                                        // const int32_t val = 0x51000309; // 1 second heartbeat in violet
-                                        const int32_t val = 0x71000309; // 1 second heartbeat in white
-
-                                        if (indColorCmdRequestQue != nullptr)
-                                            xQueueSendToBack(indColorCmdRequestQue, &val, 0);
-
-                                        if (FiveSeconds > 0)
-                                        {
-                                            if (--FiveSeconds < 1)
-                                            {
-                                                if (showTimerSeconds)
-                                                    ESP_LOGI(TAG, "Five Seconds");
-
-                                                FiveSeconds = 5;
-                                            }
-                                        }
-
-                                        if (TenSeconds > 0)
-                                        {
-                                            if (--TenSeconds < 1) // 0.1Hz Processing here
-                                            {
-                                                if (showTimerSeconds)
-                                                    ESP_LOGI(TAG, "Ten Seconds");
-
-                                                if (OneMinute > 0)
-                                                {
-                                                    if (--OneMinute < 1)
-                                                    {
-                                                        if (showTimerMinutes)
-                                                            ESP_LOGI(TAG, "One Minute");
-
-                                                        if (FiveMinutes > 0)
-                                                        {
-                                                            if (--FiveMinutes < 1)
-                                                            {
-                                                                if (showTimerMinutes)
-                                                                    ESP_LOGI(TAG, "Five Minutes");
-
-                                                                FiveMinutes = 5;
-                                                            }
-                                                        }
-                                                        OneMinute = 6;
-                                                    }
-                                                }
-                                                TenSeconds = 10;
-                                            }
-                                        }
-                                        OneSecond = 2;
-                                    }
-                                }
-                                HalfSecond = 2;
-                            }
-                        }
-                        QuarterSeconds = 25;
-                    }
-                }
-                OneHundredHertz = 10;
-            }
+            esp_timer_start_once(General_timer, delay);
+            return;
         }
-    } // While loop
+        // The deadline passed while we were running jobs -- go around again rather than arming a zero delay.
+    }
+#else
+    timerWheel.advance(timerWheel.currentTick());
+#endif
+}
+
+//
+// Timer Instrumentation
+//
+void System::recordTimerWake(uint32_t notifications)
+{
+    auto nowUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&timerStatsMux);
+    timerStats.wakeups++;
+
+    if (notifications > 1) // Coalesced notifications.  The wheel still catches up on the real clock.
+        timerStats.missedTicks += notifications - 1;
+
+    if (timerCallbackTime != 0) // Wakes caused by a re-arm request have no callback time
+    {
+        auto latency = (uint32_t)(nowUs - timerCallbackTime);
+        timerCallbackTime = 0;
+
+        uint8_t bucket = (latency == 0) ? 0 : (32 - __builtin_clz(latency));
+        if (bucket >= SYS_TIMER_LATENCY_BUCKETS)
+            bucket = SYS_TIMER_LATENCY_BUCKETS - 1;
+
+        timerStats.histogram[bucket]++;
+        timerStats.latencySamples++;
+
+        if (latency > timerStats.latencyMaxUs)
+            timerStats.latencyMaxUs = latency;
+    }
+    portEXIT_CRITICAL(&timerStatsMux);
+}
+
+void System::getTimerStats(SYS_TimerStats *stats)
+{
+    portENTER_CRITICAL(&timerStatsMux);
+    *stats = timerStats;
+    portEXIT_CRITICAL(&timerStatsMux);
+
+    stats->latencyP50Us = 0;
+    stats->latencyP99Us = 0;
+
+    if (stats->latencySamples == 0)
+        return;
+
+    uint32_t p50Count = (stats->latencySamples + 1) / 2;
+    uint32_t p99Count = stats->latencySamples - (stats->latencySamples / 100);
+    uint32_t count = 0;
+    bool blnHaveP50 = false;
+
+    for (uint8_t bucket = 0; bucket < SYS_TIMER_LATENCY_BUCKETS; bucket++)
+    {
+        count += stats->histogram[bucket];
+        uint32_t upperBound = (bucket == 0) ? 0 : ((1UL << bucket) - 1);
+
+        if (bucket == SYS_TIMER_LATENCY_BUCKETS - 1) // Open-ended bucket
+            upperBound = stats->latencyMaxUs;
+
+        if (!blnHaveP50 && (count >= p50Count))
+        {
+            stats->latencyP50Us = upperBound;
+            blnHaveP50 = true;
+        }
+
+        if (count >= p99Count)
+        {
+            stats->latencyP99Us = upperBound;
+            break;
+        }
+    }
+}
+
+bool System::getTimerJobStats(uint16_t jobID, SYS_TimerJobStats *stats)
+{
+    return timerWheel.getJobStats(jobID, stats);
+}
+
+void System::resetTimerStats(void)
+{
+    portENTER_CRITICAL(&timerStatsMux);
+    timerStats = {};
+    portEXIT_CRITICAL(&timerStatsMux);
+
+    timerWheel.resetJobStats();
+}
+
+void System::logTimerStats(void)
+{
+    SYS_TimerStats stats;
+    SYS_TimerJobStats heartbeat = {};
+
+    getTimerStats(&stats);
+    getTimerJobStats(timerJobOneSecond, &heartbeat);
+
+    ESP_LOGI(TAG, "Timer wakeups/sec %d  avg cost %d us  max cost %d us", stats.wakeups / 60,
+             (timerTickCount > 0) ? timerTickCostTotal / timerTickCount : 0, timerTickCostMax);
+    ESP_LOGI(TAG, "Timer wake latency p50 %d us  p99 %d us  max %d us  missed ticks %d", stats.latencyP50Us, stats.latencyP99Us,
+             stats.latencyMaxUs, stats.missedTicks);
+    ESP_LOGI(TAG, "Heartbeat runs %d  overruns %d  dropped %d  max late %d us", heartbeat.runs, heartbeat.overruns,
+             heartbeat.dropped, heartbeat.maxLateUs);
+}
+
+//
+// Periodic System Jobs
+//
+void System::onTimerOneSecond(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showTimerSeconds)
+        ESP_LOGI(obj->TAG, "One Second");
+
+    IND_Command command = {};
+    command.type = IND_CMD::Legacy;
+
+    // command.legacy = 0x11000301; // 1 second heartbeat in red
+    // command.legacy = 0x21000301; // 1 second heartbeat in green
+    // command.legacy = 0x41000309; // 1 second heartbeat in blue
+    // command.legacy = 0x31000309; // 1 second heartbeat in yellow
+    // command.legacy = 0x61000309; // 1 second heartbeat in cyan
+    // command.legacy = 0x51000309; // 1 second heartbeat in violet
+    command.legacy = 0x71000309; // 1 second heartbeat in white
+
+    if (obj->indColorCmdRequestQue != nullptr)
+        xQueueSendToBack(obj->indColorCmdRequestQue, &command, 0);
+}
+
+void System::onTimerFiveSeconds(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showTimerSeconds)
+        ESP_LOGI(obj->TAG, "Five Seconds");
+}
+
+void System::onTimerTenSeconds(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showTimerSeconds)
+        ESP_LOGI(obj->TAG, "Ten Seconds");
+}
+
+void System::onTimerOneMinute(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showTimerMinutes)
+        ESP_LOGI(obj->TAG, "One Minute");
+
+    if (obj->showTimerStats && (obj->timerTickCount > 0)) // Compare wakeups/sec with CONFIG_SYS_TIMER_TICKLESS on and off
+    {
+        obj->logTimerStats();
+        obj->resetTimerStats();
+    }
+
+    if (obj->showGPIOStats)
+        obj->logGPIOStats();
+
+    if (obj->showNVSCacheStats)
+    {
+        obj->logNVSCacheStats();
+        obj->logNVSTaskStats();
+        obj->logNVSLockStats();
+    }
+
+    if (obj->showLogStoreStats)
+        obj->logLogStoreStats();
+
+    if (obj->showIndicationStats && (obj->ind != nullptr))
+    {
+        obj->ind->logRenderStats();
+        obj->ind->logSequenceStats();
+    }
+
+    obj->timerTickCount = 0;
+    obj->timerTickCostTotal = 0;
+    obj->timerTickCostMax = 0;
+}
+
+void System::onTimerFiveMinutes(void *arg, uint32_t missed)
+{
+    auto obj = (System *)arg;
+
+    if (obj->showTimerMinutes)
+        ESP_LOGI(obj->TAG, "Five Minutes");
 }
@@ -0,0 +1,353 @@
+#include "system_timerwheel.hpp"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+//
+// Timer Wheel
+//
+// Each level has 64 slots and a 64 bit occupancy mask.  Level 0 slots are 1 tick wide, level 1 slots are 64 ticks wide, and so on.
+// A job is placed in the lowest level whose span covers its remaining delay.  When the level below wraps, the current slot of the
+// level above is cascaded down.  Inserting, cancelling and ticking never walk the full list of jobs.
+//
+void TimerWheel::start(int64_t epochUs)
+{
+    portENTER_CRITICAL(&mux);
+    epoch = epochUs;
+    portEXIT_CRITICAL(&mux);
+}
+
+bool TimerWheel::schedule(uint64_t delay_us, uint64_t period_us, SYS_TimerCallback callback, void *ctx, uint16_t *jobID, SYS_TIMER_POLICY policy,
+                          bool *blnEarliest)
+{
+    if (callback == nullptr)
+        return false;
+
+    uint64_t delayTicks = (delay_us + SYS_TIMER_TICK_US - 1) / SYS_TIMER_TICK_US; // Round up so we are never early
+    uint64_t periodTicks = (period_us + SYS_TIMER_TICK_US - 1) / SYS_TIMER_TICK_US;
+
+    if (delayTicks < 1) // A job may never land in the slot we are currently servicing
+        delayTicks = 1;
+
+    SYS_TimerJob *job = nullptr;
+    uint16_t index = 0;
+
+    portENTER_CRITICAL(&mux);
+    for (index = 0; index < SYS_TIMER_MAX_JOBS; index++)
+    {
+        if (!jobs[index].inUse)
+        {
+            job = &jobs[index];
+            job->inUse = true;
+            job->runs = 0;
+            job->overruns = 0;
+            job->dropped = 0;
+            job->maxLateUs = 0;
+            job->callback = callback;
+            job->ctx = ctx;
+            job->period = (uint32_t)periodTicks;
+            job->policy = policy;
+            job->expires = currentTick() + delayTicks;
+            insertJob(job);
+            break;
+        }
+    }
+
+    if (blnEarliest != nullptr)
+        *blnEarliest = (job != nullptr) && (job->expires < armedTick);
+    portEXIT_CRITICAL(&mux);
+
+    if (job == nullptr)
+    {
+        ESP_LOGE(TAG, "Error, No free timer jobs.  Raise SYS_TIMER_MAX_JOBS");
+        return false;
+    }
+
+    if (jobID != nullptr)
+        *jobID = index;
+    return true;
+}
+
+bool TimerWheel::cancel(uint16_t jobID)
+{
+    if (jobID >= SYS_TIMER_MAX_JOBS)
+        return false;
+
+    bool blnCancelled = false;
+    auto job = &jobs[jobID];
+
+    portENTER_CRITICAL(&mux);
+    if (job->inUse)
+    {
+        if (job->linked)
+            unlinkJob(job);
+
+        job->inUse = false;
+        blnCancelled = true;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    return blnCancelled;
+}
+
+void TimerWheel::insertJob(SYS_TimerJob *job) // Caller must hold mux
+{
+    const uint64_t wheelSpan = 1ULL << (SYS_TIMER_WHEEL_BITS * SYS_TIMER_WHEEL_LEVELS);
+
+    uint64_t expires = job->expires;
+    uint64_t delta = (expires > now) ? (expires - now) : 0;
+
+    if (delta >= wheelSpan) // Park far away jobs in the last slot we can reach.  They are re-inserted when that slot comes due.
+    {
+        expires = now + wheelSpan - 1;
+        delta = wheelSpan - 1;
+    }
+
+    uint8_t level = 0;
+    while ((level < SYS_TIMER_WHEEL_LEVELS - 1) && (delta >= (1ULL << (SYS_TIMER_WHEEL_BITS * (level + 1)))))
+        level++;
+
+    uint8_t slot = (expires >> (SYS_TIMER_WHEEL_BITS * level)) & SYS_TIMER_WHEEL_MASK;
+
+    job->level = level;
+    job->slot = slot;
+    job->prev = nullptr;
+    job->next = slots[level][slot];
+
+    if (job->next != nullptr)
+        job->next->prev = job;
+
+    slots[level][slot] = job;
+    occupied[level] |= (1ULL << slot);
+    job->linked = true;
+}
+
+void TimerWheel::unlinkJob(SYS_TimerJob *job) // Caller must hold mux
+{
+    if (job->prev != nullptr)
+        job->prev->next = job->next;
+    else
+        slots[job->level][job->slot] = job->next;
+
+    if (job->next != nullptr)
+        job->next->prev = job->prev;
+
+    if (slots[job->level][job->slot] == nullptr)
+        occupied[job->level] &= ~(1ULL << job->slot);
+
+    job->next = nullptr;
+    job->prev = nullptr;
+    job->linked = false;
+}
+
+void TimerWheel::cascade(uint8_t level, uint8_t slot) // Caller must hold mux
+{
+    auto job = slots[level][slot];
+
+    slots[level][slot] = nullptr;
+    occupied[level] &= ~(1ULL << slot);
+
+    while (job != nullptr)
+    {
+        auto next = job->next;
+        job->linked = false;
+        insertJob(job); // Every job here is now within reach of a lower level
+        job = next;
+    }
+}
+
+uint64_t TimerWheel::currentTick(void)
+{
+    // The wheel only moves when we wake, so deadlines are always taken from the real clock.
+    return (uint64_t)(esp_timer_get_time() - epoch) / SYS_TIMER_TICK_US;
+}
+
+int64_t TimerWheel::tickTime(uint64_t tick) const
+{
+    return epoch + (int64_t)(tick * SYS_TIMER_TICK_US);
+}
+
+static inline uint64_t rotateRight64(uint64_t value, uint8_t count)
+{
+    count &= 63;
+    return (value >> count) | (value << ((64 - count) & 63));
+}
+
+//
+// Finds the next tick at which the wheel has work -- either a level 0 slot with jobs, or a boundary at which a non-empty slot
+// of a higher level is cascaded.  Nothing is walked except the occupancy masks.  Returns UINT64_MAX when no jobs are pending.
+//
+uint64_t TimerWheel::nextEventTick(void) // Caller must hold mux
+{
+    uint64_t next = UINT64_MAX;
+
+    if (occupied[0] != 0)
+    {
+        auto pending = rotateRight64(occupied[0], (now + 1) & SYS_TIMER_WHEEL_MASK);
+        next = now + 1 + __builtin_ctzll(pending);
+    }
+
+    for (uint8_t level = 1; level < SYS_TIMER_WHEEL_LEVELS; level++)
+    {
+        if (occupied[level] == 0)
+            continue;
+
+        uint8_t shift = SYS_TIMER_WHEEL_BITS * level;
+        uint64_t index = now >> shift;
+        auto pending = rotateRight64(occupied[level], (index + 1) & SYS_TIMER_WHEEL_MASK);
+        uint64_t boundary = (index + 1 + __builtin_ctzll(pending)) << shift;
+
+        if (boundary < next)
+            next = boundary;
+    }
+
+    return next;
+}
+
+uint64_t TimerWheel::armNextTick(void)
+{
+    portENTER_CRITICAL(&mux);
+    auto next = nextEventTick();
+    armedTick = next;
+    portEXIT_CRITICAL(&mux);
+
+    return next;
+}
+
+//
+// Moves the wheel forward to targetTick.  Empty stretches are skipped in one step, so the cost depends on the number of
+// deadlines passed rather than the number of ticks elapsed.
+//
+void TimerWheel::advance(uint64_t targetTick)
+{
+    while (true)
+    {
+        portENTER_CRITICAL(&mux);
+        if (now >= targetTick)
+        {
+            portEXIT_CRITICAL(&mux);
+            break;
+        }
+
+        auto next = nextEventTick();
+
+        if (next > targetTick)
+        {
+            now = targetTick; // Nothing falls due before the target
+            portEXIT_CRITICAL(&mux);
+            break;
+        }
+
+        now = next - 1;
+        portEXIT_CRITICAL(&mux);
+
+        processTick();
+    }
+}
+
+void TimerWheel::processTick(void)
+{
+    auto nowUs = esp_timer_get_time();
+    uint64_t realTick = (uint64_t)(nowUs - epoch) / SYS_TIMER_TICK_US;
+
+    portENTER_CRITICAL(&mux);
+    now++;
+
+    for (uint8_t level = 1; level < SYS_TIMER_WHEEL_LEVELS; level++) // Cascade only when the level below has wrapped
+    {
+        if (now & ((1ULL << (SYS_TIMER_WHEEL_BITS * level)) - 1))
+            break;
+
+        cascade(level, (now >> (SYS_TIMER_WHEEL_BITS * level)) & SYS_TIMER_WHEEL_MASK);
+    }
+
+    uint8_t slot = now & SYS_TIMER_WHEEL_MASK;
+
+    while (slots[0][slot] != nullptr)
+    {
+        auto job = slots[0][slot];
+        unlinkJob(job);
+
+        if (job->expires > now) // A parked long delay job that is not due yet
+        {
+            insertJob(job);
+            continue;
+        }
+
+        auto callback = job->callback;
+        auto ctx = job->ctx;
+
+        int64_t lateUs = nowUs - tickTime(job->expires);
+
+        job->runs++;
+        if (lateUs > (int64_t)job->maxLateUs)
+            job->maxLateUs = (uint32_t)lateUs;
+
+        if ((job->period > 0) && (lateUs >= (int64_t)job->period * SYS_TIMER_TICK_US))
+            job->overruns++;
+
+        uint32_t missed = 0;
+
+        if (job->period > 0) // Re-arm before calling so the callback is free to cancel its own job
+        {
+            uint64_t next = job->expires + job->period; // Always on the original grid -- never "now + period"
+
+            if ((job->policy != SYS_TIMER_POLICY::CatchUp) && (realTick >= next))
+            {
+                missed = (uint32_t)((realTick - job->expires) / job->period); // Whole periods that are already due as well
+                next = job->expires + ((uint64_t)missed + 1) * job->period;
+            }
+
+            if (job->policy == SYS_TIMER_POLICY::Skip) // Dropped -- the callback is not told about them
+            {
+                job->dropped += missed;
+                missed = 0;
+            }
+
+            job->expires = next;
+            insertJob(job);
+        }
+        else
+            job->inUse = false;
+
+        portEXIT_CRITICAL(&mux); // Never hold the wheel while running a job
+        callback(ctx, missed);
+        portENTER_CRITICAL(&mux);
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+//
+// Job Instrumentation
+//
+bool TimerWheel::getJobStats(uint16_t jobID, SYS_TimerJobStats *stats)
+{
+    if (jobID >= SYS_TIMER_MAX_JOBS)
+        return false;
+
+    auto job = &jobs[jobID];
+
+    portENTER_CRITICAL(&mux);
+    stats->periodUs = job->period * SYS_TIMER_TICK_US;
+    stats->runs = job->runs;
+    stats->overruns = job->overruns;
+    stats->dropped = job->dropped;
+    stats->maxLateUs = job->maxLateUs;
+    bool blnInUse = job->inUse;
+    portEXIT_CRITICAL(&mux);
+
+    return blnInUse;
+}
+
+void TimerWheel::resetJobStats(void)
+{
+    portENTER_CRITICAL(&mux);
+    for (uint16_t index = 0; index < SYS_TIMER_MAX_JOBS; index++)
+    {
+        jobs[index].runs = 0;
+        jobs[index].overruns = 0;
+        jobs[index].dropped = 0;
+        jobs[index].maxLateUs = 0;
+    }
+    portEXIT_CRITICAL(&mux);
+}
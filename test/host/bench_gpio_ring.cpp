@@ -0,0 +1,154 @@
+#include "system_gpio_ring.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "esp_timer.h"
+#include "freertos/queue.h"
+#include "host_test.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Bursts of 1 to 32 edges through the GPIO event ring and through the depth-1 queue it replaced.  A host thread stands in for
+// the ISR and fires each burst with 20 us between edges, 50 bursts per size, each 2 ms after the last one was handled.  The
+// consumer is a task that waits, drains and calls a handler the way SYS::GPIO does, once with a handler that returns at once
+// and once with one that takes 200 us.  The old side is the old GPIOIsrHandler -- xQueueSendToBackFromISR into a queue of
+// one, stamped here so it has a latency -- read by a task blocked in xQueueReceive.  128 edges is past the ring's 64 slots,
+// to show where it drops.
+//
+// Latency is the edge's stamp to its handler call, drops are edges the ISR could not store.
+//
+#define BENCH_BURSTS 50
+#define BENCH_EDGE_GAP_US 20
+#define BENCH_BURST_GAP_MS 2
+
+int64_t esp_timer_get_time(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static QueueHandle_t oldQueue = nullptr;
+static std::atomic<uint32_t> handled(0);
+static std::atomic<uint32_t> handlerUs(0);
+static std::vector<int64_t> latencies; // Consumer only, until handled says it is done
+
+static void spin(uint32_t us)
+{
+    auto until = esp_timer_get_time() + us;
+
+    while (esp_timer_get_time() < until)
+    {
+    }
+}
+
+static void onEvent(const SYS_GPIOEvent &evt)
+{
+    latencies.push_back(esp_timer_get_time() - evt.timestamp);
+    spin(handlerUs);
+    handled.fetch_add(1, std::memory_order_release);
+}
+
+static void runRingTask(void *)
+{
+    SYS_GPIOEvent batch[SYS_GPIO_BATCH_SIZE];
+    uint32_t notifyBits = 0;
+
+    while (true)
+    {
+        xTaskNotifyWait(0, UINT32_MAX, &notifyBits, portMAX_DELAY);
+
+        while (auto available = takeGPIOEvents(batch, SYS_GPIO_BATCH_SIZE))
+        {
+            for (uint32_t index = 0; index < available; index++)
+                onEvent(batch[index]);
+        }
+    }
+}
+
+static void runQueueTask(void *)
+{
+    SYS_GPIOEvent evt;
+
+    while (true)
+    {
+        if (xQueueReceive(oldQueue, &evt, pdMS_TO_TICKS(50)))
+            onEvent(evt);
+    }
+}
+
+static bool pushOld(uint8_t pin, uint8_t level)
+{
+    SYS_GPIOEvent evt = {esp_timer_get_time(), pin, level};
+    return xQueueSendToBackFromISR(oldQueue, &evt, NULL) == pdTRUE;
+}
+
+static void runBursts(const char *name, uint32_t edges, bool (*push)(uint8_t, uint8_t))
+{
+    uint32_t sent = 0;
+    uint32_t dropped = 0;
+
+    latencies.clear();
+    handled = 0;
+
+    for (int burst = 0; burst < BENCH_BURSTS; burst++)
+    {
+        for (uint32_t edge = 0; edge < edges; edge++)
+        {
+            if (edge > 0)
+                spin(BENCH_EDGE_GAP_US);
+
+            sent++;
+            dropped += push(0, (uint8_t)(edge & 1)) ? 0 : 1;
+        }
+
+        while (handled.load(std::memory_order_acquire) < sent - dropped) // Bursts are apart -- each one starts on an idle consumer
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(BENCH_BURST_GAP_MS));
+    }
+
+    CHECK(latencies.size() == sent - dropped);
+    std::sort(latencies.begin(), latencies.end());
+
+    auto count = latencies.size();
+    printf("    %-6s %3d edges  %5.1f%% dropped  p50 %5lld  p99 %5lld  max %6lld us\n", name, edges, 100.0 * dropped / sent,
+           (long long)latencies[count / 2], (long long)latencies[count * 99 / 100], (long long)latencies[count - 1]);
+}
+
+int main(void)
+{
+    const uint32_t bursts[] = {1, 2, 4, 8, 16, 32, 128};
+    const uint32_t handlerCosts[] = {0, 200};
+
+    oldQueue = xQueueCreate(1, sizeof(SYS_GPIOEvent));
+    xTaskCreate(runQueueTask, "old", 1024 * 3, nullptr, 7, nullptr);
+    xTaskCreate(runRingTask, "SYS::GPIO", 1024 * 3, nullptr, 7, &gpioEventTask);
+
+    printf("  %d bursts per size, %d us between edges, on %d host cores\n", BENCH_BURSTS, BENCH_EDGE_GAP_US,
+           (int)std::thread::hardware_concurrency());
+
+    for (auto cost : handlerCosts)
+    {
+        handlerUs = cost;
+        printf("  handler %d us\n", cost);
+
+        for (auto edges : bursts)
+        {
+            runBursts("ring", edges, &pushGPIOEvent);
+            runBursts("queue", edges, &pushOld);
+        }
+    }
+
+    CHECK(getGPIORingDrops() > 0); // Only the 128 edge bursts, which overrun the ring
+
+    fflush(stdout);
+    _exit((hostTestFailures == 0) ? 0 : 1); // The consumer tasks never end
+}
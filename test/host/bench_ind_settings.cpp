@@ -0,0 +1,184 @@
+#include "system.hpp"
+#include "indication/indication.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "esp_rom_crc.h"
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Indication's settings restore and save, blob against the per-key layout.  Each case boots a fresh System and Indication
+// in a forked process on flash that holds one layout.  Flash is charged an assumed 20 us per read and 200 us per entry.
+//
+//   per-key boot   the six keys the old firmware wrote -- restored, then migrated to the blob
+//   blob boot      the blob the current firmware writes
+//   per-key save   the old saveVariblesToNVS after setDefaultValues() changed one value -- all three marked dirty
+//   blob save      setDefaultValues() with one value changed, as it is now
+//
+// The "indication" namespace is preloaded when System boots, so the restore itself reads from the cache and the flash
+// reads are the preload's.  Boot counts run from System's constructor to Indication's init finished and its writes flushed.
+//
+enum class Case : uint8_t
+{
+    PerKeyBoot,
+    BlobBoot,
+    PerKeySave,
+    BlobSave,
+};
+
+static void seed(bool blnBlob)
+{
+    nvs_handle_t handle = 0;
+    CHECK(nvs_open("indication", NVS_READWRITE, &handle) == ESP_OK);
+
+    if (blnBlob)
+    {
+        IND_SettingsBlob blob;
+        memset(&blob, 0, sizeof(blob));
+        blob.version = IND_SETTINGS_VERSION;
+        blob.length = sizeof(blob);
+        blob.aState = (uint8_t)LED_STATE::ON;
+        blob.bState = (uint8_t)LED_STATE::OFF;
+        blob.cState = (uint8_t)LED_STATE::AUTO;
+        blob.aDefValue = 10;
+        blob.bDefValue = 20;
+        blob.cDefValue = 30;
+        blob.crc = esp_rom_crc32_le(0, (const uint8_t *)&blob + sizeof(uint32_t), sizeof(blob) - sizeof(uint32_t));
+        CHECK(nvs_set_blob(handle, IND_SETTINGS_KEY, &blob, sizeof(blob)) == ESP_OK);
+    }
+    else
+    {
+        CHECK(nvs_set_u8(handle, SET_IND_A_STATE.key, (uint8_t)LED_STATE::ON) == ESP_OK);
+        CHECK(nvs_set_u8(handle, SET_IND_B_STATE.key, (uint8_t)LED_STATE::OFF) == ESP_OK);
+        CHECK(nvs_set_u8(handle, SET_IND_C_STATE.key, (uint8_t)LED_STATE::AUTO) == ESP_OK);
+        CHECK(nvs_set_u8(handle, SET_IND_A_DEF_VALUE.key, 10) == ESP_OK);
+        CHECK(nvs_set_u8(handle, SET_IND_B_DEF_VALUE.key, 20) == ESP_OK);
+        CHECK(nvs_set_u8(handle, SET_IND_C_DEF_VALUE.key, 30) == ESP_OK);
+    }
+
+    CHECK(nvs_commit(handle) == ESP_OK);
+    nvs_close(handle);
+}
+
+static void printRow(const char *name, int64_t preloadUs, int64_t us, const NvsEmulatorCounters &counters)
+{
+    char preload[24] = ""; // Saves have no boot
+
+    if (preloadUs > 0)
+        snprintf(preload, sizeof(preload), "%lld us preload", (long long)preloadUs);
+
+    printf("  %-13s %16s  %5lld us %-7s  %3d reads  %3d scanned  %2d writes  %2d entries\n", name, preload, (long long)us,
+           (preloadUs > 0) ? "restore" : "save", counters.reads, counters.scanned, counters.writes, counters.entries);
+}
+
+static Indication *bootIndication(System &sys)
+{
+    auto ind = new Indication(&sys, 0, 0, 0); // No version to blink out
+    xSemaphoreTake(semIndEntry, portMAX_DELAY);
+    xSemaphoreGive(semIndEntry);
+    return ind;
+}
+
+static void runBoot(bool blnBlob)
+{
+    seed(blnBlob);
+    NvsEmulator::setCost(20, 200);
+    NvsEmulator::resetCounters();
+
+    auto startTime = esp_timer_get_time();
+    auto &sys = System::getInstance();
+    auto preloadUs = esp_timer_get_time() - startTime; // All of it NVS -- the host System brings up nothing else
+
+    auto ind = bootIndication(sys);
+    CHECK(sys.flushNVSCache());
+
+    IND_SettingsStats stats;
+    ind->getSettingsStats(&stats);
+    CHECK(stats.source == (blnBlob ? IND_SettingsSource::Blob : IND_SettingsSource::PerKey));
+    CHECK(stats.saves == (blnBlob ? 0 : 1)); // Only the migration saves
+
+    NvsEmulatorCounters counters;
+    NvsEmulator::getCounters(&counters);
+    printRow(blnBlob ? "blob boot" : "per-key boot", preloadUs, stats.restoreUs, counters);
+    CHECK(NvsEmulator::keys("indication") == 1); // The blob, and the per-key layout erased
+}
+
+static void runSave(bool blnBlob)
+{
+    seed(blnBlob);
+    NvsEmulator::setCost(20, 200);
+
+    auto &sys = System::getInstance();
+    int64_t saveUs = 0;
+    NvsEmulatorCounters counters;
+
+    if (blnBlob)
+    {
+        auto ind = bootIndication(sys);
+        CHECK(sys.flushNVSCache());
+        NvsEmulator::resetCounters();
+
+        CHECK(ind->setDefaultValues(10, 21, 30));
+        CHECK(sys.flushNVSCache());
+
+        IND_SettingsStats stats;
+        ind->getSettingsStats(&stats);
+        saveUs = stats.saveUs;
+    }
+    else // The old save, replayed as it ran -- setDefaultValues() marked all three values dirty
+    {
+        NvsEmulator::resetCounters();
+        auto startTime = esp_timer_get_time();
+        {
+            NvsTransaction txn("indication");
+            CHECK(txn.set(SET_IND_A_DEF_VALUE, (uint8_t)10));
+            CHECK(txn.set(SET_IND_B_DEF_VALUE, (uint8_t)21));
+            CHECK(txn.set(SET_IND_C_DEF_VALUE, (uint8_t)30));
+            CHECK(txn.commit());
+        }
+        saveUs = esp_timer_get_time() - startTime;
+        CHECK(sys.flushNVSCache());
+    }
+
+    NvsEmulator::getCounters(&counters);
+    printRow(blnBlob ? "blob save" : "per-key save", 0, saveUs, counters);
+}
+
+int main(void)
+{
+    const Case cases[] = {Case::PerKeyBoot, Case::BlobBoot, Case::PerKeySave, Case::BlobSave};
+
+    printf("  flash 20 us per read and 200 us per entry, IND_SettingsBlob is %d bytes\n", (int)sizeof(IND_SettingsBlob));
+    fflush(stdout);
+
+    int failures = 0;
+
+    for (auto kind : cases) // A fresh boot for each
+    {
+        auto pid = fork();
+
+        if (pid == 0)
+        {
+            if ((kind == Case::PerKeyBoot) || (kind == Case::BlobBoot))
+                runBoot(kind == Case::BlobBoot);
+            else
+                runSave(kind == Case::BlobSave);
+
+            fflush(stdout);
+            _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS and IND::Run are still running -- no static destructors under them
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        failures += (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : 1;
+    }
+
+    return (failures == 0) ? 0 : 1;
+}
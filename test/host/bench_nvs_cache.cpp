@@ -0,0 +1,151 @@
+#include "system.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Set/commit throughput through the write-back cache against writing through to NVS the way the SWITCH_1 handler used to
+// (open, three sets, commit, close per press).  Each load runs once with flash free and once with flash charged a round
+// figure per read and per entry -- not a measurement of the S3, only enough to show who waits for it.  The cached side is
+// timed on the caller and then for the flush that follows, so nothing written is left out.
+//
+//   presses    1000 presses, each sets three keys to one of four values
+//   unchanged  1000 presses that set the values already held
+//   200 keys   1000 single key sets spread over more keys than the cache has entries
+//
+#define BENCH_PRESSES 1000
+#define BENCH_SPREAD_KEYS 200
+
+static const char *keyNames[3] = {"aDefValue", "bDefValue", "cDefValue"};
+
+struct Load
+{
+    const char *name;
+    uint8_t keys;     // Keys set per operation
+    uint16_t spread;  // Distinct keys the operations walk over.  One means the same keys every time.
+    bool blnChanging; // The value moves on with every operation
+};
+
+static void keyName(const Load &load, int op, int k, char *key)
+{
+    if (load.spread > 1)
+        snprintf(key, NVS_KEY_NAME_MAX_SIZE, "key%03d", op % load.spread);
+    else
+        snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s", keyNames[k]);
+}
+
+static uint8_t keyValue(const Load &load, int op, int round) // Moves on with every pass over the keys and every round
+{
+    return load.blnChanging ? (uint8_t)((op / load.spread + round) % 4) : 1;
+}
+
+static void printRow(const char *name, int64_t callerUs, int64_t flushUs, const NvsEmulatorCounters &before)
+{
+    NvsEmulatorCounters after;
+    NvsEmulator::getCounters(&after);
+
+    printf("    %-14s %8.1f us/op  %9lld us flush  %6.0f ops/s   %5d reads  %5d entries  %5d commits\n", name,
+           (double)callerUs / BENCH_PRESSES, (long long)flushUs, BENCH_PRESSES * 1e6 / (callerUs + flushUs),
+           after.reads - before.reads, after.entries - before.entries, after.commits - before.commits);
+}
+
+static void runCached(System &sys, const Load &load, int round, const char *name_space)
+{
+    NvsEmulatorCounters before;
+    SYS_NVSCacheStats statsBefore, statsAfter;
+
+    sys.getNVSCacheStats(&statsBefore);
+    NvsEmulator::getCounters(&before);
+    auto start = esp_timer_get_time();
+
+    for (int op = 0; op < BENCH_PRESSES; op++)
+    {
+        NvsTransaction txn(name_space);
+
+        for (uint8_t k = 0; k < load.keys; k++)
+        {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            keyName(load, op, k, key);
+            CHECK(txn.setU8(key, keyValue(load, op, round)));
+        }
+        CHECK(txn.commit());
+    }
+
+    auto callerUs = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+    CHECK(sys.flushNVSCache());
+    auto flushUs = esp_timer_get_time() - start;
+
+    printRow("cached", callerUs, flushUs, before);
+
+    sys.getNVSCacheStats(&statsAfter);
+    printf("    %-14s %d unchanged  %d coalesced  %d space waits\n", "", statsAfter.writesUnchanged - statsBefore.writesUnchanged,
+           statsAfter.writesCoalesced - statsBefore.writesCoalesced, statsAfter.spaceWaits - statsBefore.spaceWaits);
+}
+
+static void runWriteThrough(const Load &load, int round, const char *name_space)
+{
+    NvsEmulatorCounters before;
+    NvsEmulator::getCounters(&before);
+    auto start = esp_timer_get_time();
+
+    for (int op = 0; op < BENCH_PRESSES; op++)
+    {
+        nvs_handle_t handle = 0;
+        CHECK(nvs_open(name_space, NVS_READWRITE, &handle) == ESP_OK);
+
+        for (uint8_t k = 0; k < load.keys; k++)
+        {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            keyName(load, op, k, key);
+            CHECK(nvs_set_u8(handle, key, keyValue(load, op, round)) == ESP_OK);
+        }
+        CHECK(nvs_commit(handle) == ESP_OK);
+        nvs_close(handle);
+    }
+
+    printRow("write through", esp_timer_get_time() - start, 0, before);
+}
+
+int main(void)
+{
+    auto &sys = System::getInstance();
+
+    const Load loads[] = {
+        {"presses", 3, 1, true},
+        {"unchanged", 3, 1, false},
+        {"200 keys", 1, BENCH_SPREAD_KEYS, true},
+    };
+
+    const uint32_t costs[][2] = {{0, 0}, {20, 200}}; // us per read, us per entry written
+
+    for (int round = 0; round < 2; round++)
+    {
+        auto &cost = costs[round];
+        NvsEmulator::setCost(cost[0], cost[1]);
+        printf("  flash %d us per read, %d us per entry\n", cost[0], cost[1]);
+
+        for (auto &load : loads)
+        {
+            printf("  %s\n", load.name);
+
+            char name_space[NVS_KEY_NAME_MAX_SIZE];
+            auto index = (int)(&load - loads);
+
+            snprintf(name_space, sizeof(name_space), "cached%d", index); // Each side keeps its own namespace per load
+            runCached(sys, load, round, name_space);
+
+            snprintf(name_space, sizeof(name_space), "direct%d", index);
+            runWriteThrough(load, round, name_space);
+        }
+    }
+
+    fflush(stdout);
+    _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS is still running -- no static destructors under it
+}
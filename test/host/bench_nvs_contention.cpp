@@ -0,0 +1,257 @@
+#include "system.hpp"
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Four tasks hammering NVS at once.  Each runs 1000 rounds of a read-write transaction setting three keys and a read-only
+// transaction reading them back, sleeping a tick after every tenth round, while the main task asks SYS::NVS for a flush
+// every 20 ms.  Flash is charged an assumed 20 us per read and 200 us per entry written, so a flush holds the emulated
+// flash for milliseconds while the tasks carry on.
+//
+//   own namespaces     what System does now -- one writer lock per namespace, readers take none
+//   one namespace      all four tasks share a namespace, so the writers do contend
+//   global lock        every transaction, reads as well, also holds one System wide mutex as semSYSEntry did
+//   old write through  the global lock held over nvs_open, three sets, commit and close as the old code did
+//
+// Each mode runs in a forked process on a fresh boot.  Latency is per round, waits included, sleeps not.  Contention and the longest wait come from System's lock stats for the
+// tasks' namespaces, or for the global lock from the bench's own count of the same thing -- a take that had to block.
+//
+#define BENCH_TASKS 4
+#define BENCH_ROUNDS 1000
+
+enum class Mode : uint8_t
+{
+    OwnNamespaces,
+    OneNamespace,
+    GlobalLock,
+    OldWriteThrough,
+};
+
+struct Worker
+{
+    Mode mode;
+    char name_space[NVS_KEY_NAME_MAX_SIZE];
+    std::vector<int64_t> latencies;
+    uint32_t contended; // Global lock only
+    int64_t waitMaxUs;
+};
+
+static SemaphoreHandle_t globalLock = nullptr;
+static SemaphoreHandle_t doneSem = nullptr;
+
+static void takeGlobal(Worker *worker)
+{
+    if (xSemaphoreTake(globalLock, 0) == pdTRUE)
+        return;
+
+    auto start = esp_timer_get_time();
+    xSemaphoreTake(globalLock, portMAX_DELAY);
+    worker->contended++;
+    worker->waitMaxUs = std::max(worker->waitMaxUs, esp_timer_get_time() - start);
+}
+
+static bool runRound(Worker *worker, int round)
+{
+    static const char *keys[3] = {"aValue", "bValue", "cValue"};
+    bool blnResult = true;
+    auto value = (uint8_t)round;
+    bool blnGlobal = (worker->mode == Mode::GlobalLock) || (worker->mode == Mode::OldWriteThrough);
+
+    if (blnGlobal)
+        takeGlobal(worker);
+
+    if (worker->mode == Mode::OldWriteThrough)
+    {
+        nvs_handle_t handle = 0;
+        blnResult = (nvs_open(worker->name_space, NVS_READWRITE, &handle) == ESP_OK);
+
+        for (auto key : keys)
+            blnResult &= (nvs_set_u8(handle, key, value) == ESP_OK);
+
+        blnResult &= (nvs_commit(handle) == ESP_OK);
+        nvs_close(handle);
+    }
+    else
+    {
+        NvsTransaction txn(worker->name_space);
+
+        for (auto key : keys)
+            blnResult &= txn.setU8(key, value);
+
+        blnResult &= txn.commit();
+    }
+
+    if (blnGlobal)
+    {
+        xSemaphoreGive(globalLock);
+        takeGlobal(worker);
+    }
+
+    if (worker->mode == Mode::OldWriteThrough)
+    {
+        nvs_handle_t handle = 0;
+        uint8_t read = 0;
+
+        blnResult &= (nvs_open(worker->name_space, NVS_READONLY, &handle) == ESP_OK);
+
+        for (auto key : keys)
+            blnResult &= (nvs_get_u8(handle, key, &read) == ESP_OK);
+
+        nvs_close(handle);
+    }
+    else
+    {
+        NvsTransaction txn(worker->name_space, SYS_NVS_MODE::ReadOnly);
+        uint8_t read = 0;
+
+        for (auto key : keys)
+            blnResult &= txn.getU8(key, &read);
+    }
+
+    if (blnGlobal)
+        xSemaphoreGive(globalLock);
+
+    return blnResult;
+}
+
+static void runWorker(void *arg)
+{
+    auto worker = (Worker *)arg;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        auto start = esp_timer_get_time();
+        CHECK(runRound(worker, round));
+        worker->latencies.push_back(esp_timer_get_time() - start);
+
+        if ((round % 10) == 9)
+            vTaskDelay(1);
+    }
+
+    xSemaphoreGive(doneSem);
+    vTaskDelete(nullptr);
+}
+
+static void benchmark(const char *name, Mode mode)
+{
+    globalLock = xSemaphoreCreateMutex();
+    doneSem = xSemaphoreCreateCounting(BENCH_TASKS, 0);
+
+    auto &sys = System::getInstance();
+    NvsEmulator::setCost(20, 200);
+
+    Worker workers[BENCH_TASKS];
+    SYS_NVSLockStats before[BENCH_TASKS] = {};
+
+    for (int i = 0; i < BENCH_TASKS; i++)
+    {
+        workers[i].mode = mode;
+        workers[i].contended = 0;
+        workers[i].waitMaxUs = 0;
+        snprintf(workers[i].name_space, NVS_KEY_NAME_MAX_SIZE, "task%d", (mode == Mode::OneNamespace) ? 0 : i);
+        workers[i].latencies.reserve(BENCH_ROUNDS);
+        sys.getNVSLockStats(workers[i].name_space, &before[i]);
+    }
+
+    SYS_NVSCacheStats cacheBefore, cacheAfter;
+    sys.getNVSCacheStats(&cacheBefore);
+
+    auto start = esp_timer_get_time();
+
+    for (auto &worker : workers)
+        xTaskCreate(runWorker, "bench", 1024 * 3, &worker, 5, nullptr);
+
+    int done = 0;
+
+    while (done < BENCH_TASKS)
+    {
+        if (xSemaphoreTake(doneSem, pdMS_TO_TICKS(20)) == pdTRUE)
+            done++;
+        else if (mode != Mode::OldWriteThrough)
+            sys.requestNVSFlush();
+    }
+
+    auto elapsedUs = esp_timer_get_time() - start;
+    sys.getNVSCacheStats(&cacheAfter);
+
+    std::vector<int64_t> latencies;
+
+    for (auto &worker : workers)
+        latencies.insert(latencies.end(), worker.latencies.begin(), worker.latencies.end());
+
+    std::sort(latencies.begin(), latencies.end());
+
+    uint32_t contended = 0;
+    int64_t waitMaxUs = 0;
+
+    for (int i = 0; i < BENCH_TASKS; i++)
+    {
+        if ((mode == Mode::GlobalLock) || (mode == Mode::OldWriteThrough))
+        {
+            contended += workers[i].contended;
+            waitMaxUs = std::max(waitMaxUs, workers[i].waitMaxUs);
+        }
+        else if ((mode == Mode::OwnNamespaces) || (i == 0)) // One namespace has the same stats four times
+        {
+            SYS_NVSLockStats after;
+            sys.getNVSLockStats(workers[i].name_space, &after);
+            contended += after.contended - before[i].contended;
+            waitMaxUs = std::max(waitMaxUs, (int64_t)after.waitMaxUs); // Since boot -- each mode boots its own System
+        }
+    }
+
+    auto rounds = latencies.size();
+    printf("  %-18s %6lld ms  p50 %6lld  p99 %6lld  max %7lld us   %5d contended  wait max %6lld us  %3d flushes\n", name,
+           (long long)(elapsedUs / 1000), (long long)latencies[rounds / 2], (long long)latencies[rounds * 99 / 100],
+           (long long)latencies[rounds - 1], contended, (long long)waitMaxUs, cacheAfter.flushes - cacheBefore.flushes);
+}
+
+int main(void)
+{
+    const struct
+    {
+        const char *name;
+        Mode mode;
+    } modes[] = {
+        {"own namespaces", Mode::OwnNamespaces},
+        {"one namespace", Mode::OneNamespace},
+        {"global lock", Mode::GlobalLock},
+        {"old write through", Mode::OldWriteThrough},
+    };
+
+    printf("  %d tasks x %d rounds on %d host cores, flash 20 us per read and 200 us per entry\n", BENCH_TASKS, BENCH_ROUNDS,
+           (int)std::thread::hardware_concurrency());
+    fflush(stdout);
+
+    int failures = 0;
+
+    for (auto &mode : modes) // A fresh boot for each, so System's lock stats start from nothing
+    {
+        auto pid = fork();
+
+        if (pid == 0)
+        {
+            benchmark(mode.name, mode.mode);
+            fflush(stdout);
+            _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS is still running -- no static destructors under it
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        failures += (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : 1;
+    }
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include "system.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Moving 500 keys into NVS: one NvsTransaction per key and a flush, against an image given to importNVS() in one piece and
+// the same image read from a UART in FIFO sized pieces.  Each import lands on flash that holds other values for all 500
+// keys, as does the second pass of key-by-key writes, so every path writes everything.  The export that made the image is
+// timed too.  Afterwards every key must read back what was written, through the cache and in a fresh export.
+//
+// Times are host time on the emulated partition, which charges nothing for flash -- they are what each path costs in CPU,
+// locking and hand-offs to SYS::NVS.  The emulator's counts are what it would cost in flash.
+//
+#define BENCH_NAMESPACES 4
+#define BENCH_KEYS_PER_NAMESPACE 125
+#define BENCH_STRING_EVERY 5 // Every fifth key is a string, the rest are U16
+
+static const char *benchNamespaces[BENCH_NAMESPACES] = {"bench0", "bench1", "bench2", "bench3"};
+
+static void keyName(int index, char *key)
+{
+    snprintf(key, NVS_KEY_NAME_MAX_SIZE, "key%03d", index);
+}
+
+static std::string stringValue(int index, int pass)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "value %03d of pass %d ------", index, pass); // 26 characters
+    return text;
+}
+
+static bool appendImage(void *ctx, const uint8_t *data, size_t length)
+{
+    ((std::string *)ctx)->append((const char *)data, length);
+    return true;
+}
+
+static void report(const char *name, int64_t elapsedUs, const NvsEmulatorCounters &before)
+{
+    NvsEmulatorCounters after;
+    NvsEmulator::getCounters(&after);
+
+    printf("  %-24s %8lld us   %5d reads  %5d scanned  %5d writes  %5d entries  %4d commits\n", name, (long long)elapsedUs,
+           after.reads - before.reads, after.scanned - before.scanned, after.writes - before.writes, after.entries - before.entries,
+           after.commits - before.commits);
+}
+
+static void writeKeyByKey(System &sys, int pass, const char *name)
+{
+    NvsEmulatorCounters before;
+    NvsEmulator::getCounters(&before);
+    auto start = esp_timer_get_time();
+
+    for (int n = 0; n < BENCH_NAMESPACES; n++)
+    {
+        for (int i = 0; i < BENCH_KEYS_PER_NAMESPACE; i++)
+        {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            keyName(i, key);
+
+            NvsTransaction txn(benchNamespaces[n]);
+
+            if ((i % BENCH_STRING_EVERY) == 0)
+                CHECK(txn.setString(key, stringValue(i, pass)));
+            else
+                CHECK(txn.setU16(key, (uint16_t)(i * 10 + pass)));
+
+            CHECK(txn.commit());
+        }
+    }
+    CHECK(sys.flushNVSCache());
+
+    report(name, esp_timer_get_time() - start, before);
+}
+
+static bool holdsPass(int pass)
+{
+    for (int n = 0; n < BENCH_NAMESPACES; n++)
+    {
+        NvsTransaction txn(benchNamespaces[n], SYS_NVS_MODE::ReadOnly);
+
+        for (int i = 0; i < BENCH_KEYS_PER_NAMESPACE; i++)
+        {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            keyName(i, key);
+
+            std::string text;
+            uint16_t value = 0;
+
+            if ((i % BENCH_STRING_EVERY) == 0)
+            {
+                if (!txn.getString(key, &text) || (text != stringValue(i, pass)))
+                    return false;
+            }
+            else if (!txn.getU16(key, &value) || (value != (uint16_t)(i * 10 + pass)))
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    auto &sys = System::getInstance();
+
+    printf("  %d keys in %d namespaces, one in %d a string\n", BENCH_NAMESPACES * BENCH_KEYS_PER_NAMESPACE, BENCH_NAMESPACES,
+           BENCH_STRING_EVERY);
+
+    writeKeyByKey(sys, 1, "key by key (new keys)");
+
+    std::string image;
+    SYS_NVSImageStats stats = {};
+    NvsEmulatorCounters before;
+    NvsEmulator::getCounters(&before);
+
+    CHECK(sys.exportNVS(benchNamespaces, BENCH_NAMESPACES, &appendImage, &image, &stats));
+    CHECK(stats.keys == BENCH_NAMESPACES * BENCH_KEYS_PER_NAMESPACE);
+    report("export", stats.elapsedUs, before);
+    printf("  %-24s %8d bytes\n", "image", (int)image.size());
+
+    writeKeyByKey(sys, 2, "key by key (overwrite)");
+    CHECK(holdsPass(2));
+
+    NvsEmulator::getCounters(&before);
+    CHECK(sys.importNVS((const uint8_t *)image.data(), image.size(), &stats));
+    CHECK(stats.keys == BENCH_NAMESPACES * BENCH_KEYS_PER_NAMESPACE);
+    report("import (in memory)", stats.elapsedUs, before);
+    CHECK(holdsPass(1));
+
+    writeKeyByKey(sys, 3, "key by key (overwrite)");
+
+    NvsEmulator::getCounters(&before);
+    SystemHost::setUARTImage((const uint8_t *)image.data(), image.size(), 120);
+    auto start = esp_timer_get_time();
+    CHECK(sys.importNVSFromUART(0, pdMS_TO_TICKS(20), &stats));
+    report("import (UART, 120 B)", esp_timer_get_time() - start, before);
+    CHECK(holdsPass(1));
+
+    std::string again;
+    CHECK(sys.exportNVS(benchNamespaces, BENCH_NAMESPACES, &appendImage, &again, nullptr));
+    CHECK(again == image);
+
+    fflush(stdout);
+    _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS is still running -- no static destructors under it
+}
@@ -0,0 +1,108 @@
+#include "system.hpp"
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Boot reads with and without the preload.  N keys are seeded in one namespace and read once each at boot, ten to a read-only
+// transaction, as init code reads its settings.  With the preload they live in "indication", which System preloads; without
+// it they live in a namespace it does not.  The preload walks the whole partition either way, so both pay for stepping over
+// the keys -- only one of them keeps what it read.  Each case is a fresh boot in a forked process.  Flash is charged an
+// assumed 20 us per read or scan step.
+//
+// Boot is System's constructor -- on the host that is NVS and nothing else -- and reads run from there until the last key.
+//
+#define BENCH_PER_TXN 10
+
+static void runBoot(int keys, bool blnPreload)
+{
+    auto name_space = blnPreload ? "indication" : "settings";
+    nvs_handle_t seed = 0;
+
+    CHECK(nvs_open(name_space, NVS_READWRITE, &seed) == ESP_OK);
+
+    for (int i = 0; i < keys; i++)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        snprintf(key, sizeof(key), "key%03d", i);
+        CHECK(nvs_set_u8(seed, key, (uint8_t)i) == ESP_OK);
+    }
+    CHECK(nvs_commit(seed) == ESP_OK);
+    nvs_close(seed);
+
+    NvsEmulator::setCost(20, 200);
+    NvsEmulator::resetCounters();
+
+    auto startTime = esp_timer_get_time();
+    auto &sys = System::getInstance();
+    auto bootUs = esp_timer_get_time() - startTime;
+
+    startTime = esp_timer_get_time();
+
+    for (int i = 0; i < keys; i += BENCH_PER_TXN)
+    {
+        NvsTransaction txn(name_space, SYS_NVS_MODE::ReadOnly);
+
+        for (int k = i; (k < keys) && (k < i + BENCH_PER_TXN); k++)
+        {
+            char key[NVS_KEY_NAME_MAX_SIZE];
+            uint8_t value = 0;
+
+            snprintf(key, sizeof(key), "key%03d", k);
+            CHECK(txn.getU8(key, &value) && (value == (uint8_t)k));
+        }
+    }
+
+    auto readUs = esp_timer_get_time() - startTime;
+
+    SYS_NVSPreloadStats preload;
+    SYS_NVSCacheStats cache;
+    NvsEmulatorCounters counters;
+
+    sys.getNVSPreloadStats(&preload);
+    sys.getNVSCacheStats(&cache);
+    NvsEmulator::getCounters(&counters);
+
+    printf("  %3d keys  %-8s %5lld us boot  %5lld us reads  %5lld us total   %3d preloaded %-12s %3d hits  %3d from flash in %5d us  "
+           "%3d scanned\n",
+           keys, blnPreload ? "preload" : "none", (long long)bootUs, (long long)readUs, (long long)(bootUs + readUs), preload.keys,
+           preload.blnTruncated ? "(cache full)" : "", preload.hits, cache.flashReads, cache.flashReadUs, counters.scanned);
+}
+
+int main(void)
+{
+    const int sizes[] = {50, 100, 200};
+
+    printf("  flash 20 us per read or scan step, %d cache entries\n", SYS_NVS_CACHE_ENTRIES);
+    fflush(stdout);
+
+    int failures = 0;
+
+    for (auto keys : sizes)
+    {
+        for (int preload = 1; preload >= 0; preload--)
+        {
+            auto pid = fork();
+
+            if (pid == 0)
+            {
+                runBoot(keys, preload != 0);
+                fflush(stdout);
+                _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS is still running -- no static destructors under it
+            }
+
+            int status = 0;
+            waitpid(pid, &status, 0);
+            failures += (WIFEXITED(status) && (WEXITSTATUS(status) == 0)) ? 0 : 1;
+        }
+    }
+
+    return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,176 @@
+#include "system.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+#include "host_test.hpp"
+#include "nvs_emulator.hpp"
+#include "system_host.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Repeated reads of one string, 10000 times each, at 16, 256 and 1500 bytes.  The old getStringFromNVS asked NVS for the
+// length, malloc'd a buffer, read the string into it, appended it to the caller's std::string and freed the buffer -- two
+// flash lookups and at least one allocation every time.  It is run here against its own handle, as it had one.  The
+// others are NvsTransaction reads from the cache, each in a read-only transaction of its own as a caller would use them.
+//
+// Heap allocations are counted through operator new, plus the old path's malloc.  Times are host time with flash free;
+// the emulator's count of lookups is what the old path would pay on the target.
+//
+#define BENCH_READS 10000
+#define BENCH_NAMESPACE "strings"
+
+static std::atomic<uint32_t> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+
+    if (auto block = malloc(size))
+        return block;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *block) noexcept
+{
+    free(block);
+}
+
+void operator delete(void *block, size_t) noexcept
+{
+    free(block);
+}
+
+struct Method
+{
+    const char *name;
+    bool (*read)(const char *, std::string *, size_t); // Key, where a std::string reader keeps its result, expected length
+};
+
+static nvs_handle_t oldHandle = 0;
+static uint32_t oldMallocs = 0;
+
+static bool readOld(const char *key, std::string *, size_t)
+{
+    std::string value; // The old call appended to whatever the caller passed -- a fresh string each time
+
+    size_t length = 0;
+
+    if ((nvs_get_str(oldHandle, key, NULL, &length) != ESP_OK) || (length == 0))
+        return false;
+
+    char *buffer = (char *)malloc(length);
+    oldMallocs++;
+
+    bool blnResult = (nvs_get_str(oldHandle, key, buffer, &length) == ESP_OK);
+
+    if (blnResult)
+        value.append(buffer);
+
+    free(buffer);
+    return blnResult;
+}
+
+static bool readFreshString(const char *key, std::string *, size_t length)
+{
+    std::string value;
+    NvsTransaction txn(BENCH_NAMESPACE, SYS_NVS_MODE::ReadOnly);
+    return txn.getString(key, &value) && (value.size() == length);
+}
+
+static bool readReusedString(const char *key, std::string *value, size_t length)
+{
+    NvsTransaction txn(BENCH_NAMESPACE, SYS_NVS_MODE::ReadOnly);
+    return txn.getString(key, value) && (value->size() == length);
+}
+
+static bool readBuffer(const char *key, std::string *, size_t length)
+{
+    char buffer[2048];
+    size_t size = sizeof(buffer);
+    NvsTransaction txn(BENCH_NAMESPACE, SYS_NVS_MODE::ReadOnly);
+    return txn.getString(key, buffer, &size) && (size == length + 1);
+}
+
+static bool readFixed(const char *key, std::string *, size_t length)
+{
+    SYS_FixedString<2048> value;
+    NvsTransaction txn(BENCH_NAMESPACE, SYS_NVS_MODE::ReadOnly);
+    return txn.getString(key, &value) && (value.length == length);
+}
+
+static bool readProbeThenBuffer(const char *key, std::string *, size_t length)
+{
+    char buffer[2048];
+    size_t size = 0;
+    NvsTransaction txn(BENCH_NAMESPACE, SYS_NVS_MODE::ReadOnly);
+
+    if (!txn.getStringLength(key, &size) || (size > sizeof(buffer)))
+        return false;
+
+    return txn.getString(key, buffer, &size) && (size == length + 1);
+}
+
+int main(void)
+{
+    const size_t lengths[] = {16, 256, 1500};
+
+    const Method methods[] = {
+        {"getStringFromNVS (old)", &readOld},
+        {"std::string, fresh", &readFreshString},
+        {"std::string, reused", &readReusedString},
+        {"char buffer", &readBuffer},
+        {"length, then buffer", &readProbeThenBuffer},
+        {"SYS_FixedString<2048>", &readFixed},
+    };
+
+    nvs_handle_t seed = 0; // Flash holds the strings before System comes up
+    CHECK(nvs_open(BENCH_NAMESPACE, NVS_READWRITE, &seed) == ESP_OK);
+
+    for (auto length : lengths)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        snprintf(key, sizeof(key), "str%d", (int)length);
+        CHECK(nvs_set_str(seed, key, std::string(length, 'x').c_str()) == ESP_OK);
+    }
+    nvs_close(seed);
+    CHECK(nvs_open(BENCH_NAMESPACE, NVS_READONLY, &oldHandle) == ESP_OK);
+
+    System::getInstance();
+
+    for (auto length : lengths)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        snprintf(key, sizeof(key), "str%d", (int)length);
+        printf("  %d bytes\n", (int)length);
+
+        for (auto &method : methods)
+        {
+            std::string reused;
+            NvsEmulatorCounters before, after;
+
+            CHECK(method.read(key, &reused, length)); // Not timed -- the first read of a key comes from flash
+            NvsEmulator::getCounters(&before);
+            oldMallocs = 0;
+            uint32_t allocated = allocations;
+            auto start = esp_timer_get_time();
+
+            for (int i = 0; i < BENCH_READS; i++)
+                CHECK(method.read(key, &reused, length));
+
+            auto elapsedUs = esp_timer_get_time() - start;
+            allocated = allocations - allocated + oldMallocs;
+            NvsEmulator::getCounters(&after);
+
+            printf("    %-24s %8.1f ns/read  %5.2f allocations/read  %5.2f lookups/read\n", method.name,
+                   elapsedUs * 1000.0 / BENCH_READS, (double)allocated / BENCH_READS, (double)(after.reads - before.reads) / BENCH_READS);
+        }
+    }
+
+    fflush(stdout);
+    _exit((hostTestFailures == 0) ? 0 : 1); // SYS::NVS is still running -- no static destructors under it
+}
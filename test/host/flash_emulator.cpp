@@ -0,0 +1,110 @@
+#include "flash_emulator.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+static std::vector<uint8_t> flash;
+static esp_partition_t partition = {};
+static long budget = -1;
+static uint32_t written = 0;
+static uint32_t erased = 0;
+
+void FlashEmulator::format(uint32_t size)
+{
+    flash.assign(size, 0xFF);
+
+    partition.type = ESP_PARTITION_TYPE_DATA;
+    partition.subtype = 0x40;
+    partition.address = 0x300000;
+    partition.size = size;
+    strcpy(partition.label, "logstore");
+
+    budget = -1;
+    written = 0;
+    erased = 0;
+}
+
+void FlashEmulator::fill(size_t offset, size_t length, uint8_t value)
+{
+    memset(flash.data() + offset, value, length);
+}
+
+void FlashEmulator::cutAfter(long bytes)
+{
+    budget = bytes;
+}
+
+bool FlashEmulator::cutArmed(void)
+{
+    return budget >= 0;
+}
+
+uint32_t FlashEmulator::bytesWritten(void)
+{
+    return written;
+}
+
+uint32_t FlashEmulator::erases(void)
+{
+    return erased;
+}
+
+static bool powerFails(void)
+{
+    return (budget >= 0) && (budget-- == 0);
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    if (flash.empty() || (type != partition.type) || (subtype != partition.subtype) || (strcmp(label, partition.label) != 0))
+        return nullptr;
+
+    return &partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if ((part != &partition) || (offset + size > flash.size()))
+        return ESP_FAIL;
+
+    memcpy(dst, flash.data() + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if ((part != &partition) || (offset + size > flash.size()))
+        return ESP_FAIL;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (powerFails())
+            throw PowerCut();
+
+        flash[offset + i] &= ((const uint8_t *)src)[i];
+        written++;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if ((part != &partition) || (offset + size > flash.size()) || (offset % 4096) || (size % 4096))
+        return ESP_FAIL;
+
+    erased++;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        if (powerFails())
+        {
+            for (size_t j = i; j < size; j++)
+                flash[offset + j] = (uint8_t)rand();
+            throw PowerCut();
+        }
+        flash[offset + i] = 0xFF;
+    }
+    return ESP_OK;
+}
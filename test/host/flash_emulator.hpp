@@ -0,0 +1,26 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+//
+// RAM backed stand-in for one data partition with NOR semantics -- a write can only clear bits and an erase sets a whole
+// range back to 0xFF.  Arm a power cut with cutAfter(n): the n-th byte written or erased from then on throws PowerCut.
+// The byte being written when the power goes keeps whatever the cell held, and an erase cut short leaves the rest of its
+// range holding garbage.
+//
+struct PowerCut
+{
+};
+
+namespace FlashEmulator
+{
+void format(uint32_t); // Partition size in bytes.  Starts out blank.
+void fill(size_t, size_t, uint8_t);
+void cutAfter(long); // -1 disarms
+bool cutArmed(void);
+
+uint32_t bytesWritten(void);
+uint32_t erases(void);
+} // namespace FlashEmulator
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+//
+// FreeRTOS on host threads.  Each task is a detached std::thread and every blocking call waits on a condition variable for
+// at most its timeout (one tick is 1 ms).  There is no scheduler -- priorities are ignored and tasks really do run at the
+// same time, which is harsher than one core with priorities and finds the same races.
+//
+// Single threaded tests see what they always did.  Taking a mutex the calling task already holds aborts, as it would
+// deadlock on the target, and so does giving one it does not hold.  Critical sections keep their nesting count.
+//
+struct HostTask
+{
+    const char *name = "";
+    std::mutex lock;
+    std::condition_variable wake;
+    uint32_t notifyValue = 0;
+    bool blnNotified = false;
+};
+
+struct HostTaskExit // Thrown by vTaskDelete() to unwind a task's thread
+{
+};
+
+static thread_local HostTask *currentTask = nullptr;
+
+static HostTask *selfTask(void)
+{
+    if (currentTask == nullptr) // main(), or a thread the test started itself
+    {
+        currentTask = new HostTask();
+        currentTask->name = "main";
+    }
+    return currentTask;
+}
+
+template <typename Ready>
+static bool waitTicks(std::unique_lock<std::mutex> &guard, std::condition_variable &changed, TickType_t ticks, Ready ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        changed.wait(guard, ready);
+        return true;
+    }
+    return changed.wait_for(guard, std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS), ready);
+}
+
+//
+// Critical Sections
+//
+void hostEnterCritical(portMUX_TYPE *mux)
+{
+    void *self = selfTask();
+
+    if (__atomic_load_n(&mux->owner, __ATOMIC_ACQUIRE) != self)
+    {
+        void *expected = nullptr;
+
+        while (!__atomic_compare_exchange_n(&mux->owner, &expected, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            expected = nullptr;
+            std::this_thread::yield();
+        }
+    }
+    mux->nesting++;
+}
+
+void hostExitCritical(portMUX_TYPE *mux)
+{
+    if (--mux->nesting == 0)
+        __atomic_store_n(&mux->owner, nullptr, __ATOMIC_RELEASE);
+}
+
+//
+// Tasks
+//
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t, void *arg, UBaseType_t, TaskHandle_t *handle)
+{
+    auto task = new HostTask();
+    task->name = name;
+
+    if (handle != nullptr) // Set before the task runs, as FreeRTOS does
+        *handle = task;
+
+    std::thread([=]() {
+        currentTask = task;
+
+        try
+        {
+            function(arg);
+        }
+        catch (const HostTaskExit &)
+        {
+        }
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                                   TaskHandle_t *handle, BaseType_t)
+{
+    return xTaskCreate(function, name, stack, arg, priority, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if ((handle != nullptr) && (handle != selfTask()))
+    {
+        fprintf(stderr, "vTaskDelete of another task is not emulated\n");
+        abort();
+    }
+    throw HostTaskExit();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return (TickType_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return selfTask();
+}
+
+//
+// Task Notifications
+//
+BaseType_t xTaskNotify(TaskHandle_t handle, uint32_t value, eNotifyAction action)
+{
+    auto task = (HostTask *)handle;
+    std::lock_guard<std::mutex> guard(task->lock);
+
+    switch (action)
+    {
+    case eSetBits:
+        task->notifyValue |= value;
+        break;
+    case eIncrement:
+        task->notifyValue++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notifyValue = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (task->blnNotified)
+            return pdFAIL;
+        task->notifyValue = value;
+        break;
+    case eNoAction:
+        break;
+    }
+
+    task->blnNotified = true;
+    task->wake.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xTaskNotifyFromISR(TaskHandle_t handle, uint32_t value, eNotifyAction action, BaseType_t *woken)
+{
+    if (woken != nullptr)
+        *woken = pdFALSE;
+    return xTaskNotify(handle, value, action);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clearOnEntry, uint32_t clearOnExit, uint32_t *value, TickType_t ticks)
+{
+    auto task = selfTask();
+    std::unique_lock<std::mutex> guard(task->lock);
+
+    if (!task->blnNotified)
+        task->notifyValue &= ~clearOnEntry;
+
+    bool blnNotified = waitTicks(guard, task->wake, ticks, [task]() { return task->blnNotified; });
+
+    if (value != nullptr)
+        *value = task->notifyValue;
+
+    if (!blnNotified)
+        return pdFALSE;
+
+    task->notifyValue &= ~clearOnExit;
+    task->blnNotified = false;
+    return pdTRUE;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    return xTaskNotify(handle, 0, eIncrement);
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t handle, BaseType_t *woken)
+{
+    xTaskNotifyFromISR(handle, 0, eIncrement, woken);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t blnClearOnExit, TickType_t ticks)
+{
+    auto task = selfTask();
+    std::unique_lock<std::mutex> guard(task->lock);
+
+    waitTicks(guard, task->wake, ticks, [task]() { return task->notifyValue != 0; });
+
+    auto value = task->notifyValue;
+
+    if (value != 0)
+        task->notifyValue = blnClearOnExit ? 0 : value - 1;
+
+    task->blnNotified = false;
+    return value;
+}
+
+//
+// Queues
+//
+struct HostQueue
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    std::vector<uint8_t> items; // A ring of length slots
+    size_t itemSize = 0;
+    size_t length = 0;
+    size_t head = 0;
+    size_t count = 0;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    auto queue = new HostQueue();
+    queue->items.resize((size_t)length * itemSize);
+    queue->itemSize = itemSize;
+    queue->length = length;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t handle)
+{
+    delete (HostQueue *)handle;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+    auto queue = (HostQueue *)handle;
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!waitTicks(guard, queue->changed, ticks, [queue]() { return queue->count < queue->length; }))
+        return pdFALSE;
+
+    auto tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->itemSize], item, queue->itemSize);
+    queue->count++;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t handle, const void *item, TickType_t ticks)
+{
+    return xQueueSend(handle, item, ticks);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t handle, const void *item, BaseType_t *woken)
+{
+    if (woken != nullptr)
+        *woken = pdFALSE;
+    return xQueueSend(handle, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t ticks)
+{
+    auto queue = (HostQueue *)handle;
+    std::unique_lock<std::mutex> guard(queue->lock);
+
+    if (!waitTicks(guard, queue->changed, ticks, [queue]() { return queue->count > 0; }))
+        return pdFALSE;
+
+    memcpy(item, &queue->items[queue->head * queue->itemSize], queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    queue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+    auto queue = (HostQueue *)handle;
+    std::lock_guard<std::mutex> guard(queue->lock);
+    return (UBaseType_t)queue->count;
+}
+
+//
+// Semaphores.  A mutex remembers its holder.
+//
+struct HostSemaphore
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t count = 0;
+    UBaseType_t max = 1;
+    bool blnMutex = false;
+    HostTask *holder = nullptr;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    auto sem = new HostSemaphore();
+    sem->count = 1;
+    sem->blnMutex = true;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return new HostSemaphore();
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    auto sem = new HostSemaphore();
+    sem->count = initial;
+    sem->max = max;
+    return sem;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle)
+{
+    delete (HostSemaphore *)handle;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t ticks)
+{
+    auto sem = (HostSemaphore *)handle;
+    auto self = selfTask();
+    std::unique_lock<std::mutex> guard(sem->lock);
+
+    if (sem->blnMutex && (sem->holder == self))
+    {
+        fprintf(stderr, "Mutex taken twice by %s -- this deadlocks on the target\n", self->name);
+        abort();
+    }
+
+    if (!waitTicks(guard, sem->changed, ticks, [sem]() { return sem->count > 0; }))
+        return pdFALSE;
+
+    sem->count--;
+
+    if (sem->blnMutex)
+        sem->holder = self;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle)
+{
+    auto sem = (HostSemaphore *)handle;
+    std::lock_guard<std::mutex> guard(sem->lock);
+
+    if (sem->blnMutex && (sem->holder != selfTask()))
+    {
+        fprintf(stderr, "Mutex given by %s, which does not hold it -- this asserts on the target\n", selfTask()->name);
+        abort();
+    }
+
+    if (sem->count >= sem->max)
+        return pdFALSE;
+
+    sem->count++;
+    sem->holder = nullptr;
+    sem->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t handle, BaseType_t *woken)
+{
+    if (woken != nullptr)
+        *woken = pdFALSE;
+    return xSemaphoreGive(handle);
+}
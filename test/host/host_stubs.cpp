@@ -0,0 +1,70 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+//
+// IDF calls shared by every host test (FreeRTOS is in host_rtos.cpp).  Logs are dropped unless HOST_TEST_LOG is set in the
+// environment.
+//
+void esp_log_level_set(const char *, esp_log_level_t)
+{
+}
+
+void esp_log_write(esp_log_level_t, const char *tag, const char *format, ...)
+{
+    static int blnShow = -1;
+
+    if (blnShow < 0)
+        blnShow = (getenv("HOST_TEST_LOG") != nullptr);
+
+    if (!blnShow)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    printf("%s", tag);
+    vprintf(format, args);
+    va_end(args);
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+const char *esp_err_to_name(esp_err_t err)
+{
+    static char text[16];
+
+    snprintf(text, sizeof(text), "0x%x", err);
+    return text;
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t) // There is no restart to run them for
+{
+    return ESP_OK;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 0;
+}
+
+esp_reset_reason_t esp_reset_reason(void) // Every host run is a cold boot
+{
+    return ESP_RST_POWERON;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdio.h>
+
+//
+// Just enough of a test harness for ctest.  A failed CHECK reports where and marks the run failed -- the test keeps going so
+// one run shows every failure.
+//
+extern int hostTestFailures;
+
+#define CHECK(condition)                                                                     \
+    do                                                                                       \
+    {                                                                                        \
+        if (!(condition))                                                                    \
+        {                                                                                    \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);             \
+            hostTestFailures++;                                                              \
+        }                                                                                    \
+    } while (0)
+
+#define RUN_TEST(test)                                     \
+    do                                                     \
+    {                                                      \
+        auto before = hostTestFailures;                    \
+        test();                                            \
+        printf("%-40s %s\n", #test, (hostTestFailures == before) ? "ok" : "FAILED"); \
+    } while (0)
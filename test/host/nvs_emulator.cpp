@@ -0,0 +1,340 @@
+#include "nvs_emulator.hpp"
+
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nvs_flash.h"
+
+#define NVS_ENTRY_SIZE 32
+
+struct NvsItem
+{
+    nvs_type_t type;
+    std::string data; // Strings include their terminator
+};
+
+typedef std::map<std::string, NvsItem> NvsKeys;
+
+struct NvsHandle
+{
+    std::string name_space;
+    bool blnReadWrite;
+};
+
+struct nvs_opaque_iterator_t
+{
+    std::vector<nvs_entry_info_t> entries;
+    size_t next;
+};
+
+static std::mutex lock; // The flash -- one caller at a time
+static std::map<std::string, NvsKeys> partition;
+static std::map<nvs_handle_t, NvsHandle> handles;
+static nvs_handle_t lastHandle = 0;
+static NvsEmulatorCounters counters = {};
+static uint32_t readCostUs = 0;
+static uint32_t entryCostUs = 0;
+
+static void spin(uint32_t us)
+{
+    if (us == 0)
+        return;
+
+    auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(us);
+
+    while (std::chrono::steady_clock::now() < until)
+    {
+    }
+}
+
+static uint32_t entryCount(const NvsItem &item)
+{
+    if ((item.type == NVS_TYPE_STR) || (item.type == NVS_TYPE_BLOB))
+        return 1 + (uint32_t)((item.data.size() + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+
+    return 1;
+}
+
+void NvsEmulator::erase(void)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    partition.clear();
+    handles.clear();
+}
+
+void NvsEmulator::setCost(uint32_t readUs, uint32_t entryUs)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    readCostUs = readUs;
+    entryCostUs = entryUs;
+}
+
+void NvsEmulator::resetCounters(void)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    counters = {};
+}
+
+void NvsEmulator::getCounters(NvsEmulatorCounters *result)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    *result = counters;
+}
+
+uint32_t NvsEmulator::keys(const char *name_space)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto ns = partition.find(name_space);
+    return (ns == partition.end()) ? 0 : (uint32_t)ns->second.size();
+}
+
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    NvsEmulator::erase();
+    return ESP_OK;
+}
+
+//
+// Handles
+//
+esp_err_t nvs_open(const char *name_space, nvs_open_mode_t mode, nvs_handle_t *handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if ((name_space == nullptr) || (strlen(name_space) >= NVS_KEY_NAME_MAX_SIZE))
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    if (partition.find(name_space) == partition.end())
+    {
+        if (mode == NVS_READONLY)
+            return ESP_ERR_NVS_NOT_FOUND;
+
+        partition[name_space]; // The namespace entry
+        counters.writes++;
+        counters.entries++;
+        spin(entryCostUs);
+    }
+
+    *handle = ++lastHandle;
+    handles[*handle] = {name_space, mode == NVS_READWRITE};
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    handles.erase(handle);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (handles.find(handle) == handles.end())
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    counters.commits++;
+    return ESP_OK;
+}
+
+//
+// Values
+//
+static esp_err_t getItem(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *length)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto h = handles.find(handle);
+
+    if (h == handles.end())
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    counters.reads++;
+    spin(readCostUs);
+
+    auto &keys = partition[h->second.name_space];
+    auto item = keys.find(key);
+
+    if ((item == keys.end()) || (item->second.type != type))
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    auto &data = item->second.data;
+
+    if (length == nullptr) // Integer -- the caller knows the size
+    {
+        memcpy(out, data.data(), data.size());
+        return ESP_OK;
+    }
+
+    if (out == nullptr) // Size query
+    {
+        *length = data.size();
+        return ESP_OK;
+    }
+
+    if (*length < data.size())
+    {
+        *length = data.size();
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(out, data.data(), data.size());
+    *length = data.size();
+    return ESP_OK;
+}
+
+static esp_err_t setItem(nvs_handle_t handle, const char *key, nvs_type_t type, const void *in, size_t length)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto h = handles.find(handle);
+
+    if (h == handles.end())
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    if (!h->second.blnReadWrite)
+        return ESP_ERR_NVS_READ_ONLY;
+
+    if ((key == nullptr) || (strlen(key) >= NVS_KEY_NAME_MAX_SIZE))
+        return ESP_ERR_NVS_INVALID_NAME;
+
+    counters.reads++; // The library looks the key up first -- to compare, or to erase the old entries once the new ones are in
+    spin(readCostUs);
+
+    NvsItem value = {type, std::string((const char *)in, length)};
+    auto &keys = partition[h->second.name_space];
+    auto item = keys.find(key);
+
+    if ((item != keys.end()) && (item->second.type == type) && (item->second.data == value.data))
+        return ESP_OK;
+
+    auto entries = entryCount(value);
+    keys[key] = value;
+
+    counters.writes++;
+    counters.entries += entries;
+    spin(entries * entryCostUs);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *value)
+{
+    return getItem(handle, key, NVS_TYPE_U8, value, nullptr);
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *value)
+{
+    return getItem(handle, key, NVS_TYPE_U16, value, nullptr);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *length)
+{
+    return getItem(handle, key, NVS_TYPE_STR, value, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *value, size_t *length)
+{
+    return getItem(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return setItem(handle, key, NVS_TYPE_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value)
+{
+    return setItem(handle, key, NVS_TYPE_U16, &value, sizeof(value));
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return setItem(handle, key, NVS_TYPE_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    return setItem(handle, key, NVS_TYPE_BLOB, value, length);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto h = handles.find(handle);
+
+    if (h == handles.end())
+        return ESP_ERR_NVS_INVALID_HANDLE;
+
+    if (!h->second.blnReadWrite)
+        return ESP_ERR_NVS_READ_ONLY;
+
+    if (partition[h->second.name_space].erase(key) == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    counters.writes++; // Marking the entries erased is a write to each of them, but only a few bits
+    counters.entries++;
+    spin(entryCostUs);
+    return ESP_OK;
+}
+
+//
+// Iterators take a snapshot, so the partition may change while one is open
+//
+nvs_iterator_t nvs_entry_find(const char *, const char *name_space, nvs_type_t type)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = new nvs_opaque_iterator_t();
+    it->next = 0;
+
+    for (auto &ns : partition)
+    {
+        for (auto &item : ns.second)
+        {
+            counters.scanned++;
+            spin(readCostUs);
+
+            if (((name_space != nullptr) && (ns.first != name_space)) || ((type != NVS_TYPE_ANY) && (item.second.type != type)))
+                continue;
+
+            nvs_entry_info_t info = {};
+            strcpy(info.namespace_name, ns.first.c_str());
+            strcpy(info.key, item.first.c_str());
+            info.type = item.second.type;
+            it->entries.push_back(info);
+        }
+    }
+
+    if (it->entries.empty())
+    {
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+nvs_iterator_t nvs_entry_next(nvs_iterator_t it)
+{
+    if (++it->next < it->entries.size())
+        return it;
+
+    delete it;
+    return nullptr;
+}
+
+void nvs_entry_info(nvs_iterator_t it, nvs_entry_info_t *info)
+{
+    *info = it->entries[it->next];
+}
+
+void nvs_release_iterator(nvs_iterator_t it)
+{
+    delete it;
+}
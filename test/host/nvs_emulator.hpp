@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+#include "nvs.h"
+
+//
+// RAM backed stand-in for the NVS library.  Values live in a map, so nothing here is a model of the page layout -- but every
+// call that would touch flash is counted the way the library pays for it.  A key read is one lookup, a scan step is one item
+// header and a set looks its key up and then writes one 32 byte entry, plus one per 32 bytes of string or blob data.  A set
+// that leaves the value as it was writes nothing, as the library compares before it writes.
+//
+// With setCost() each of those spins for the given time while holding the emulator, as flash holds everyone on the target.
+//
+struct NvsEmulatorCounters
+{
+    uint32_t reads;   // nvs_get_* and nvs_set_* lookups
+    uint32_t scanned; // Entries stepped over by an iterator
+    uint32_t writes;  // Sets and erases that changed flash
+    uint32_t entries; // 32 byte entries written
+    uint32_t commits;
+};
+
+namespace NvsEmulator
+{
+void erase(void);                  // Every namespace gone and every handle closed.  Counters and costs are kept.
+void setCost(uint32_t, uint32_t);  // us per read or scan step, us per entry written
+void resetCounters(void);
+void getCounters(NvsEmulatorCounters *);
+uint32_t keys(const char *);       // Keys held in a namespace
+} // namespace NvsEmulator
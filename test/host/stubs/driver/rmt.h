@@ -0,0 +1,11 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int rmt_channel_t;
+
+esp_err_t rmt_write_sample(rmt_channel_t, const uint8_t *, size_t, bool);
+esp_err_t rmt_wait_tx_done(rmt_channel_t, TickType_t);
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef int uart_port_t;
+
+int uart_read_bytes(uart_port_t, void *, uint32_t, TickType_t); // Supplied by the test that imports from a UART
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t, uint8_t const *, uint32_t);
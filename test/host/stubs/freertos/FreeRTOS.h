@@ -0,0 +1,40 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOSConfig.h"
+
+typedef uint32_t TickType_t;
+typedef int32_t BaseType_t;
+typedef uint32_t UBaseType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define portYIELD_FROM_ISR(woken) (void)(woken)
+
+//
+// Critical sections are a spin lock owned by the task that entered them (see host_rtos.cpp).  They nest like the target's,
+// and the nesting count is left for the tests to check that every enter had its exit.
+//
+typedef struct
+{
+    int nesting;
+    void *owner;
+} portMUX_TYPE;
+
+void hostEnterCritical(portMUX_TYPE *);
+void hostExitCritical(portMUX_TYPE *);
+
+#define portMUX_INITIALIZER_UNLOCKED {0, nullptr}
+#define portENTER_CRITICAL(mux) hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) hostExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
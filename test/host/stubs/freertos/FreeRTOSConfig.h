@@ -0,0 +1,5 @@
+#pragma once
+//
+// Host build -- one tick is one millisecond.
+//
+#define configTICK_RATE_HZ 1000
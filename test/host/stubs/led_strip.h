@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef struct led_strip_s led_strip_t;
+
+struct led_strip_s
+{
+    esp_err_t (*set_pixel)(led_strip_t *, uint32_t, uint32_t, uint32_t, uint32_t);
+    esp_err_t (*refresh)(led_strip_t *, uint32_t);
+    esp_err_t (*clear)(led_strip_t *, uint32_t);
+    esp_err_t (*del)(led_strip_t *);
+};
+
+led_strip_t *led_strip_init(uint8_t, uint8_t, uint16_t); // Channel, GPIO, pixels
@@ -0,0 +1,8 @@
+#pragma once
+//
+// Host build -- only the options the tested sources read.
+//
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_SYS_NVS_FLUSH_QUIET_MS 2000
+#define CONFIG_SYS_NVS_CACHE_ENTRIES 64
+#define CONFIG_IND_LED_COUNT 1
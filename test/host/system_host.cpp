@@ -0,0 +1,197 @@
+#include "system.hpp"
+#include "system_host.hpp"
+
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "driver/rmt.h"
+#include "led_strip.h"
+
+System::System(void)
+{
+    esp_log_level_set(TAG, ESP_LOG_INFO);
+    initNVS();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    static const auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+//
+// esp_timer.  One dispatch thread runs every callback in deadline order, as the esp_timer task does.
+//
+struct esp_timer
+{
+    esp_timer_create_args_t args;
+    int64_t dueUs;
+    uint64_t periodUs; // Zero for a one-shot
+    bool blnArmed;
+};
+
+static std::mutex timerLock;
+static std::condition_variable timerChanged;
+static std::vector<esp_timer_handle_t> timers;
+static bool blnDispatching = false;
+
+static void runTimers(void)
+{
+    std::unique_lock<std::mutex> guard(timerLock);
+
+    while (true)
+    {
+        esp_timer_handle_t next = nullptr;
+
+        for (auto timer : timers)
+        {
+            if (timer->blnArmed && ((next == nullptr) || (timer->dueUs < next->dueUs)))
+                next = timer;
+        }
+
+        if (next == nullptr)
+        {
+            timerChanged.wait(guard);
+            continue;
+        }
+
+        auto waitUs = next->dueUs - esp_timer_get_time();
+
+        if (waitUs > 0)
+        {
+            timerChanged.wait_for(guard, std::chrono::microseconds(waitUs)); // Then look again -- it may have been stopped
+            continue;
+        }
+
+        if (next->periodUs > 0)
+            next->dueUs += next->periodUs;
+        else
+            next->blnArmed = false;
+
+        auto args = next->args;
+        guard.unlock();
+        args.callback(args.arg);
+        guard.lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *handle)
+{
+    std::lock_guard<std::mutex> guard(timerLock);
+
+    if (!blnDispatching)
+    {
+        std::thread(runTimers).detach();
+        blnDispatching = true;
+    }
+
+    *handle = new esp_timer{*args, 0, 0, false};
+    timers.push_back(*handle);
+    return ESP_OK;
+}
+
+static esp_err_t startTimer(esp_timer_handle_t timer, uint64_t us, uint64_t periodUs)
+{
+    std::lock_guard<std::mutex> guard(timerLock);
+
+    if (timer->blnArmed)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->dueUs = esp_timer_get_time() + (int64_t)us;
+    timer->periodUs = periodUs;
+    timer->blnArmed = true;
+    timerChanged.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t us)
+{
+    return startTimer(timer, us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t us)
+{
+    return startTimer(timer, us, us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(timerLock);
+
+    if (!timer->blnArmed)
+        return ESP_ERR_INVALID_STATE;
+
+    timer->blnArmed = false;
+    timerChanged.notify_all();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    std::lock_guard<std::mutex> guard(timerLock);
+
+    if (timer->blnArmed)
+        return ESP_ERR_INVALID_STATE;
+
+    for (auto it = timers.begin(); it != timers.end(); ++it)
+    {
+        if (*it == timer)
+        {
+            timers.erase(it);
+            break;
+        }
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+//
+// The LED strip.  There is nothing on the other end, so every frame is sent at once.
+//
+led_strip_t *led_strip_init(uint8_t, uint8_t, uint16_t)
+{
+    static led_strip_t strip = {};
+    return &strip;
+}
+
+esp_err_t rmt_write_sample(rmt_channel_t, const uint8_t *, size_t, bool)
+{
+    return ESP_OK;
+}
+
+esp_err_t rmt_wait_tx_done(rmt_channel_t, TickType_t)
+{
+    return ESP_OK;
+}
+
+//
+// The UART holds one image.  Once it has all been read the line is quiet and every read returns nothing.
+//
+static const uint8_t *uartImage = nullptr;
+static size_t uartLength = 0;
+static size_t uartChunk = 0;
+
+void SystemHost::setUARTImage(const uint8_t *data, size_t length, size_t chunk)
+{
+    uartImage = data;
+    uartLength = length;
+    uartChunk = chunk;
+}
+
+int uart_read_bytes(uart_port_t, void *buffer, uint32_t size, TickType_t)
+{
+    size_t length = (uartLength < uartChunk) ? uartLength : uartChunk;
+
+    if (length > size)
+        length = size;
+
+    memcpy(buffer, uartImage, length);
+    uartImage += length;
+    uartLength -= length;
+    return (int)length;
+}
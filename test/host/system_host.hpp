@@ -0,0 +1,16 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// System for the NVS benchmarks.  Its constructor (system_host.cpp) only brings up NVS -- SYS::NVS, the preload and the log
+// store -- on top of the NVS and flash emulators.  GPIO, the timer and SYS::Run are not linked.  esp_timer and a strip with
+// nothing on the other end are there, so a benchmark may link Indication and construct one against it.
+//
+// Call System::getInstance() only once the emulated partition holds what the boot should find.  A benchmark that wants a
+// fresh boot forks first, so each child constructs its own System.
+//
+namespace SystemHost
+{
+void setUARTImage(const uint8_t *, size_t, size_t); // What uart_read_bytes() hands out, and in chunks of at most this size
+} // namespace SystemHost
@@ -0,0 +1,332 @@
+#include "system_logstore.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "flash_emulator.hpp"
+#include "host_test.hpp"
+
+int hostTestFailures = 0;
+
+//
+// LogStore against an emulated partition.  Every reboot is a fresh LogStore mounted on what the flash holds at that moment,
+// so nothing is carried over in RAM.
+//
+#define TEST_SECTORS 12
+
+typedef std::map<std::string, std::vector<uint8_t>> Model;
+
+static bool matches(LogStore &store, const Model &model)
+{
+    for (const auto &kv : model)
+    {
+        uint8_t value[SYS_LOG_MAX_VALUE];
+        size_t length = sizeof(value);
+
+        if (!store.get(kv.first.c_str(), value, &length) || (length != kv.second.size()) || (memcmp(value, kv.second.data(), length) != 0))
+        {
+            printf("  %s does not hold its last value\n", kv.first.c_str());
+            return false;
+        }
+    }
+
+    SYS_LogStoreStats stats;
+    store.getStats(&stats);
+
+    if (stats.liveKeys != model.size())
+    {
+        printf("  %d live keys, expected %d\n", stats.liveKeys, (int)model.size());
+        return false;
+    }
+    return true;
+}
+
+static std::vector<uint8_t> randomValue(size_t maxLength)
+{
+    std::vector<uint8_t> value(1 + rand() % maxLength);
+
+    for (auto &b : value)
+        b = (uint8_t)(rand() % 4); // Few symbols, so equal values (no write) come up too
+
+    return value;
+}
+
+static void testSetGetErase(void)
+{
+    FlashEmulator::format(TEST_SECTORS * SYS_LOG_SECTOR_SIZE);
+
+    {
+        LogStore store;
+        CHECK(store.mount());
+
+        uint32_t states = 0x12345678;
+        CHECK(store.set("states", &states, sizeof(states)));
+        CHECK(store.set("mode", "auto", 4));
+        CHECK(store.set("gone", "x", 1));
+        CHECK(store.erase("gone"));
+        CHECK(store.erase("never")); // Absent keys erase quietly
+
+        auto before = FlashEmulator::bytesWritten();
+        CHECK(store.set("states", &states, sizeof(states)));
+        CHECK(FlashEmulator::bytesWritten() == before); // Unchanged values never reach flash
+
+        CHECK(!store.set("", "x", 1));
+        CHECK(!store.set("sixteen_chars_ok", "x", 1)); // One past SYS_LOG_MAX_KEY
+
+        uint8_t big[SYS_LOG_MAX_VALUE + 1] = {};
+        CHECK(!store.set("big", big, sizeof(big)));
+
+        char small[2];
+        size_t length = sizeof(small);
+        CHECK(!store.get("mode", small, &length));
+        CHECK(length == 4); // Reports the size it needs
+    }
+
+    LogStore store; // Reboot
+    CHECK(store.mount());
+
+    uint32_t states = 0;
+    size_t length = sizeof(states);
+    CHECK(store.get("states", &states, &length) && (length == sizeof(states)) && (states == 0x12345678));
+
+    char mode[8] = {};
+    length = sizeof(mode);
+    CHECK(store.get("mode", mode, &length) && (length == 4) && (memcmp(mode, "auto", 4) == 0));
+
+    length = sizeof(mode);
+    CHECK(!store.get("gone", mode, &length));
+}
+
+static void testNeedsAtLeastThreeSectors(void)
+{
+    FlashEmulator::format(2 * SYS_LOG_SECTOR_SIZE);
+
+    LogStore store;
+    CHECK(!store.mount());
+    CHECK(!store.set("mode", "x", 1));
+}
+
+//
+// A record torn by a power cut is dropped at mount along with the sector's remaining space.  The value before it survives
+// and later writes go to another sector.
+//
+static void testTornRecord(void)
+{
+    FlashEmulator::format(TEST_SECTORS * SYS_LOG_SECTOR_SIZE);
+
+    {
+        LogStore store;
+        CHECK(store.mount());
+        CHECK(store.set("bright", "\x10", 1));
+
+        FlashEmulator::cutAfter(6); // Inside the record header
+        bool blnCut = false;
+
+        try
+        {
+            store.set("bright", "\x20", 1);
+        }
+        catch (PowerCut &)
+        {
+            blnCut = true;
+        }
+        CHECK(blnCut);
+        FlashEmulator::cutAfter(-1);
+    }
+
+    {
+        LogStore store;
+        CHECK(store.mount());
+
+        SYS_LogStoreStats stats;
+        store.getStats(&stats);
+        CHECK(stats.tornRecords == 1);
+
+        uint8_t bright = 0;
+        size_t length = sizeof(bright);
+        CHECK(store.get("bright", &bright, &length) && (bright == 0x10));
+
+        CHECK(store.set("bright", "\x30", 1));
+        CHECK(store.set("mode", "m", 1));
+    }
+
+    LogStore store;
+    CHECK(store.mount());
+
+    uint8_t bright = 0;
+    size_t length = sizeof(bright);
+    CHECK(store.get("bright", &bright, &length) && (bright == 0x30));
+
+    char mode = 0;
+    length = sizeof(mode);
+    CHECK(store.get("mode", &mode, &length) && (mode == 'm'));
+}
+
+//
+// A blank or scribbled partition mounts.  Unreadable sectors are erased by the first compaction before they are used.
+//
+static void testGarbageSectors(void)
+{
+    FlashEmulator::format(TEST_SECTORS * SYS_LOG_SECTOR_SIZE);
+    FlashEmulator::fill(0, 100, 0x00);
+    FlashEmulator::fill(3 * SYS_LOG_SECTOR_SIZE, SYS_LOG_SECTOR_SIZE, 0x5A);
+
+    LogStore store;
+    CHECK(store.mount());
+    CHECK(store.wantsCompaction());
+    CHECK(store.compact());
+    CHECK(!store.wantsCompaction());
+
+    SYS_LogStoreStats stats;
+    store.getStats(&stats);
+    CHECK(stats.sectors == TEST_SECTORS);
+    CHECK(stats.freeSectors == TEST_SECTORS);
+    CHECK(stats.erases == TEST_SECTORS);
+
+    CHECK(store.set("mode", "m", 1));
+}
+
+//
+// Compaction copies live records forward.  A copy must never shadow a newer value or bring back an erased key, and wear has
+// to spread over every sector.
+//
+static void testCompactionOrdering(void)
+{
+    FlashEmulator::format(TEST_SECTORS * SYS_LOG_SECTOR_SIZE);
+    srand(7);
+
+    const char *keys[] = {"states", "bright", "mode", "color", "speed", "tomb"};
+    Model model;
+    uint32_t compactions = 0;
+    LogStore *store = new LogStore();
+    CHECK(store->mount());
+
+    for (int i = 0; i < 40000; i++)
+    {
+        const char *key = keys[rand() % 6];
+
+        if ((strcmp(key, "tomb") == 0) && (rand() % 2))
+        {
+            CHECK(store->erase(key));
+            model.erase(key);
+        }
+        else
+        {
+            auto value = randomValue(SYS_LOG_MAX_VALUE);
+            CHECK(store->set(key, value.data(), value.size()));
+            model[key] = value;
+        }
+
+        if (store->wantsCompaction())
+            CHECK(store->compact());
+
+        if ((i % 5000) == 4999) // Reboot
+        {
+            SYS_LogStoreStats stats;
+            store->getStats(&stats);
+            CHECK(stats.errors == 0);
+            compactions += stats.compactions; // Counters live in RAM
+
+            CHECK(matches(*store, model));
+            delete store;
+            store = new LogStore();
+            CHECK(store->mount());
+            CHECK(matches(*store, model));
+        }
+    }
+
+    SYS_LogStoreStats stats;
+    store->getStats(&stats);
+    CHECK(compactions > 0);
+    CHECK(stats.tornRecords == 0);
+    CHECK(stats.eraseMin > 0);
+    CHECK(stats.eraseMax - stats.eraseMin <= 2);
+    delete store;
+}
+
+//
+// Power is cut at a random byte of a random write or erase -- records, sector activation, compaction copies and erases all
+// get hit.  After every reboot each key must hold its last acknowledged value, or the value that was in flight.
+//
+static void testPowerCuts(void)
+{
+    FlashEmulator::format(TEST_SECTORS * SYS_LOG_SECTOR_SIZE);
+    srand(1);
+
+    const char *keys[] = {"states", "bright", "mode", "k3", "k4", "k5"};
+    Model model;
+    int cuts = 0;
+
+    for (int round = 0; round < 1000; round++)
+    {
+        LogStore store;
+        FlashEmulator::cutAfter(-1);
+
+        if (!store.mount() || !matches(store, model))
+        {
+            printf("  round %d\n", round);
+            CHECK(false);
+            return;
+        }
+
+        std::string pendingKey;
+        std::vector<uint8_t> pendingValue;
+        bool blnPending = false;
+
+        FlashEmulator::cutAfter(rand() % 20000);
+
+        try
+        {
+            for (int i = 0; i < 2000; i++)
+            {
+                const char *key = keys[rand() % 6];
+                auto value = randomValue((key[0] == 's') ? 3 : 40);
+
+                pendingKey = key;
+                pendingValue = value;
+                blnPending = true;
+
+                CHECK(store.set(key, value.data(), value.size()));
+                blnPending = false;
+                model[key] = value;
+
+                if (store.wantsCompaction())
+                    CHECK(store.compact());
+            }
+        }
+        catch (PowerCut &)
+        {
+            cuts++;
+        }
+
+        if (blnPending) // The cut may have come after the record was complete
+        {
+            LogStore probe;
+            FlashEmulator::cutAfter(-1);
+            CHECK(probe.mount());
+
+            uint8_t value[SYS_LOG_MAX_VALUE];
+            size_t length = sizeof(value);
+
+            if (probe.get(pendingKey.c_str(), value, &length) && (length == pendingValue.size()) && (memcmp(value, pendingValue.data(), length) == 0))
+                model[pendingKey] = pendingValue;
+        }
+    }
+    CHECK(cuts > 500);
+}
+
+int main(void)
+{
+    RUN_TEST(testSetGetErase);
+    RUN_TEST(testNeedsAtLeastThreeSectors);
+    RUN_TEST(testTornRecord);
+    RUN_TEST(testGarbageSectors);
+    RUN_TEST(testCompactionOrdering);
+    RUN_TEST(testPowerCuts);
+
+    return (hostTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,239 @@
+#include "system_pulse.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "host_test.hpp"
+
+int hostTestFailures = 0;
+
+//
+// Pulse counter ISR and window math fed with synthetic edge trains.  Time is simulated -- each edge sets the clock and
+// calls the ISR, and windows are closed the way the timer wheel job would close them.
+//
+static int64_t simClock = 0;
+
+int64_t esp_timer_get_time(void)
+{
+    return simClock;
+}
+
+static SYS_PulseCounter newCounter(int64_t start)
+{
+    SYS_PulseCounter counter = {};
+    counter.windowStart = start;
+    counter.jobID = SYS_TIMER_INVALID_JOB;
+    counter.inUse = true;
+    return counter;
+}
+
+//
+// Plays the edges (sorted, in us) through the ISR and closes a window every windowUs plus the given lateness.  Returns
+// every reading.
+//
+static std::vector<SYS_PulseReading> play(SYS_PulseCounter *counter, const std::vector<int64_t> &edges, int64_t windowUs, int64_t endUs,
+                                          int64_t lateUs = 0)
+{
+    std::vector<SYS_PulseReading> readings;
+    size_t next = 0;
+    int64_t deadline = counter->windowStart + windowUs;
+
+    while (deadline + lateUs <= endUs)
+    {
+        while ((next < edges.size()) && (edges[next] < deadline + lateUs))
+        {
+            simClock = edges[next++];
+            GPIOPulseIsrHandler(counter);
+        }
+
+        simClock = deadline + lateUs;
+        readings.push_back(closePulseWindow(counter, simClock));
+        deadline += windowUs; // Periodic jobs are anchored, so lateness does not push later windows out
+    }
+    return readings;
+}
+
+static std::vector<int64_t> edgeTrain(int64_t start, double frequencyHz, int64_t endUs, int jitterUs = 0)
+{
+    std::vector<int64_t> edges;
+
+    for (int64_t k = 0;; k++)
+    {
+        auto t = start + (int64_t)llround(k * 1000000.0 / frequencyHz);
+
+        if (jitterUs > 0)
+            t += (rand() % (2 * jitterUs + 1)) - jitterUs;
+
+        if (t >= endUs)
+            break;
+
+        edges.push_back(t);
+    }
+    return edges;
+}
+
+static bool near(double value, double expected, double tolerance)
+{
+    return fabs(value - expected) <= fabs(expected) * tolerance;
+}
+
+static void testSteadyTrain(void)
+{
+    auto counter = newCounter(1000);
+    auto edges = edgeTrain(1010, 20000.0, 1001000); // 20 kHz for a second
+    auto readings = play(&counter, edges, 100000, 1001000);
+
+    CHECK(readings.size() == 10);
+    CHECK(readings[0].count == 2000);
+    CHECK(readings[0].periodUs == 50); // First window only counts the intervals inside it
+
+    for (const auto &reading : readings)
+    {
+        CHECK(reading.count == 2000);
+        CHECK(reading.periodUs == 50);
+        CHECK(near(reading.frequencyHz, 20000.0, 0.0001));
+        CHECK(reading.windowUs == 100000);
+    }
+
+    CHECK(readings.back().total == edges.size());
+    CHECK(counter.reading.total == edges.size()); // Published for getPulseReading()
+    CHECK(pulseCounterMux.nesting == 0);
+}
+
+//
+// A rate that does not divide the microsecond clock.  The period is truncated, the frequency is not.
+//
+static void testFractionalPeriod(void)
+{
+    auto counter = newCounter(0);
+    auto edges = edgeTrain(7, 30000.0, 500000);
+    auto readings = play(&counter, edges, 50000, 500000);
+
+    uint64_t total = 0;
+
+    for (const auto &reading : readings)
+    {
+        CHECK(reading.periodUs == 33);
+        CHECK(near(reading.frequencyHz, 30000.0, 0.001));
+        total += reading.count;
+    }
+    CHECK(total == edges.size());
+}
+
+static void testJitteredTrain(void)
+{
+    srand(3);
+
+    auto counter = newCounter(0);
+    auto edges = edgeTrain(20, 40000.0, 2000000, 5); // 40 kHz, +/-5 us of jitter on every edge
+    auto readings = play(&counter, edges, 100000, 2000000);
+
+    CHECK(readings.size() == 20);
+
+    for (const auto &reading : readings)
+        CHECK(near(reading.frequencyHz, 40000.0, 0.005));
+
+    CHECK(readings.back().total == edges.size());
+}
+
+//
+// No edge interval is lost between windows -- the spans of all windows after the first add up to the whole train.
+//
+static void testIntervalsAcrossWindows(void)
+{
+    auto counter = newCounter(0);
+    auto edges = edgeTrain(13, 1234.0, 1000000);
+    auto readings = play(&counter, edges, 10000, 1000000);
+
+    double span = 0;
+    uint64_t intervals = 0;
+
+    for (size_t i = 0; i < readings.size(); i++)
+    {
+        auto windowIntervals = (i == 0) ? readings[i].count - 1 : readings[i].count;
+
+        if (readings[i].frequencyHz > 0)
+            span += windowIntervals * 1000000.0 / readings[i].frequencyHz;
+
+        intervals += windowIntervals;
+    }
+
+    CHECK(intervals == edges.size() - 1);
+    CHECK(near(span, (double)(edges.back() - edges.front()), 0.00001));
+}
+
+//
+// Slower than the window -- empty windows read zero and the windows holding an edge read the true period.
+//
+static void testSlowSignal(void)
+{
+    auto counter = newCounter(0);
+    auto edges = edgeTrain(50000, 2.0, 3000000); // 2 Hz, 100 ms windows
+    auto readings = play(&counter, edges, 100000, 3000000);
+
+    int empty = 0;
+    int withEdge = 0;
+
+    for (size_t i = 0; i < readings.size(); i++)
+    {
+        if (readings[i].count == 0)
+        {
+            empty++;
+            CHECK(readings[i].periodUs == 0);
+            CHECK(readings[i].frequencyHz == 0.0f);
+        }
+        else
+        {
+            CHECK(readings[i].count == 1);
+
+            if (withEdge++ == 0)
+                CHECK(readings[i].periodUs == 0); // The first edge alone is not a full period
+            else
+            {
+                CHECK(readings[i].periodUs == 500000);
+                CHECK(near(readings[i].frequencyHz, 2.0, 0.0001));
+            }
+        }
+    }
+
+    CHECK(withEdge == 6);
+    CHECK(empty == 24);
+}
+
+//
+// A window closed late by the timer task is measured as it really was.  The edges that land in the lateness are counted in
+// the late window, so none are lost or counted twice.
+//
+static void testLateWindows(void)
+{
+    auto counter = newCounter(0);
+    auto edges = edgeTrain(5, 10000.0, 1000000);
+    auto readings = play(&counter, edges, 100000, 1000000, 3000);
+
+    CHECK(readings.size() == 9);
+    CHECK(readings[0].windowUs == 103000);
+    CHECK(readings[0].count == 1030);
+
+    for (size_t i = 1; i < readings.size(); i++)
+    {
+        CHECK(readings[i].windowUs == 100000);
+        CHECK(readings[i].count == 1000);
+        CHECK(readings[i].periodUs == 100);
+    }
+
+    CHECK(readings.back().total == 9030);
+}
+
+int main(void)
+{
+    RUN_TEST(testSteadyTrain);
+    RUN_TEST(testFractionalPeriod);
+    RUN_TEST(testJitteredTrain);
+    RUN_TEST(testIntervalsAcrossWindows);
+    RUN_TEST(testSlowSignal);
+    RUN_TEST(testLateWindows);
+
+    return (hostTestFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,324 @@
+#include "system_timerwheel.hpp"
+
+#include <stdlib.h>
+
+#include <vector>
+
+#include "host_test.hpp"
+
+int hostTestFailures = 0;
+
+//
+// TimerWheel on a simulated clock.  serviceTickless() does what SYS::TIMER does when tickless -- sleep until the armed
+// deadline, plus any lateness the test injects, then bring the wheel up to the real clock.
+//
+static int64_t simClock = 0;
+
+int64_t esp_timer_get_time(void)
+{
+    return simClock;
+}
+
+struct JobLog
+{
+    std::vector<int64_t> calls; // simClock at each call
+    std::vector<uint32_t> missed;
+    TimerWheel *wheel;
+    uint16_t jobID;
+    int cancelAfter; // Cancels its own job after this many calls.  Zero never.
+};
+
+static void logJob(void *ctx, uint32_t missed)
+{
+    auto log = (JobLog *)ctx;
+
+    log->calls.push_back(simClock);
+    log->missed.push_back(missed);
+
+    if ((log->cancelAfter > 0) && ((int)log->calls.size() == log->cancelAfter))
+        log->wheel->cancel(log->jobID);
+}
+
+static bool serviceTickless(TimerWheel &wheel, int64_t endUs, int64_t lateUs = 0)
+{
+    auto next = wheel.armNextTick();
+
+    if ((next == UINT64_MAX) || (wheel.tickTime(next) + lateUs > endUs))
+        return false;
+
+    simClock = wheel.tickTime(next) + lateUs;
+    wheel.advance(wheel.currentTick());
+    return true;
+}
+
+static void testOneShot(void)
+{
+    simClock = 5000000;
+
+    TimerWheel wheel;
+    wheel.start(simClock);
+
+    JobLog log = {};
+    uint16_t jobID = SYS_TIMER_INVALID_JOB;
+    bool blnEarliest = false;
+
+    CHECK(wheel.schedule(4500, 0, &logJob, &log, &jobID, SYS_TIMER_POLICY::Skip, &blnEarliest));
+    CHECK(jobID == 0);
+    CHECK(blnEarliest);
+
+    simClock += 4999;
+    wheel.advance(wheel.currentTick());
+    CHECK(log.calls.empty()); // 4.5 ms rounds up to 5 ticks -- never early
+
+    simClock += 1;
+    wheel.advance(wheel.currentTick());
+    CHECK((log.calls.size() == 1) && (log.missed[0] == 0));
+
+    SYS_TimerJobStats stats;
+    CHECK(!wheel.getJobStats(jobID, &stats)); // A one-shot frees its slot when it runs
+
+    CHECK(wheel.schedule(0, 0, &logJob, &log, nullptr, SYS_TIMER_POLICY::Skip, nullptr));
+    CHECK(wheel.armNextTick() == wheel.currentTick() + 1); // Zero delay still waits for the next tick
+
+    CHECK(!wheel.schedule(1000, 0, nullptr, nullptr, nullptr, SYS_TIMER_POLICY::Skip, nullptr));
+}
+
+static void testCancel(void)
+{
+    simClock = 0;
+
+    TimerWheel wheel;
+    wheel.start(0);
+
+    JobLog kept = {};
+    JobLog cancelled = {};
+    JobLog selfCancel = {};
+    uint16_t jobID = 0;
+
+    CHECK(wheel.schedule(10000, 10000, &logJob, &kept, nullptr, SYS_TIMER_POLICY::Skip, nullptr));
+    CHECK(wheel.schedule(3000, 3000, &logJob, &cancelled, &jobID, SYS_TIMER_POLICY::Skip, nullptr));
+    CHECK(wheel.cancel(jobID));
+    CHECK(!wheel.cancel(jobID));
+    CHECK(!wheel.cancel(SYS_TIMER_INVALID_JOB));
+
+    selfCancel.wheel = &wheel;
+    selfCancel.cancelAfter = 3;
+    CHECK(wheel.schedule(7000, 7000, &logJob, &selfCancel, &selfCancel.jobID, SYS_TIMER_POLICY::Skip, nullptr));
+    CHECK(selfCancel.jobID == jobID); // The cancelled slot is reused
+
+    while (serviceTickless(wheel, 1000000))
+        ;
+
+    CHECK(kept.calls.size() == 100);
+    CHECK(cancelled.calls.empty());
+    CHECK(selfCancel.calls.size() == 3);
+}
+
+//
+// Jobs beyond the wheel's 2^24 tick reach are parked and re-inserted until they come due.
+//
+static void testLongDelay(void)
+{
+    simClock = 0;
+
+    TimerWheel wheel;
+    wheel.start(0);
+
+    JobLog log = {};
+    const int64_t sixHours = 6LL * 3600 * 1000000;
+
+    CHECK(wheel.schedule(sixHours, 0, &logJob, &log, nullptr, SYS_TIMER_POLICY::Skip, nullptr));
+
+    int wakes = 0;
+
+    while (serviceTickless(wheel, sixHours * 2))
+        wakes++;
+
+    CHECK((log.calls.size() == 1) && (log.calls[0] == sixHours));
+    CHECK(wakes < 200); // Only cascade boundaries wake us, not every tick
+}
+
+//
+// A mix of periods with no lateness -- every job runs exactly on its own grid and nothing runs out of order.
+//
+static void testExactDeadlines(void)
+{
+    simClock = 0;
+    srand(11);
+
+    TimerWheel wheel;
+    wheel.start(0);
+
+    const int64_t endUs = 2LL * 3600 * 1000000; // Two hours
+    const int count = SYS_TIMER_MAX_JOBS;
+
+    std::vector<JobLog> logs(count);
+    std::vector<int64_t> firstUs(count);
+    std::vector<int64_t> periodUs(count);
+
+    for (int i = 0; i < count; i++)
+    {
+        periodUs[i] = (int64_t)(7 + rand() % 1000) * ((i % 3 == 0) ? 10 : (i % 3 == 1) ? 100 : 1000) * 1000; // 70 ms to 17 minutes
+        firstUs[i] = (int64_t)(1 + rand() % 5000) * 1000;
+        CHECK(wheel.schedule(firstUs[i], periodUs[i], &logJob, &logs[i], nullptr, SYS_TIMER_POLICY::Skip, nullptr));
+    }
+
+    int64_t lastCall = 0;
+    bool blnOrdered = true;
+
+    while (serviceTickless(wheel, endUs))
+    {
+        blnOrdered &= (simClock >= lastCall);
+        lastCall = simClock;
+    }
+    CHECK(blnOrdered);
+
+    for (int i = 0; i < count; i++)
+    {
+        auto expected = (endUs - firstUs[i]) / periodUs[i] + 1;
+        bool blnOnGrid = true;
+
+        for (size_t k = 0; k < logs[i].calls.size(); k++)
+            blnOnGrid &= (logs[i].calls[k] == firstUs[i] + (int64_t)k * periodUs[i]) && (logs[i].missed[k] == 0);
+
+        CHECK((int64_t)logs[i].calls.size() == expected);
+        CHECK(blnOnGrid);
+    }
+}
+
+//
+// 24 simulated hours with the timer task woken late -- usually by a few ms, sometimes by 1.5 s and now and then by 70 s.
+// The jobs must stay on their absolute grids and nothing that is due is left behind.  Coalesce makes one call per wake with
+// every deadline that has passed counted in missed.  Skip makes the same calls with missed always 0 and counts what it
+// dropped in the job stats.  CatchUp makes one call per deadline.
+//
+static int64_t injectedDelay(void)
+{
+    auto roll = rand() % 20000;
+
+    if (roll == 0)
+        return 70 * 1000000LL;
+
+    if (roll < 40)
+        return 1500000;
+
+    return rand() % 3000;
+}
+
+static void run24Hours(SYS_TIMER_POLICY policy, bool blnTickless)
+{
+    simClock = 0;
+    srand(17);
+
+    TimerWheel wheel;
+    wheel.start(0);
+
+    const int64_t endUs = 24LL * 3600 * 1000000;
+    const int64_t periods[] = {250000, 1000000, 5000000, 10000000, 60000000, 300000000};
+    const int count = sizeof(periods) / sizeof(periods[0]);
+
+    JobLog logs[count] = {};
+    uint16_t jobIDs[count] = {};
+
+    for (int i = 0; i < count; i++)
+        CHECK(wheel.schedule(periods[i], periods[i], &logJob, &logs[i], &jobIDs[i], policy, nullptr));
+
+    if (blnTickless)
+    {
+        while (serviceTickless(wheel, endUs, injectedDelay()))
+            ;
+    }
+    else // Free running at 1 kHz.  A late wake stands for the notifications esp_timer dropped meanwhile.
+    {
+        while (simClock < endUs)
+        {
+            simClock += SYS_TIMER_TICK_US;
+
+            if ((rand() % 1000) == 0)
+                simClock += injectedDelay();
+
+            if (simClock > endUs)
+                simClock = endUs;
+
+            wheel.advance(wheel.currentTick());
+        }
+    }
+
+    simClock = endUs;
+    wheel.advance(wheel.currentTick());
+
+    for (int i = 0; i < count; i++)
+    {
+        auto &log = logs[i];
+        int64_t deadlines = 0;
+        bool blnOnGrid = true;
+
+        for (size_t k = 0; k < log.calls.size(); k++)
+        {
+            if (policy == SYS_TIMER_POLICY::Skip)
+            {
+                blnOnGrid &= (log.missed[k] == 0) && (log.calls[k] / periods[i] > deadlines);
+                deadlines = log.calls[k] / periods[i]; // Runs for the latest deadline that has passed
+            }
+            else if (policy == SYS_TIMER_POLICY::CatchUp)
+            {
+                deadlines++;
+                blnOnGrid &= (log.missed[k] == 0) && (log.calls[k] >= deadlines * periods[i]);
+            }
+            else
+            {
+                deadlines += 1 + log.missed[k];
+                blnOnGrid &= (deadlines == log.calls[k] / periods[i]); // Every passed deadline accounted for, none ahead
+            }
+        }
+
+        SYS_TimerJobStats stats = {};
+        CHECK(wheel.getJobStats(jobIDs[i], &stats));
+
+        CHECK(blnOnGrid);
+        CHECK(deadlines == endUs / periods[i]); // No drift after a day
+        CHECK(stats.runs == log.calls.size());
+
+        if (policy == SYS_TIMER_POLICY::Skip)
+            CHECK(stats.runs + stats.dropped == endUs / periods[i]);
+        else
+            CHECK(stats.dropped == 0);
+    }
+
+    if (policy != SYS_TIMER_POLICY::CatchUp)
+        CHECK(logs[0].calls.size() < (size_t)(endUs / periods[0])); // The stalls did fold deadlines together
+}
+
+static void testSkip24Hours(void)
+{
+    run24Hours(SYS_TIMER_POLICY::Skip, true);
+}
+
+static void testCoalesce24Hours(void)
+{
+    run24Hours(SYS_TIMER_POLICY::Coalesce, true);
+}
+
+static void testCatchUp24Hours(void)
+{
+    run24Hours(SYS_TIMER_POLICY::CatchUp, true);
+}
+
+static void testFreeRunning24Hours(void)
+{
+    run24Hours(SYS_TIMER_POLICY::Skip, false);
+}
+
+int main(void)
+{
+    RUN_TEST(testOneShot);
+    RUN_TEST(testCancel);
+    RUN_TEST(testLongDelay);
+    RUN_TEST(testExactDeadlines);
+    RUN_TEST(testSkip24Hours);
+    RUN_TEST(testCoalesce24Hours);
+    RUN_TEST(testCatchUp24Hours);
+    RUN_TEST(testFreeRunning24Hours);
+
+    return (hostTestFailures == 0) ? 0 : 1;
+}